@@ -20,11 +20,252 @@
 #ifndef ACTIVTIY_DB_H
 #define ACTIVITY_DB_H
 
+#include <set>
+
 #include "feature-db.h"
+#include "activity-ranks.h"
 
 using namespace std;
 
 extern bool quantitative;
+extern bool kernel;
+
+//! significance tests of the features of one or more endpoints on a thread pool
+//
+// The tested features of each endpoint are sharded into chunks and the chunks of all
+// endpoints are the jobs of one pool, i.e. several endpoints run concurrently. run() only
+// reads the training set and writes the results of its own chunk, commit() stores the
+// results in the feature statistics in endpoint and feature order, i.e. they do not depend
+// on the number of threads. The activity store must be finalized before run().
+template <class FeatureType, class ActivityType>
+class SignificancePass: public ParallelJobs {
+
+public:
+
+    typedef Feature<FeatureType> * FeatRef;
+
+    static const int chunk_size = 256;
+
+private:
+
+    struct Endpoint {
+        string act;
+        int ep;	// endpoint id in the activity store
+        vector<FeatRef> features;	// features with more than one match
+        vector<FeatRef> infrequent;	// the others (KS tests mark them too infrequent)
+        int first_job;
+        float n_a;	// chi-sq tests: totals, counts and results
+        float n_i;
+        vector<float> f_a;
+        vector<float> f_i;
+        vector<float> chisq;	// with loo_states for the four LOO states: chisq[state * features.size() + k]
+        vector<float> p;
+        vector<char> too_infrequent;	// loo_states only
+        int min_frequency[4];	// chisq_min_frequency() of the totals of each LOO state
+        shared_ptr<ActivityRanks> ranks;	// KS tests: ranked activities and results
+        vector<float> d;
+        vector<float> median;
+        vector<int> nr;	// 0: no activities (the compounds have been removed)
+        shared_ptr<LooRanks> loo;	// KS tests with loo_states: steps of the LOO subsets
+    };
+
+    ActivityStore<ActivityType> * store;
+    int nr_compounds;
+    bool loo_states;
+    vector<Endpoint> endpoints;
+    int nr_jobs;
+    vector<ActivityRanks::Scratch> scratch;	// per thread
+
+    //! chi-sq tests of the features begin .. end-1 of e
+    void test(Endpoint & e, int begin, int end, int thread_nr, bool) {
+        const typename ActivityStore<ActivityType>::Value * v;
+        const typename ActivityStore<ActivityType>::Value * v_end;
+        vector<int> * matches;
+        vector<int>::iterator cur_comp;
+
+        for (int k = begin; k < end; k++) {	// AM: cell sums
+            int a = 0;
+            int i = 0;
+            matches = e.features[k]->get_matches_ptr();
+            for (cur_comp = matches->begin(); cur_comp != matches->end(); cur_comp++) {
+                if (store->is_available(e.ep, *cur_comp)) {
+                    store->get_values(e.ep, *cur_comp, &v, &v_end);
+                    for (; v != v_end; v++) {
+                        if (*v) a++;
+                        else i++;
+                    }
+                }
+            }
+            e.f_a[k] = a;
+            e.f_i[k] = i;
+        }
+        if (!loo_states) {
+            chisq_significance(&e.f_a[begin], &e.f_i[begin], end - begin, e.n_a, e.n_i, &e.chisq[begin], &e.p[begin]);
+            return;
+        }
+
+        // pre-computing 4 significance values for all features for loo classification
+        // the right value for each feature depends on two criteria:
+        // - is the test structure active (reduces either n_a, or n_i)
+        // - does the feature occur in the test structure (if yes then reduce either f_a or f_i)
+        vector<float> f_a(end - begin);
+        vector<float> f_i(end - begin);
+        for (int state = 0; state < 4; state++) {
+            bool str_active = state & 2;
+            bool feat_occurs = state & 1;
+            int first = state * e.features.size() + begin;
+            for (int k = begin; k < end; k++) {
+                f_a[k - begin] = e.f_a[k] - (str_active && feat_occurs ? 1 : 0);
+                f_i[k - begin] = e.f_i[k] - (!str_active && feat_occurs ? 1 : 0);
+            }
+            chisq_significance(&f_a[0], &f_i[0], end - begin, e.n_a - (str_active ? 1 : 0), e.n_i - (str_active ? 0 : 1), &e.chisq[first], &e.p[first]);
+            for (int k = 0; k < end - begin; k++) {
+                if (f_a[k] < 0 || f_i[k] < 0) {	// inconsistent counts
+                    e.chisq[first + k] = 0;
+                    e.p[first + k] = 0;
+                }
+                e.too_infrequent[first + k] = f_a[k] < 0 || f_i[k] < 0 || f_a[k] + f_i[k] < e.min_frequency[state];
+            }
+        }
+    };
+
+    //! KS tests of the features begin .. end-1 of e
+    void test(Endpoint & e, int begin, int end, int thread_nr, float) {
+        for (int k = begin; k < end; k++) {
+            if (!e.ranks->ks(*e.features[k]->get_matches_ptr(), &scratch[thread_nr], &e.d[k], &e.nr[k], &e.median[k]))
+                e.nr[k] = 0;
+            else if (e.loo)
+                e.loo->add_feature(e.features[k]->get_id(), *e.features[k]->get_matches_ptr(), &scratch[thread_nr], e.median[k]);
+        }
+    };
+
+    void commit(Endpoint & e, bool) {
+        if (loo_states) {
+            int nr = e.features.size();
+            for (int k = 0; k < nr; k++) {
+                e.features[k]->set_loo_counts(e.act, e.n_a, e.n_i, e.f_a[k], e.f_i[k]);
+                for (int state = 0; state < 4; state++)
+                    e.features[k]->set_loo_significance(e.act, state & 2, state & 1, e.chisq[state * nr + k], e.p[state * nr + k], e.too_infrequent[state * nr + k]);
+            }
+            return;
+        }
+        int min_frequency = chisq_min_frequency(e.n_a, e.n_i);
+        for (unsigned int k = 0; k < e.features.size(); k++)
+            e.features[k]->set_significance(e.act, e.n_a, e.n_i, e.f_a[k], e.f_i[k], e.chisq[k], e.p[k], min_frequency);
+    };
+
+    void commit(Endpoint & e, float) {
+        for (unsigned int k = 0; k < e.features.size(); k++) {
+            // AM: BUGFIX: Do not calc sig for feat w/o occurrences (possible due to remove_duplicates())
+            if (e.nr[k] > 0)
+                e.features[k]->set_ks_significance(e.act, e.d[k], e.ranks->size(), e.nr[k], e.median[k], e.ranks->get_median());
+        }
+        for (unsigned int k = 0; k < e.infrequent.size(); k++)
+            e.infrequent[k]->set_too_infrequent(e.act); // mark infrequent features
+    };
+
+    //! totals of the chi-sq tests
+    void prepare(Endpoint & e, const vector<bool> & activity_values) {
+        e.n_a = 0;
+        e.n_i = 0;
+        for (vector<bool>::const_iterator a = activity_values.begin(); a != activity_values.end(); a++) {	// AM: column sums
+            if (*a) e.n_a++;
+            else e.n_i++;
+        }
+        e.f_a.resize(e.features.size());
+        e.f_i.resize(e.features.size());
+        if (!loo_states) {
+            e.chisq.resize(e.features.size());
+            e.p.resize(e.features.size());
+            return;
+        }
+        e.chisq.resize(4 * e.features.size());
+        e.p.resize(4 * e.features.size());
+        e.too_infrequent.resize(4 * e.features.size());
+        for (int state = 0; state < 4; state++)	// the test structure is not part of the training set
+            e.min_frequency[state] = chisq_min_frequency(e.n_a - (state & 2 ? 1 : 0), e.n_i - (state & 2 ? 0 : 1));
+    };
+
+    //! ranks of the KS tests
+    void prepare(Endpoint & e, const vector<float> & activity_values) {
+        const typename ActivityStore<ActivityType>::Value * begin;
+        const typename ActivityStore<ActivityType>::Value * end;
+        int nr_features = 0;
+
+        e.ranks.reset(new ActivityRanks(activity_values));
+        for (int n = 0; n < nr_compounds; n++) {
+            if (store->is_available(e.ep, n)) {
+                store->get_values(e.ep, n, &begin, &end);
+                e.ranks->add_compound(begin, end);
+            }
+            else
+                e.ranks->add_compound(NULL, NULL);
+        }
+        e.d.resize(e.features.size());
+        e.median.resize(e.features.size());
+        e.nr.resize(e.features.size());
+        if (loo_states) {
+            for (unsigned int k = 0; k < e.features.size(); k++)
+                nr_features = max(nr_features, e.features[k]->get_id() + 1);
+            e.loo.reset(new LooRanks(e.ranks, nr_features));
+        }
+    };
+
+public:
+
+    //! loo_states: precompute the LOO states of the chi-sq tests (ClassFeat::set_loo_significance()),
+    //! or the steps of the KS tests for LOO subsets in addition to the tests of the whole set (see get_loo_ranks())
+    SignificancePass(ActivityStore<ActivityType> * store, int nr_compounds, bool loo_states): store(store), nr_compounds(nr_compounds), loo_states(loo_states), nr_jobs(0) {};
+
+    //! test features for endpoint act, activity_values: the activities of all available compounds
+    void add_endpoint(string act, const vector<ActivityType> & activity_values, const vector<FeatRef> & features) {
+        typename vector<FeatRef>::const_iterator cur_feat;
+
+        endpoints.push_back(Endpoint());
+        Endpoint & e = endpoints.back();
+        e.act = act;
+        e.ep = store->get_id(act);
+        for (cur_feat = features.begin(); cur_feat != features.end(); cur_feat++) {
+            if ((*cur_feat)->nr_matches() > 1) // remove features that match on a single compound
+                e.features.push_back(*cur_feat);
+            else
+                e.infrequent.push_back(*cur_feat);
+        }
+        e.first_job = nr_jobs;
+        nr_jobs += (e.features.size() + chunk_size - 1) / chunk_size;
+        this->prepare(e, activity_values);
+    };
+
+    int get_nr_jobs() {
+        return(nr_jobs);
+    };
+
+    void init(int nr_threads) {
+        scratch.assign(max(nr_threads, 1), ActivityRanks::Scratch());
+    };
+
+    void run(int thread_nr, int job_nr) {
+        int i = endpoints.size() - 1;
+        while (endpoints[i].first_job > job_nr)
+            i--;
+        Endpoint & e = endpoints[i];
+        int begin = (job_nr - e.first_job) * chunk_size;
+        int end = min((int) e.features.size(), begin + chunk_size);
+        this->test(e, begin, end, thread_nr, ActivityType());
+    };
+
+    //! precomputed KS tests without one value for the i-th endpoint (NULL for chi-sq tests or without loo_states)
+    shared_ptr<LooRanks> get_loo_ranks(int i) {
+        return(endpoints[i].loo);
+    };
+
+    //! store the results in the feature statistics (in the calling thread)
+    void commit() {
+        for (unsigned int i = 0; i < endpoints.size(); i++)
+            this->commit(endpoints[i], ActivityType());
+    };
+
+};
 
 //! compounds with activities and features
 template <class MolType, class FeatureType, class ActivityType>
@@ -35,6 +276,43 @@ private:
     vector<string> activity_names;
     shared_ptr<Out> out;
 
+    //! time spent in fill_weights()
+    float weight_secs;
+
+    //! endpoints with new activities, all significances have to be recalculated
+    set<string> stale_acts;
+    //! features with new matches, their significances have to be recalculated for each endpoint
+    map<string, set<Feature<FeatureType> *> > stale_features;
+
+    //! move the changed features of FeatMolVect to the stale features of each endpoint
+    void collect_stale_features();
+
+    //! determine significance for a subset of the training set features
+    void feature_significance(string act, vector<bool> activity_values, vector<Feature<FeatureType> *> * features);
+    void feature_significance(string act, const vector<float> & activity_values, vector<Feature<FeatureType> *> * features);
+    //! run the tests of pass on nr_threads threads and store the results
+    void run_significance(SignificancePass<FeatureType, ActivityType> & pass);
+
+    //! precompute the similarity weights of all features for endpoint act (after a significance pass)
+    void fill_weights(string act);
+
+    //! compounds made unavailable by remove_duplicates()
+    set<int> excluded;
+    //! endpoints whose statistics have been computed for the whole training set (exclude_significance() builds on them)
+    set<string> full_acts;
+    //! endpoints whose statistics have been changed for the excluded compounds, restore_duplicates() rolls them back
+    set<string> delta_acts;
+
+    //! change the statistics of act from the whole training set to the training set without the excluded compounds
+    void delta_significance(string act, bool);
+    void delta_significance(string act, float);
+
+    //! precomputed KS tests of regression endpoints for LOO subsets (precompute_feature_significance()),
+    //! cleared when the training set changes
+    map<string, shared_ptr<LooRanks> > loo_ranks;
+    //! KS tests of act without compound comp from the precomputed steps
+    void loo_significance(string act, const LooRanks & loo, int comp);
+
 public:
 
     typedef FeatMol < MolType, FeatureType, ActivityType > * MolRef ;
@@ -45,9 +323,42 @@ public:
     //! ActMolVect constructor, called directly by Predictor(). Reads in activity values after (implicitly) calling super class constructor FeatMolVect()
     ActMolVect< MolType, FeatureType, ActivityType >(char * act_file,char * feat_file, char  * structure_file, shared_ptr<Out> out);
 
-    //! read activities
+    //! ActMolVect constructor for training sets saved with write_snapshot()
+    ActMolVect< MolType, FeatureType, ActivityType >(Snapshot * snapshot, shared_ptr<Out> out);
+
+    //! save structures, features and activities as binary snapshot
+    void write_snapshot(char * snapshot_file);
+
+    //! read activities (of new or existing compounds)
     void read_act(char * act_file);
 
+    //! append structures, features and activities, feature file compound numbers refer to the lines of structure_file
+    void append(char * structure_file, char * act_file, char * feat_file);
+
+    //! append a single structure, returns its index (-1 if the ID is not unique)
+    int add_compound(string id, string smiles) {
+        return(MolVect< MolType, FeatureType, ActivityType >::add_compound(id, smiles));
+    };
+
+    //! add a match of feature name (e.g. a SMARTS) to compound id
+    bool add_feature_match(string name, string id);
+
+    //! add an activity value (not log transformed for regression) of endpoint act to compound id
+    bool add_activity(string id, string act, ActivityType value);
+
+    //! recalculate outdated significances of endpoint act (after appending), returns false if nothing was outdated
+    bool update_significance(string act);
+
+    //! make the training set instances of test_comp unavailable (see MolVect::remove_duplicates())
+    vector<sMolRef> remove_duplicates(sMolRef test_comp);
+
+    //! make the compounds of remove_duplicates() available again and restore the statistics of the whole training set
+    void restore_duplicates(vector<sMolRef> & duplicates);
+
+    //! significances of act without the compounds of remove_duplicates(): the statistics of the whole training set
+    //! (computed on the first call) are updated for the removed compounds and restored by restore_duplicates()
+    void exclude_significance(string act);
+
     //! get activity values for activity act
     vector<ActivityType> get_activity_values(string act);
 
@@ -58,16 +369,25 @@ public:
         return(activity_names);
     }
 
+    //! total time spent to fill the similarity weight tables
+    float get_weight_secs() {
+        return(weight_secs);
+    };
+
     // MG : precompute significance
-    void precompute_feature_significance(string act, vector<bool> activity_values);
-    void precompute_feature_significance(string act, vector<float> activity_values);
+    //! LOO significances of all features for the endpoints acts (endpoints run concurrently): the LOO states of
+    //! classification features, or the whole set significances and the KS steps of exclude_significance() for single compounds
+    void precompute_feature_significance(const vector<string> & acts);
     // MG
 
     //! determine significance of boolean training set features using chi-sq test
     void feature_significance(string act, vector<bool> activity_values);
 
     //! determine significance of quantitative training set features using KS test
-    void feature_significance(string act, vector<float> activity_values);
+    void feature_significance(string act, const vector<float> & activity_values);
+
+    //! determine significance of all training set features for the endpoints acts (endpoints run concurrently)
+    void feature_significance(const vector<string> & acts);
 
     void print_sig_features(float limit, char* smarts);
     void print_sorted_features(float limit, char* smarts);
@@ -77,7 +397,18 @@ public:
 
 // read activity file
 template <class MolType, class FeatureType, class ActivityType>
-ActMolVect<MolType, FeatureType, ActivityType>::ActMolVect(char* act_file,char* feat_file, char* structure_file, shared_ptr<Out> out): FeatMolVect< MolType, FeatureType, ActivityType >(feat_file,structure_file,out), out(out) {
+ActMolVect<MolType, FeatureType, ActivityType>::ActMolVect(char* act_file,char* feat_file, char* structure_file, shared_ptr<Out> out): FeatMolVect< MolType, FeatureType, ActivityType >(feat_file,structure_file,out), out(out), weight_secs(0) {
+
+    this->read_act(act_file);
+
+    // everything is new
+    stale_acts.clear();
+    this->take_changed_features();
+
+};
+
+template <class MolType, class FeatureType, class ActivityType>
+void ActMolVect<MolType, FeatureType, ActivityType>::read_act(char * act_file) {
 
     string line;
     string tmp_field;
@@ -87,7 +418,7 @@ ActMolVect<MolType, FeatureType, ActivityType>::ActMolVect(char* act_file,char*
     sMolRef mol_ptr;
     int line_nr = 0;
 
-    ifstream input;
+    InputFile input;
     input.open(act_file);
 
     *out << "Reading activities from " << act_file << endl;
@@ -128,6 +459,8 @@ ActMolVect<MolType, FeatureType, ActivityType>::ActMolVect(char* act_file,char*
             else if (field_nr == 1) {	// ACTIVITY NAME
                 activity_names.push_back(tmp_field);
                 act_name = tmp_field;
+                stale_acts.insert(act_name);
+                loo_ranks.erase(act_name);
             }
 
             else if (field_nr == 2) {	// ACTIVITY VALUES
@@ -162,7 +495,14 @@ ActMolVect<MolType, FeatureType, ActivityType>::ActMolVect(char* act_file,char*
 
     }
 
+    if (input.failed()) {
+        *out << act_file << " is corrupt or truncated ... exiting.\n";
+        out->print_err();
+        exit(1);
+    }
+
     input.close();
+    this->activity_store.finalize();
 
     // unique activity names
     sort(activity_names.begin(),activity_names.end());
@@ -173,21 +513,408 @@ ActMolVect<MolType, FeatureType, ActivityType>::ActMolVect(char* act_file,char*
 
 
 
+// read activities from a snapshot
+template <class MolType, class FeatureType, class ActivityType>
+ActMolVect<MolType, FeatureType, ActivityType>::ActMolVect(Snapshot * snapshot, shared_ptr<Out> out): FeatMolVect< MolType, FeatureType, ActivityType >(snapshot,out), out(out), weight_secs(0) {
+
+    const SnapActivity * act;
+    const float * values;
+    sMolRef mol_ptr;
+
+    if (snapshot->is_quantitative() != quantitative) {
+        *out << "Snapshot contains " << (snapshot->is_quantitative() ? "regression" : "classification") << " data ... exiting.\n";
+        out->print_err();
+        exit(1);
+    }
+
+    // endpoints are stored sorted and unique
+    for (int n = 0; n < snapshot->get_nr_endpoints(); n++)
+        activity_names.push_back(snapshot->get_endpoint(n));
+
+    for (int n = 0; n < snapshot->get_nr_activities(); n++) {
+
+        act = snapshot->get_activity(n);
+        values = snapshot->get_values(act);
+        mol_ptr = this->get_compound(act->compound);
+
+        for (unsigned int i = 0; i < act->nr_values; i++)
+            mol_ptr->set_activity(activity_names[act->endpoint], (ActivityType) values[i]);
+
+        if (!act->available)
+            mol_ptr->set_na(activity_names[act->endpoint]);
+    }
+    this->activity_store.finalize();
+
+};
+
+template <class MolType, class FeatureType, class ActivityType>
+void ActMolVect<MolType, FeatureType, ActivityType>::append(char * structure_file, char * act_file, char * feat_file) {
+
+    int first_compound = this->read_structures(structure_file);
+    this->read_features(feat_file, first_compound);
+    this->read_act(act_file);
+
+};
+
+template <class MolType, class FeatureType, class ActivityType>
+bool ActMolVect<MolType, FeatureType, ActivityType>::add_feature_match(string name, string id) {
+
+    sMolRef mol_ptr = this->get_molfromid(id);
+
+    if (mol_ptr == sMolRef()) {
+        *out << "No structure for ID " << id << ".\n";
+        out->print_err();
+        return(false);
+    }
+
+    this->FeatMolVect< MolType, FeatureType, ActivityType >::add_feature_match(name, mol_ptr->get_line_nr());
+    return(true);
+
+};
+
+template <class MolType, class FeatureType, class ActivityType>
+bool ActMolVect<MolType, FeatureType, ActivityType>::add_activity(string id, string act, ActivityType value) {
+
+    sMolRef mol_ptr = this->get_molfromid(id);
+
+    if (mol_ptr == sMolRef()) {
+        *out << "No structure for ID " << id << ".\n";
+        out->print_err();
+        return(false);
+    }
+
+    if (quantitative) value = log10(value);
+    mol_ptr->set_activity(act, value);
+    this->activity_store.finalize();
+
+    if (!binary_search(activity_names.begin(), activity_names.end(), act))
+        activity_names.insert(lower_bound(activity_names.begin(), activity_names.end(), act), act);
+    stale_acts.insert(act);
+    loo_ranks.erase(act);
+
+    return(true);
+
+};
+
+template <class MolType, class FeatureType, class ActivityType>
+void ActMolVect<MolType, FeatureType, ActivityType>::collect_stale_features() {
+
+    vector<FeatRef> changed = this->take_changed_features();
+    typename vector<FeatRef>::iterator cur_feat;
+    vector<string>::iterator cur_act;
+
+    if (changed.empty())
+        return;
+
+    loo_ranks.clear();
+    for (cur_act = activity_names.begin(); cur_act != activity_names.end(); cur_act++) {
+        if (stale_acts.find(*cur_act) == stale_acts.end())
+            stale_features[*cur_act].insert(changed.begin(), changed.end());
+    }
+
+};
+
+template <class MolType, class FeatureType, class ActivityType>
+bool ActMolVect<MolType, FeatureType, ActivityType>::update_significance(string act) {
+
+    vector<ActivityType> activity_values;
+
+    this->collect_stale_features();
+
+    if (delta_acts.find(act) != delta_acts.end() && (stale_acts.find(act) != stale_acts.end() || stale_features.find(act) != stale_features.end())) {
+        this->get_features()->front()->rollback_delta(act);	// the changes below must not be rolled back
+        delta_acts.erase(act);
+    }
+
+    if (stale_acts.find(act) != stale_acts.end()) {	// recalculate all features (and clear the stale marks)
+        activity_values = this->get_activity_values(act);
+        this->feature_significance(act, activity_values);
+        return(true);
+    }
+
+    typename map<string, set<FeatRef> >::iterator stale = stale_features.find(act);
+
+    if (stale == stale_features.end())
+        return(false);
+
+    vector<FeatRef> features(stale->second.begin(), stale->second.end());
+    stale_features.erase(stale);
+    activity_values = this->get_activity_values(act);
+    this->feature_significance(act, activity_values, &features);
+    return(true);
+
+};
+
+template <class MolType, class FeatureType, class ActivityType>
+vector<shared_ptr<FeatMol < MolType, FeatureType, ActivityType > > > ActMolVect<MolType, FeatureType, ActivityType>::remove_duplicates(sMolRef test_comp) {
+
+    vector<sMolRef> duplicates = MolVect< MolType, FeatureType, ActivityType >::remove_duplicates(test_comp);
+    typename vector<sMolRef>::iterator cur_dup;
+
+    // the statistics of the endpoints with deltas do not cover the new exclusions
+    for (set<string>::iterator cur_act = delta_acts.begin(); cur_act != delta_acts.end(); cur_act++)
+        this->get_features()->front()->rollback_delta(*cur_act);
+    delta_acts.clear();
+
+    for (cur_dup = duplicates.begin(); cur_dup != duplicates.end(); cur_dup++)
+        excluded.insert((*cur_dup)->get_line_nr());
+    return(duplicates);
+
+};
+
+template <class MolType, class FeatureType, class ActivityType>
+void ActMolVect<MolType, FeatureType, ActivityType>::restore_duplicates(vector<sMolRef> & duplicates) {
+
+    typename vector<sMolRef>::iterator cur_dup;
+
+    for (cur_dup = duplicates.begin(); cur_dup != duplicates.end(); cur_dup++) {
+        (*cur_dup)->restore();
+        excluded.erase((*cur_dup)->get_line_nr());
+    }
+
+    for (set<string>::iterator cur_act = delta_acts.begin(); cur_act != delta_acts.end(); cur_act++)
+        this->get_features()->front()->rollback_delta(*cur_act);
+    delta_acts.clear();
+
+};
+
+template <class MolType, class FeatureType, class ActivityType>
+void ActMolVect<MolType, FeatureType, ActivityType>::exclude_significance(string act) {
+
+    vector<sFeatRef> * features = this->get_features();
+    vector<ActivityType> activity_values;
+    set<int>::iterator cur_c;
+
+    if (features->empty())
+        return;
+
+    // outdated features invalidate the whole set statistics
+    this->collect_stale_features();
+    if (stale_acts.find(act) != stale_acts.end() || stale_features.find(act) != stale_features.end()) {
+        full_acts.erase(act);
+        if (delta_acts.erase(act))
+            features->front()->rollback_delta(act);
+    }
+
+    if (delta_acts.find(act) != delta_acts.end())
+        return;	// deltas of the current exclusions are in place
+
+    if (full_acts.find(act) == full_acts.end()) {
+        for (cur_c = excluded.begin(); cur_c != excluded.end(); cur_c++)
+            this->activity_store.restore(*cur_c);
+        activity_values = this->get_activity_values(act);
+        this->feature_significance(act, activity_values);
+        for (cur_c = excluded.begin(); cur_c != excluded.end(); cur_c++)
+            this->activity_store.remove(*cur_c);
+        full_acts.insert(act);
+    }
+
+    if (excluded.empty())
+        return;
+
+    features->front()->begin_delta(act);
+    delta_acts.insert(act);
+    this->delta_significance(act, ActivityType());
+
+    clock_t t = clock();
+    features->front()->finish_delta(act);	// only the weights of the changed features
+    weight_secs += (float)(clock()-t)/CLOCKS_PER_SEC;
+
+};
+
+template <class MolType, class FeatureType, class ActivityType>
+void ActMolVect<MolType, FeatureType, ActivityType>::delta_significance(string act, bool) {
+
+    vector<sFeatRef> * features = this->get_features();
+    typename vector<sFeatRef>::iterator cur_feat;
+    vector<Feature<FeatureType> *> * comp_features;
+    typename vector<Feature<FeatureType> *>::iterator cur_cf;
+    unordered_map<Feature<FeatureType> *, pair<float, float> > deltas;	// removed active and inactive occurrences
+    typename unordered_map<Feature<FeatureType> *, pair<float, float> >::iterator delta;
+    vector<ActivityType> activity_values = this->get_activity_values(act);
+    typename vector<ActivityType>::iterator cur_act_val;
+    const typename ActivityStore<ActivityType>::Value * begin;
+    const typename ActivityStore<ActivityType>::Value * end;
+    int ep = this->activity_store.get_id(act);
+    int n_a = 0;
+    int n_i = 0;
+    int d_a = 0;
+    int d_i = 0;
+
+    for (cur_act_val = activity_values.begin(); cur_act_val != activity_values.end(); cur_act_val++) {
+        if (*cur_act_val)
+            n_a++;
+        else
+            n_i++;
+    }
+
+    // counts of the features of the excluded compounds
+    for (set<int>::iterator cur_c = excluded.begin(); cur_c != excluded.end(); cur_c++) {
+        if (!this->activity_store.was_available(ep, *cur_c))
+            continue;
+        int a = 0;
+        int i = 0;
+        this->activity_store.get_values(ep, *cur_c, &begin, &end);
+        for (; begin != end; begin++) {
+            if (*begin) a++;
+            else i++;
+        }
+        if (a + i == 0)
+            continue;
+        d_a += a;
+        d_i += i;
+        comp_features = this->get_compound(*cur_c)->get_sorted_features();
+        for (cur_cf = comp_features->begin(); cur_cf != comp_features->end(); cur_cf++) {
+            deltas[*cur_cf].first += a;
+            deltas[*cur_cf].second += i;
+        }
+    }
+
+    if (d_a == 0 && d_i == 0)
+        return;	// the excluded compounds have no values for act
+
+    // the totals have changed, chi-sq of the other features from their cached counts
+    for (cur_feat = features->begin(); cur_feat != features->end(); cur_feat++) {
+        if ((*cur_feat)->nr_matches() > 1) {
+            delta = deltas.find(cur_feat->get());
+            if (delta == deltas.end())
+                (*cur_feat)->delta_significance(act, n_a, n_i, 0, 0);
+            else
+                (*cur_feat)->delta_significance(act, n_a, n_i, delta->second.first, delta->second.second);
+        }
+    }
+
+};
+
+template <class MolType, class FeatureType, class ActivityType>
+void ActMolVect<MolType, FeatureType, ActivityType>::delta_significance(string act, float) {
+
+    vector<sFeatRef> * all_features = this->get_features();
+    vector<FeatRef> features;
+    typename vector<sFeatRef>::iterator cur_feat;
+    const typename ActivityStore<ActivityType>::Value * begin;
+    const typename ActivityStore<ActivityType>::Value * end;
+    int ep = this->activity_store.get_id(act);
+    int removed = 0;
+
+    for (set<int>::iterator cur_c = excluded.begin(); cur_c != excluded.end(); cur_c++) {
+        if (this->activity_store.was_available(ep, *cur_c)) {
+            this->activity_store.get_values(ep, *cur_c, &begin, &end);
+            removed += end - begin;
+        }
+    }
+    if (removed == 0)
+        return;	// the excluded compounds have no values for act
+
+    typename map<string, shared_ptr<LooRanks> >::iterator loo = loo_ranks.find(act);
+    if (loo != loo_ranks.end() && excluded.size() == 1 && removed == 1) {
+        this->loo_significance(act, *loo->second, *excluded.begin());
+        return;
+    }
+
+    // KS has no sufficient statistics: the reference distribution has changed for every feature
+    SignificancePass<FeatureType, ActivityType> pass(&this->activity_store, this->get_size(), false);
+    features.reserve(all_features->size());
+    for (cur_feat = all_features->begin(); cur_feat != all_features->end(); cur_feat++)
+        features.push_back(cur_feat->get());
+    pass.add_endpoint(act, this->get_activity_values(act), features);
+    this->run_significance(pass);
+
+};
+
+template <class MolType, class FeatureType, class ActivityType>
+void ActMolVect<MolType, FeatureType, ActivityType>::loo_significance(string act, const LooRanks & loo, int comp) {
+
+    vector<sFeatRef> * features = this->get_features();
+    vector<int> * comp_features = this->get_compound(comp)->get_feature_ids();	// ascending
+    vector<int>::iterator occurs = comp_features->begin();
+    int nr_features = min(loo.size(), (int) features->size());
+    vector<float> values;
+    float all_median;
+    float median;
+    float d;
+    int group;
+    int nr;
+
+    if (!loo.left_out(comp, &group, &all_median))
+        return;	// no value that the tests could have used
+
+    for (int id = 0; id < nr_features; id++) {
+        while (occurs != comp_features->end() && *occurs < id)
+            occurs++;
+        if (loo.ks(id, group, occurs != comp_features->end() && *occurs == id, &values, &d, &nr, &median))
+            (*features)[id]->set_ks_significance(act, d, loo.get_nr_values(), nr, median, all_median);
+    }
+
+};
+
+template <class MolType, class FeatureType, class ActivityType>
+void ActMolVect<MolType, FeatureType, ActivityType>::write_snapshot(char * snapshot_file) {
+
+    SnapshotWriter writer(quantitative);
+    vector<sMolRef> compounds = this->get_compounds();
+    vector<sFeatRef> * features = this->get_features();
+    typename vector<sMolRef>::iterator cur_mol;
+    typename vector<sFeatRef>::iterator cur_feat;
+    vector<string>::iterator cur_act;
+
+    *out << "Writing snapshot to " << snapshot_file << endl;
+    out->print_err();
+
+    for (cur_mol = compounds.begin(); cur_mol != compounds.end(); cur_mol++)
+        writer.add_compound((*cur_mol)->get_line_nr(), (*cur_mol)->get_id(), (*cur_mol)->get_smiles(), (*cur_mol)->get_inchi());
+
+    for (cur_feat = features->begin(); cur_feat != features->end(); cur_feat++)
+        writer.add_feature((*cur_feat)->get_name(), (*cur_feat)->get_matches_ptr());
+
+    for (cur_act = activity_names.begin(); cur_act != activity_names.end(); cur_act++)
+        writer.add_endpoint(*cur_act);
+
+    for (unsigned int n = 0; n < compounds.size(); n++) {
+
+        map<string, vector<ActivityType> > activities = compounds[n]->get_activities();
+
+        for (cur_act = activity_names.begin(); cur_act != activity_names.end(); cur_act++) {
+
+            vector<float> vals;
+            bool available = compounds[n]->is_available(*cur_act);
+            typename map<string, vector<ActivityType> >::iterator cur_vals = activities.find(*cur_act);
+
+            if (cur_vals != activities.end())
+                vals.assign(cur_vals->second.begin(), cur_vals->second.end());
+
+            if (vals.size() || available)
+                writer.add_activity(n, *cur_act, &vals, available);
+        }
+    }
+
+    if (writer.is_too_large()) {
+        *out << "Training set too large for a snapshot (more than 4GB of strings or 2^32 postings/values), " << snapshot_file << " not written" << endl;
+        out->print_err();
+        exit(1);
+    }
+
+    if (!writer.write(snapshot_file)) {
+        *out << "Cannot write " << snapshot_file << endl;
+        out->print_err();
+        exit(1);
+    }
+
+};
+
 template <class MolType, class FeatureType, class ActivityType>
 vector<ActivityType> ActMolVect<MolType, FeatureType, ActivityType>::get_activity_values(vector<int> comp_nrs, string act) {
 
     vector<ActivityType> activities;
-    vector<ActivityType> tmp;
-    vector<sMolRef> compounds = this->get_compounds();
     vector<int>::iterator cur_comp;
-    typename vector<ActivityType>::iterator cur_a;
+    const typename ActivityStore<ActivityType>::Value * begin;
+    const typename ActivityStore<ActivityType>::Value * end;
+    int ep = this->activity_store.get_id(act);
 
     for (cur_comp=comp_nrs.begin();cur_comp!=comp_nrs.end();cur_comp++) {
-        if (compounds[*cur_comp]->is_available(act)) { // *
-            tmp = compounds[*cur_comp]->get_act(act);
-            for (cur_a=tmp.begin();cur_a!=tmp.end();cur_a++) {
-                activities.push_back(*cur_a);
-            }
+        if (this->activity_store.is_available(ep, *cur_comp)) { // *
+            this->activity_store.get_values(ep, *cur_comp, &begin, &end);
+            activities.insert(activities.end(), begin, end);
         }
     }
 
@@ -198,20 +925,19 @@ template <class MolType, class FeatureType, class ActivityType>
 vector<ActivityType> ActMolVect<MolType, FeatureType, ActivityType>::get_activity_values(string act) {
 
     vector<ActivityType> activities;
-    vector<ActivityType> tmp;
-    vector<sMolRef> compounds = this->get_compounds();
-    typename vector<ActivityType>::iterator cur_a;
-    typename vector<sMolRef>::iterator cur_comp;
-
-    for (cur_comp=compounds.begin();cur_comp!=compounds.end();cur_comp++) {
-
-        if ((*cur_comp)->is_available(act)) {
-            tmp = (*cur_comp)->get_act(act);
-            for (cur_a=tmp.begin();cur_a!=tmp.end();cur_a++) {
-                activities.push_back(*cur_a);
-            }
+    const typename ActivityStore<ActivityType>::Value * begin;
+    const typename ActivityStore<ActivityType>::Value * end;
+    int ep = this->activity_store.get_id(act);
+    int nr_compounds = this->get_size();
+
+    if (ep < 0)
+        return(activities);
+
+    for (int n = 0; n < nr_compounds; n++) {
+        if (this->activity_store.is_available(ep, n)) {
+            this->activity_store.get_values(ep, n, &begin, &end);
+            activities.insert(activities.end(), begin, end);
         }
-
     }
 
     return(activities);
@@ -220,16 +946,14 @@ vector<ActivityType> ActMolVect<MolType, FeatureType, ActivityType>::get_activit
 template <class MolType, class FeatureType, class ActivityType>
 void ActMolVect<MolType, FeatureType, ActivityType>::print_sig_features(float limit, char* smarts) {
 
-    vector<ActivityType> activity_values;
     vector<string>::iterator cur_act;
     typename vector<sFeatRef>::iterator cur_feat;
     vector<sFeatRef> printed_features;
     vector<sFeatRef> * features = this->get_features();;
 
-    for (cur_act = activity_names.begin(); cur_act != activity_names.end(); cur_act++) {
+    this->feature_significance(activity_names);
 
-        activity_values = this->get_activity_values(*cur_act);
-        this->feature_significance(*cur_act, activity_values);
+    for (cur_act = activity_names.begin(); cur_act != activity_names.end(); cur_act++) {
 
         for (cur_feat=features->begin(); cur_feat!=features->end(); cur_feat++) {
 
@@ -247,16 +971,14 @@ void ActMolVect<MolType, FeatureType, ActivityType>::print_sig_features(float li
 template <class MolType, class FeatureType, class ActivityType>
 void  ActMolVect<MolType, FeatureType, ActivityType>::print_sorted_features(float limit, char* smarts) {
 
-    vector<ActivityType> activity_values;
     vector<string>::iterator cur_act;
     typename vector<sFeatRef>::iterator cur_feat;
     vector<sFeatRef> printed_features;
     vector<sFeatRef> * features = this->get_features();
 
-    for (cur_act = activity_names.begin(); cur_act != activity_names.end(); cur_act++) {
+    this->feature_significance(activity_names);
 
-        activity_values = this->get_activity_values(*cur_act);
-        this->feature_significance(*cur_act, activity_values);
+    for (cur_act = activity_names.begin(); cur_act != activity_names.end(); cur_act++) {
 
         for (cur_feat=features->begin(); cur_feat!=features->end(); cur_feat++) {
 
@@ -268,152 +990,153 @@ void  ActMolVect<MolType, FeatureType, ActivityType>::print_sorted_features(floa
 };
 
 template <class MolType, class FeatureType, class ActivityType>
-void ActMolVect<MolType, FeatureType, ActivityType>::precompute_feature_significance(string act, vector<bool> activity_values) {
+void ActMolVect<MolType, FeatureType, ActivityType>::precompute_feature_significance(const vector<string> & acts) {
 
-    int n_a =0;
-    int n_i =0;
-    vector<bool>::iterator cur_act_val;
+    SignificancePass<FeatureType, ActivityType> pass(&this->activity_store, this->get_size(), true);
+    vector<sFeatRef> * all_features = this->get_features();
+    vector<FeatRef> features;
     typename vector<sFeatRef>::iterator cur_feat;
-    vector<sFeatRef> * features = this->get_features();
+    vector<string>::const_iterator cur_act;
 
-    // determine global nr of actives/inactives // AM: column sums
-    for (cur_act_val=activity_values.begin();cur_act_val!=activity_values.end();cur_act_val++) {
+    features.reserve(all_features->size());
+    for (cur_feat=all_features->begin(); cur_feat!=all_features->end(); cur_feat++)
+        features.push_back(cur_feat->get());
 
-        if (*cur_act_val)
-            n_a++;
-        else
-            n_i++;
+    this->collect_stale_features();
+    for (cur_act = acts.begin(); cur_act != acts.end(); cur_act++) {
+        full_acts.erase(*cur_act);	// classification: slot 0 has the counts of a LOO state
+        pass.add_endpoint(*cur_act, this->get_activity_values(*cur_act), features);
+    }
+    this->run_significance(pass);
+
+    for (unsigned int i = 0; i < acts.size(); i++) {
+        shared_ptr<LooRanks> loo = pass.get_loo_ranks(i);
+        if (loo && excluded.empty()) {	// regression: the whole set statistics, exclude_significance() derives the LOO subsets
+            stale_acts.erase(acts[i]);
+            stale_features.erase(acts[i]);
+            loo_ranks[acts[i]] = loo;
+            full_acts.insert(acts[i]);
+        }
+        this->fill_weights(acts[i]);
+    }
+
+};
+
+template <class MolType, class FeatureType, class ActivityType>
+void ActMolVect<MolType, FeatureType, ActivityType>::feature_significance(const vector<string> & acts) {
 
+    SignificancePass<FeatureType, ActivityType> pass(&this->activity_store, this->get_size(), false);
+    vector<sFeatRef> * all_features = this->get_features();
+    vector<FeatRef> features;
+    typename vector<sFeatRef>::iterator cur_feat;
+    vector<string>::const_iterator cur_act;
+
+    features.reserve(all_features->size());
+    for (cur_feat=all_features->begin(); cur_feat!=all_features->end(); cur_feat++)
+        features.push_back(cur_feat->get());
+
+    this->collect_stale_features();
+    for (cur_act = acts.begin(); cur_act != acts.end(); cur_act++) {
+        stale_acts.erase(*cur_act);
+        stale_features.erase(*cur_act);
+        full_acts.erase(*cur_act);
+        pass.add_endpoint(*cur_act, this->get_activity_values(*cur_act), features);
     }
+    this->run_significance(pass);
 
-    // determine significance of training set features
-    for (cur_feat=features->begin(); cur_feat!=features->end(); cur_feat++) {
+    for (cur_act = acts.begin(); cur_act != acts.end(); cur_act++)
+        this->fill_weights(*cur_act);
 
-        if ((*cur_feat)->nr_matches() > 1) { // remove features that match on a single compound
-            activity_values = this->get_activity_values((*cur_feat)->get_matches(), act);
+};
 
-            int f_a=0;
-            int f_i=0;
-            // AM: cell sums
-            for (cur_act_val = activity_values.begin(); cur_act_val != activity_values.end(); cur_act_val++) {
+template <class MolType, class FeatureType, class ActivityType>
+void ActMolVect<MolType, FeatureType, ActivityType>::run_significance(SignificancePass<FeatureType, ActivityType> & pass) {
 
-                if (*cur_act_val)
-                    f_a++;
-                else if (!*cur_act_val)
-                    f_i++;
+    pass.init(nr_threads);
+    run_parallel(&pass, pass.get_nr_jobs(), nr_threads);
+    pass.commit();
 
-            }
+};
 
-            (*cur_feat)->precompute_significance(act, n_a, n_i, f_a, f_i);
-        }
-    }
+template <class MolType, class FeatureType, class ActivityType>
+void ActMolVect<MolType, FeatureType, ActivityType>::feature_significance(string act, vector<bool> activity_values) {
+
+    vector<sFeatRef> * all_features = this->get_features();
+    vector<FeatRef> features;
+    typename vector<sFeatRef>::iterator cur_feat;
+
+    features.reserve(all_features->size());
+    for (cur_feat=all_features->begin(); cur_feat!=all_features->end(); cur_feat++)
+        features.push_back(cur_feat->get());
+
+    this->collect_stale_features();
+    stale_acts.erase(act);
+    stale_features.erase(act);
+
+    this->feature_significance(act, activity_values, &features);
 
 };
 
 template <class MolType, class FeatureType, class ActivityType>
-void ActMolVect<MolType, FeatureType, ActivityType>::precompute_feature_significance(string act, vector<float> activity_values){
+void ActMolVect<MolType, FeatureType, ActivityType>::feature_significance(string act, vector<bool> activity_values, vector<FeatRef> * features) {
 
-    fprintf(stderr, "Not implemented for regression");
-    exit(1);
-}
+    SignificancePass<FeatureType, ActivityType> pass(&this->activity_store, this->get_size(), false);
 
+    full_acts.erase(act);
+    pass.add_endpoint(act, activity_values, *features);
+    this->run_significance(pass);
+    this->fill_weights(act);
+
+};
 
 template <class MolType, class FeatureType, class ActivityType>
-void ActMolVect<MolType, FeatureType, ActivityType>::feature_significance(string act, vector<bool> activity_values) {
+void ActMolVect<MolType, FeatureType, ActivityType>::feature_significance(string act, const vector<float> & all_activity_values) {
 
-    int n_a =0;
-    int n_i =0;
-    vector<bool>::iterator cur_act_val;
+    vector<sFeatRef> * all_features = this->get_features();
+    vector<FeatRef> features;
     typename vector<sFeatRef>::iterator cur_feat;
-    vector<sFeatRef> * features = this->get_features();
 
-    // determine global nr of actives/inactives // AM: column sums
-    for (cur_act_val=activity_values.begin();cur_act_val!=activity_values.end();cur_act_val++) {
+    features.reserve(all_features->size());
+    for (cur_feat=all_features->begin(); cur_feat!=all_features->end(); cur_feat++)
+        features.push_back(cur_feat->get());
 
-        if (*cur_act_val)
-            n_a++;
-        else
-            n_i++;
+    this->collect_stale_features();
+    stale_acts.erase(act);
+    stale_features.erase(act);
 
-    }
+    this->feature_significance(act, all_activity_values, &features);
 
-    // determine significance of training set features
-    for (cur_feat=features->begin(); cur_feat!=features->end(); cur_feat++) {
+};
 
-        if ((*cur_feat)->nr_matches() > 1) { // remove features that match on a single compound
-            activity_values = this->get_activity_values((*cur_feat)->get_matches(), act);
-            (*cur_feat)->determine_significance(act, n_a, n_i, &activity_values);	// AM: determine significance
-        }
-    }
+template <class MolType, class FeatureType, class ActivityType>
+void ActMolVect<MolType, FeatureType, ActivityType>::feature_significance(string act, const vector<float> & all_activity_values, vector<FeatRef> * features) {
+
+    SignificancePass<FeatureType, ActivityType> pass(&this->activity_store, this->get_size(), false);
+
+    full_acts.erase(act);
+    // run K-S test, sensitive version, but with ALL activity values
+    pass.add_endpoint(act, all_activity_values, *features);
+    this->run_significance(pass);
+    this->fill_weights(act);
 
 };
 
 template <class MolType, class FeatureType, class ActivityType>
-void ActMolVect<MolType, FeatureType, ActivityType>::feature_significance(string act, vector<float> all_activity_values) {
+void ActMolVect<MolType, FeatureType, ActivityType>::fill_weights(string act) {
 
-    //float global_median;
-    //vector<bool>::iterator cur_act_val;
-    vector<float> feat_activity_values;
-    typename vector<sFeatRef>::iterator cur_feat;
     vector<sFeatRef> * features = this->get_features();
+    clock_t t = clock();
 
-    // determine significance of training set features
-    for (cur_feat=features->begin(); cur_feat!=features->end(); cur_feat++) {
-        if ((*cur_feat)->nr_matches() > 1) { // remove features that match on a single compound
-            feat_activity_values = this->get_activity_values((*cur_feat)->get_matches(), act);
-
-            // DEBUG-AM
-            /*
-            cerr << "Feat: '" << (*cur_feat)->get_name() << "': ";
-            vector<float>::iterator fi;
-            for (fi=feat_activity_values.begin(); fi!=feat_activity_values.end(); fi++) { 
-                cerr << (*fi) << " ";
-            }
-            cerr << endl;
-            */
-
-            /*
-            sort(feat_activity_values.begin(), feat_activity_values.end());
-            sort(all_activity_values.begin(), all_activity_values.end());
-
-            // remove activity values that come from the current feature
-            typename vector<float>::iterator cur_feat_act;
-            typename vector<float>::iterator cur_all_act;
-            cur_feat_act = feat_activity_values.begin();
-            cur_all_act = all_activity_values.begin();
-
-
-            vector<float> missing_activity_values;						// place to store missing activities
-
-            while (cur_feat_act != feat_activity_values.end()) {
-            	if (cur_all_act == all_activity_values.end()) {
-            		break;
-            	}
-
-            	if ((*cur_feat_act) > (*cur_all_act)) {
-            		missing_activity_values.push_back(*cur_all_act);	// current value doesn't appear in feature activity: store it
-            		cur_all_act++;
-            	}
-
-            	else if ((*cur_feat_act) < (*cur_all_act)) {
-            		exit(1); //this shouldn't happen
-            	}
-            	else {
-            		cur_feat_act++;
-            		cur_all_act++;
-            	}
-            }
-            */
+    if (features->empty())
+        return;
 
-            // run K-S test, sensitive version, but with ALL activity values
-            if (feat_activity_values.size()) // AM: BUGFIX: Do not calc sig for feat w/o occurrences (possible due to remove_duplicates())
-                (*cur_feat)->determine_significance(act, all_activity_values, feat_activity_values);
-        }
+    // all features share the statistics table
+    features->front()->fill_weights(act);
+    weight_secs += (float)(clock()-t)/CLOCKS_PER_SEC;
 
-        else {
-            (*cur_feat)->set_too_infrequent(act); // mark infrequent features
-        }
-    }
+    // the gram matrices of kernel models need the similarities of training compounds
+    if (kernel)
+        this->precompute_similarities(act);
 
 };
 
@@ -0,0 +1,394 @@
+/* Copyright (C) 2005  Christoph Helma <helma@in-silico.de>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+
+*/
+
+#ifndef ACTIVITY_RANKS_H
+#define ACTIVITY_RANKS_H
+
+#include <vector>
+#include <algorithm>
+#include <stdint.h>
+
+#include "boost/shared_ptr.hpp"
+
+#include "stats.h"
+
+using namespace std;
+using namespace boost;
+
+//! activities of an endpoint, ranked once for the KS tests of all features of a training set
+//
+// The values of all compounds are sorted once. The values of a feature are a subset of
+// them, i.e. they can be sorted by walking the tie groups (first position of a value in the
+// sorted array) of the compounds in its posting list through a bitmap. The KS distances
+// only change at the steps of the feature distribution, so they are evaluated there. The
+// results are identical to a merge of the two sorted value lists. NaN values are ignored.
+// The ranks are not changed by ks(), threads share them and pass their own Scratch.
+class ActivityRanks {
+
+public:
+
+    //! temporary arrays of ks(), one per thread
+    struct Scratch {
+        vector<uint64_t> used;	// tie groups of the feature
+        vector<int> counts;	// values of the feature per tie group
+        vector<float> values;	// sorted values of the feature
+    };
+
+private:
+
+    vector<float> sorted;	// all values, ascending
+    float median;
+    vector<int> offsets;	// compound n has groups[offsets[n]] .. groups[offsets[n+1]-1]
+    vector<int> groups;	// tie groups of the values of the compounds
+
+public:
+
+    //! rank values (the activities of all available compounds)
+    ActivityRanks(const vector<float> & all_values): median(0), offsets(1, 0) {
+        sorted.reserve(all_values.size());
+        for (vector<float>::const_iterator v = all_values.begin(); v != all_values.end(); v++)
+            if (!isnan(*v)) sorted.push_back(*v);
+        sort(sorted.begin(), sorted.end());
+        if (sorted.size())
+            median = computeMedian(sorted.begin(), sorted.end(), accumulate(sorted.begin(), sorted.end(), 0.0f));
+    };
+
+    //! add the next compound (0, 1, ...) with the values begin .. end-1 (begin == end for unavailable compounds)
+    void add_compound(const float * begin, const float * end) {
+        for (; begin != end; begin++) {
+            if (!isnan(*begin))
+                groups.push_back(lower_bound(sorted.begin(), sorted.end(), *begin) - sorted.begin());
+        }
+        offsets.push_back(groups.size());
+    };
+
+    //! number of ranked values
+    int size() const {
+        return(sorted.size());
+    };
+
+    //! median of all values (computeStats() of the sorted values)
+    float get_median() const {
+        return(median);
+    };
+
+    //! value of tie group g
+    float get_value(int g) const {
+        return(sorted[g]);
+    };
+
+    //! tie groups of the values of compound n
+    void get_groups(int n, const int ** begin, const int ** end) const {
+        if (n + 1 >= (int) offsets.size()) {
+            *begin = *end = NULL;
+            return;
+        }
+        *begin = &groups[0] + offsets[n];
+        *end = &groups[0] + offsets[n + 1];
+    };
+
+    //! tie groups of the values of compounds comps, ascending (one per value)
+    void get_groups(const vector<int> & comps, Scratch * scratch, vector<int> * feat_groups) const {
+
+        vector<uint64_t> & used = scratch->used;	// all 0 between calls
+        vector<int> & counts = scratch->counts;
+        int first;
+        int last = -1;
+
+        if (counts.size() < sorted.size()) {
+            used.resize((sorted.size() + 63) / 64, 0);
+            counts.resize(sorted.size(), 0);
+        }
+        first = used.size();
+        feat_groups->clear();
+
+        for (vector<int>::const_iterator c = comps.begin(); c != comps.end(); c++) {
+            if (*c + 1 >= (int) offsets.size())
+                continue;
+            for (int j = offsets[*c]; j < offsets[*c + 1]; j++) {
+                int g = groups[j];
+                used[g >> 6] |= (uint64_t) 1 << (g & 63);
+                counts[g]++;
+                first = min(first, g >> 6);
+                last = max(last, g >> 6);
+            }
+        }
+
+        for (int w = first; w <= last; w++) {
+            uint64_t bits = used[w];
+            used[w] = 0;
+            while (bits) {
+                int g = (w << 6) + __builtin_ctzll(bits);
+                bits &= bits - 1;
+                feat_groups->insert(feat_groups->end(), counts[g], g);
+                counts[g] = 0;
+            }
+        }
+
+    };
+
+    //! KS distance d (sum of the largest deviations in both directions) between the values of compounds comps
+    //! and all values, *nr: number of their values, *feat_median: their median. Returns false if they have no values.
+    bool ks(const vector<int> & comps, Scratch * scratch, float * d, int * nr, float * feat_median) const {
+
+        float en1 = sorted.size();
+        float en2;
+        float fn1, fn2, dt1, dt2, d_1 = 0, d_2 = 0;
+        unsigned int pos;
+        unsigned int k = 0;
+        vector<uint64_t> & used = scratch->used;	// all 0 between calls
+        vector<int> & counts = scratch->counts;
+        vector<float> & values = scratch->values;
+        int first;
+        int last = -1;
+
+        if (counts.size() < sorted.size()) {
+            used.resize((sorted.size() + 63) / 64, 0);
+            counts.resize(sorted.size(), 0);
+        }
+        first = used.size();
+
+        for (vector<int>::const_iterator c = comps.begin(); c != comps.end(); c++) {
+            if (*c + 1 >= (int) offsets.size())
+                continue;
+            for (int j = offsets[*c]; j < offsets[*c + 1]; j++) {
+                int g = groups[j];
+                used[g >> 6] |= (uint64_t) 1 << (g & 63);
+                counts[g]++;
+                first = min(first, g >> 6);
+                last = max(last, g >> 6);
+                k++;
+            }
+        }
+        *nr = k;
+        if (k == 0)
+            return(false);
+
+        // the sorted feature values take the first positions of their tie groups in the
+        // merge with all values, the distances are largest just before and after their steps
+        en2 = k;
+        k = 0;
+        values.clear();
+        for (int w = first; w <= last; w++) {
+            uint64_t bits = used[w];
+            used[w] = 0;
+            while (bits) {
+                int g = (w << 6) + __builtin_ctzll(bits);
+                bits &= bits - 1;
+                for (pos = g; pos < (unsigned int) (g + counts[g]); pos++) {
+                    fn1 = pos/en1;
+                    fn2 = k/en2;
+                    dt2 = fn1-fn2;
+                    if (dt2 > d_2) d_2 = dt2;
+                    k++;
+                    fn1 = (pos+1)/en1;
+                    fn2 = k/en2;
+                    dt1 = fn2-fn1;
+                    if (dt1 > d_1) d_1 = dt1;
+                    values.push_back(sorted[g]);
+                }
+                counts[g] = 0;
+            }
+        }
+
+        *d = d_1 + d_2;
+        *feat_median = computeMedian(values.begin(), values.end(), accumulate(values.begin(), values.end(), 0.0f));
+        return(true);
+
+    };
+
+};
+
+//! KS tests of the features of a training set with one value left out, precomputed for LOO predictions
+//
+// Leaving out a value of tie group g shifts the positions of all larger groups by one. The
+// values of a feature without that value do not change, its distances below the split are
+// the ones without shift and above the split the ones with shift, i.e. the maxima of the
+// steps before and after the split (precomputed for both cases) give the new KS distance
+// with a binary search. The steps of the features with the left out value are recomputed.
+// The results are identical to ActivityRanks::ks() of the remaining values.
+class LooRanks {
+
+private:
+
+    //! steps of a feature
+    struct Steps {
+        vector<int> groups;	// tie groups of the values, ascending
+        vector<float> below_1;	// maxima of the distances in both directions up to a step (no shift)
+        vector<float> below_2;
+        vector<float> above_1;	// maxima of the distances in both directions from a step on (shifted)
+        vector<float> above_2;
+        float median;
+    };
+
+    boost::shared_ptr<ActivityRanks> ranks;
+    vector<Steps> steps;	// by feature id
+
+public:
+
+    //! ranks: all values of the training set, nr_features: features ids are 0 .. nr_features-1
+    LooRanks(boost::shared_ptr<ActivityRanks> ranks, int nr_features): ranks(ranks), steps(nr_features) {};
+
+    //! number of feature ids
+    int size() const {
+        return(steps.size());
+    };
+
+    //! number of values without the left out one
+    int get_nr_values() const {
+        return(ranks->size() - 1);
+    };
+
+    //! precompute the steps of feature id with the values of compounds comps (median: their median),
+    //! different ids can be added concurrently
+    void add_feature(int id, const vector<int> & comps, ActivityRanks::Scratch * scratch, float median) {
+
+        Steps & f = steps[id];
+        float en1 = ranks->size() - 1;
+        float en2;
+        float fn1, fn2, dt1, dt2, d_1 = 0, d_2 = 0;
+        int n;
+        int pos = 0;
+
+        ranks->get_groups(comps, scratch, &f.groups);
+        n = f.groups.size();
+        en2 = n;
+        f.median = median;
+        f.below_1.resize(n);
+        f.below_2.resize(n);
+        f.above_1.resize(n);
+        f.above_2.resize(n);
+
+        for (int k = 0; k < n; k++) {
+            pos = (k > 0 && f.groups[k] == f.groups[k-1]) ? pos + 1 : f.groups[k];
+            fn1 = pos/en1;
+            fn2 = k/en2;
+            dt2 = fn1-fn2;
+            if (dt2 > d_2) d_2 = dt2;
+            fn1 = (pos+1)/en1;
+            fn2 = (k+1)/en2;
+            dt1 = fn2-fn1;
+            if (dt1 > d_1) d_1 = dt1;
+            f.below_1[k] = d_1;
+            f.below_2[k] = d_2;
+            fn1 = (pos-1)/en1;	// shifted
+            fn2 = k/en2;
+            f.above_2[k] = fn1-fn2;
+            fn1 = pos/en1;
+            fn2 = (k+1)/en2;
+            f.above_1[k] = fn2-fn1;
+        }
+
+        d_1 = 0;
+        d_2 = 0;
+        for (int k = n - 1; k >= 0; k--) {
+            if (f.above_1[k] > d_1) d_1 = f.above_1[k];
+            if (f.above_2[k] > d_2) d_2 = f.above_2[k];
+            f.above_1[k] = d_1;
+            f.above_2[k] = d_2;
+        }
+
+    };
+
+    //! tie group *g of the value of compound n and *all_median: the median of the other values,
+    //! returns false if n has no value
+    bool left_out(int n, int * g, float * all_median) const {
+
+        const int * begin;
+        const int * end;
+        vector<float> values;
+
+        ranks->get_groups(n, &begin, &end);
+        if (begin == end)
+            return(false);
+        *g = *begin;
+        *all_median = 0;
+        for (int k = 0; k < ranks->size(); k++)
+            if (k != *g) values.push_back(ranks->get_value(k));
+        if (values.size())
+            *all_median = computeMedian(values.begin(), values.end(), accumulate(values.begin(), values.end(), 0.0f));
+        return(true);
+
+    };
+
+    //! KS distance d of feature id without a value of tie group g (see ActivityRanks::ks()), feat_occurs: the
+    //! value belongs to the feature, values: scratch space. Returns false if the feature has no values.
+    bool ks(int id, int g, bool feat_occurs, vector<float> * values, float * d, int * nr, float * feat_median) const {
+
+        const Steps & f = steps[id];
+        int n = f.groups.size();
+        float en1 = ranks->size() - 1;
+        float en2;
+        float fn1, fn2, dt1, dt2, d_1 = 0, d_2 = 0;
+        bool left_out = false;
+        int pos = 0;
+        int prev = -1;
+        int k = 0;
+
+        if (!feat_occurs) {
+            int split = upper_bound(f.groups.begin(), f.groups.end(), g) - f.groups.begin();
+            *nr = n;
+            if (n == 0)
+                return(false);
+            if (split > 0) {
+                d_1 = f.below_1[split - 1];
+                d_2 = f.below_2[split - 1];
+            }
+            if (split < n) {
+                d_1 = max(d_1, f.above_1[split]);
+                d_2 = max(d_2, f.above_2[split]);
+            }
+            *d = d_1 + d_2;
+            *feat_median = f.median;
+            return(true);
+        }
+
+        *nr = n - 1;
+        if (n <= 1)
+            return(false);
+        en2 = n - 1;
+        values->clear();
+        for (int j = 0; j < n; j++) {
+            int cur = f.groups[j];
+            if (cur == g && !left_out) {
+                left_out = true;
+                continue;
+            }
+            pos = (cur == prev) ? pos + 1 : (cur > g ? cur - 1 : cur);
+            prev = cur;
+            fn1 = pos/en1;
+            fn2 = k/en2;
+            dt2 = fn1-fn2;
+            if (dt2 > d_2) d_2 = dt2;
+            k++;
+            fn1 = (pos+1)/en1;
+            fn2 = k/en2;
+            dt1 = fn2-fn1;
+            if (dt1 > d_1) d_1 = dt1;
+            values->push_back(ranks->get_value(cur));
+        }
+
+        *d = d_1 + d_2;
+        *feat_median = computeMedian(values->begin(), values->end(), accumulate(values->begin(), values->end(), 0.0f));
+        return(true);
+
+    };
+
+};
+
+#endif
@@ -0,0 +1,255 @@
+/* Copyright (C) 2005  Christoph Helma <helma@in-silico.de>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+
+*/
+
+#ifndef ACTIVITY_STORE_H
+#define ACTIVITY_STORE_H
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <stdint.h>
+
+#include "boost/unordered_map.hpp"
+
+using namespace std;
+using namespace boost;
+
+//! storage type of activity values (vector<bool> is packed and has no contiguous values)
+template <class ActivityType>
+struct ActivityValue {
+    typedef ActivityType type;
+};
+
+template <>
+struct ActivityValue<bool> {
+    typedef unsigned char type;
+};
+
+//! columnar activity values of a training set
+//
+// Endpoint names are interned to ids 0..get_nr_endpoints()-1. Each endpoint has
+// one dense value array, compound n owns values[offsets[n]] .. values[offsets[n+1]-1]
+// (CSR layout, compounds may have repeated measurements), and two bitmaps with the
+// availability of each compound (available, and the backup of remove()).
+// New values are collected in a pending list and merged into the CSR arrays by
+// finalize(), which the readers call implicitly.
+template <class ActivityType>
+class ActivityStore {
+
+public:
+
+    typedef typename ActivityValue<ActivityType>::type Value;
+
+private:
+
+    struct Column {
+        vector<int> offsets;	// nr_compounds + 1
+        vector<Value> values;
+        vector<uint64_t> available;
+        vector<uint64_t> available_bak;
+        vector<pair<int, Value> > pending;	// (compound, value) in insertion order
+    };
+
+    vector<string> names;
+    unordered_map<string, int> ids;
+    vector<Column> columns;
+    int nr_compounds;
+    bool dirty;	// pending values
+
+    static bool get_bit(const vector<uint64_t> & bits, int n) {
+        return((bits[n >> 6] >> (n & 63)) & 1);
+    };
+    static void set_bit(vector<uint64_t> & bits, int n, bool value) {
+        if (value) bits[n >> 6] |= ((uint64_t) 1 << (n & 63));
+        else bits[n >> 6] &= ~((uint64_t) 1 << (n & 63));
+    };
+
+    void resize_column(Column & col) {
+        col.offsets.resize(nr_compounds + 1, col.offsets.empty() ? 0 : col.offsets.back());
+        col.available.resize((nr_compounds + 63) / 64, 0);
+        col.available_bak.resize((nr_compounds + 63) / 64, 0);
+    };
+
+    void finalize(Column & col);
+
+public:
+
+    ActivityStore(): nr_compounds(0), dirty(false) {};
+
+    //! make room for compounds 0 .. n-1
+    void set_nr_compounds(int n) {
+        nr_compounds = n;
+        for (unsigned int ep = 0; ep < columns.size(); ep++)
+            this->resize_column(columns[ep]);
+    };
+
+    int get_nr_compounds() {
+        return(nr_compounds);
+    };
+
+    int get_nr_endpoints() {
+        return(names.size());
+    };
+
+    //! id of endpoint name, -1 if it is unknown
+    int get_id(const string & name) {
+        unordered_map<string, int>::iterator found = ids.find(name);
+        return(found == ids.end() ? -1 : found->second);
+    };
+
+    //! id of endpoint name, added if necessary
+    int intern(const string & name);
+
+    const string & get_name(int ep) {
+        return(names[ep]);
+    };
+
+    //! add a value for compound comp (availability is not changed)
+    void add_value(int ep, int comp, ActivityType value) {
+        columns[ep].pending.push_back(make_pair(comp, (Value) value));
+        dirty = true;
+    };
+
+    void set_available(int ep, int comp, bool value) {
+        set_bit(columns[ep].available, comp, value);
+    };
+
+    void set_available_bak(int ep, int comp, bool value) {
+        set_bit(columns[ep].available_bak, comp, value);
+    };
+
+    //! remove all values of compound comp
+    void clear_values(int comp);
+
+    bool is_available(int ep, int comp) {
+        return(ep >= 0 && get_bit(columns[ep].available, comp));
+    };
+
+    bool was_available(int ep, int comp) {
+        return(ep >= 0 && get_bit(columns[ep].available_bak, comp));
+    };
+
+    //! number of compounds that are available for endpoint ep
+    int count_available(int ep) {
+        int nr = 0;
+        if (ep < 0) return(0);
+        for (unsigned int i = 0; i < columns[ep].available.size(); i++)
+            nr += __builtin_popcountll(columns[ep].available[i]);
+        return(nr);
+    };
+
+    //! availability bitmap of endpoint ep
+    const uint64_t * get_available(int ep) {
+        return(&columns[ep].available[0]);
+    };
+
+    //! values of compound comp for endpoint ep in [*begin, *end)
+    void get_values(int ep, int comp, const Value ** begin, const Value ** end) {
+        if (dirty) this->finalize();
+        const Column & col = columns[ep];
+        *begin = col.values.empty() ? NULL : &col.values[0] + col.offsets[comp];
+        *end = col.values.empty() ? NULL : &col.values[0] + col.offsets[comp+1];
+    };
+
+    //! make compound comp unavailable for all endpoints (backup the current availability)
+    void remove(int comp) {
+        for (unsigned int ep = 0; ep < columns.size(); ep++) {
+            set_bit(columns[ep].available_bak, comp, get_bit(columns[ep].available, comp));
+            set_bit(columns[ep].available, comp, false);
+        }
+    };
+
+    //! restore the availability of compound comp before remove()
+    void restore(int comp) {
+        for (unsigned int ep = 0; ep < columns.size(); ep++)
+            set_bit(columns[ep].available, comp, get_bit(columns[ep].available_bak, comp));
+    };
+
+    //! merge pending values into the value arrays (has to be called before concurrent reads)
+    void finalize() {
+        for (unsigned int ep = 0; ep < columns.size(); ep++)
+            this->finalize(columns[ep]);
+        dirty = false;
+    };
+
+};
+
+template <class ActivityType>
+int ActivityStore<ActivityType>::intern(const string & name) {
+
+    int ep = this->get_id(name);
+
+    if (ep < 0) {
+        ep = names.size();
+        names.push_back(name);
+        ids[name] = ep;
+        columns.push_back(Column());
+        this->resize_column(columns.back());
+    }
+    return(ep);
+};
+
+template <class ActivityType>
+void ActivityStore<ActivityType>::finalize(Column & col) {
+
+    if (col.pending.empty())
+        return;
+
+    vector<int> counts(nr_compounds, 0);
+    vector<int> offsets(nr_compounds + 1, 0);
+    vector<Value> values;
+    typename vector<pair<int, Value> >::iterator cur_p;
+
+    for (int n = 0; n < nr_compounds; n++)
+        counts[n] = col.offsets[n+1] - col.offsets[n];
+    for (cur_p = col.pending.begin(); cur_p != col.pending.end(); cur_p++)
+        counts[cur_p->first]++;
+    for (int n = 0; n < nr_compounds; n++)
+        offsets[n+1] = offsets[n] + counts[n];
+
+    // old values first, then the pending ones in insertion order
+    values.resize(offsets[nr_compounds]);
+    for (int n = 0; n < nr_compounds; n++) {
+        copy(col.values.begin() + col.offsets[n], col.values.begin() + col.offsets[n+1], values.begin() + offsets[n]);
+        counts[n] = offsets[n] + (col.offsets[n+1] - col.offsets[n]);	// next free slot
+    }
+    for (cur_p = col.pending.begin(); cur_p != col.pending.end(); cur_p++)
+        values[counts[cur_p->first]++] = cur_p->second;
+
+    col.offsets.swap(offsets);
+    col.values.swap(values);
+    vector<pair<int, Value> >().swap(col.pending);
+};
+
+template <class ActivityType>
+void ActivityStore<ActivityType>::clear_values(int comp) {
+
+    this->finalize();
+
+    for (unsigned int ep = 0; ep < columns.size(); ep++) {
+        Column & col = columns[ep];
+        int nr = col.offsets[comp+1] - col.offsets[comp];
+        if (nr > 0) {
+            col.values.erase(col.values.begin() + col.offsets[comp], col.values.begin() + col.offsets[comp+1]);
+            for (int n = comp + 1; n <= nr_compounds; n++)
+                col.offsets[n] -= nr;
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,105 @@
+/* Copyright (C) 2005  Christoph Helma <helma@in-silico.de>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+
+*/
+
+#include <iostream>
+#include <vector>
+#include <stdlib.h>
+#include <math.h>
+#include <sys/time.h>
+#include <gsl/gsl_cdf.h>
+
+#include "chisq.h"
+
+using namespace std;
+
+static double now() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return(tv.tv_sec + tv.tv_usec / 1e6);
+}
+
+//! features per second of kernel for repeated tests of all features
+static double bench(void (*kernel)(const float *, const float *, int, float, float, float *, float *),
+                    vector<float> & f_a, vector<float> & f_i, float n_a, float n_i, vector<float> & chisq, vector<float> & p) {
+
+    int nr = f_a.size();
+    int rounds = 0;
+    double start = now();
+    double secs;
+
+    do {
+        kernel(&f_a[0], &f_i[0], nr, n_a, n_i, &chisq[0], &p[0]);
+        rounds++;
+        secs = now() - start;
+    } while (secs < 1.0);
+    return(rounds * (double) nr / secs);
+}
+
+//! micro-benchmark of the batch chi-square tests on random counts, p values are compared with GSL
+int main(int argc, char *argv[]) {
+
+    int nr_features = argc > 1 ? atoi(argv[1]) : 1000000;
+    int n_a = argc > 2 ? atoi(argv[2]) : 400;
+    int n_i = argc > 3 ? atoi(argv[3]) : 600;
+
+    if (nr_features < 1 || n_a < 1 || n_i < 1) {
+        cerr << "usage: " << argv[0] << " [features [actives [inactives]]]\n";
+        return(1);
+    }
+
+    vector<float> f_a(nr_features);
+    vector<float> f_i(nr_features);
+    vector<float> chisq(nr_features);
+    vector<float> p(nr_features);
+    vector<float> ref_chisq(nr_features);
+    vector<float> ref_p(nr_features);
+    double max_chisq_diff = 0;
+    int max_ulps = 0;
+    double start;
+
+    srand(1);
+    for (int k = 0; k < nr_features; k++) {
+        f_a[k] = rand() % (n_a + 1);
+        f_i[k] = rand() % (n_i + 1);
+        if (rand() % 2) {	// most features are rare
+            f_a[k] = (int) f_a[k] % 8;
+            f_i[k] = (int) f_i[k] % 8;
+        }
+    }
+
+    chisq_significance_scalar(&f_a[0], &f_i[0], nr_features, n_a, n_i, &ref_chisq[0], &ref_p[0]);
+    chisq_significance(&f_a[0], &f_i[0], nr_features, n_a, n_i, &chisq[0], &p[0]);
+    start = now();
+    for (int k = 0; k < nr_features; k++)
+        ref_p[k] = gsl_cdf_chisq_P(ref_chisq[k], 1);
+    cout << "gsl_cdf_chisq_P: " << nr_features / (now() - start) << " features/sec\n";
+    for (int k = 0; k < nr_features; k++) {
+        max_chisq_diff = max(max_chisq_diff, (double) fabs(chisq[k] - ref_chisq[k]));
+        int ulps = 0;
+        for (float v = min(p[k], ref_p[k]); v < max(p[k], ref_p[k]); v = nextafterf(v, 2))
+            ulps++;
+        max_ulps = max(max_ulps, ulps);
+    }
+
+    cout << "features: " << nr_features << ", actives: " << n_a << ", inactives: " << n_i << "\n";
+    cout << "scalar: " << bench(chisq_significance_scalar, f_a, f_i, n_a, n_i, chisq, p) << " features/sec\n";
+    cout << chisq_isa() << ": " << bench(chisq_significance, f_a, f_i, n_a, n_i, chisq, p) << " features/sec\n";
+    cout << "max chisq difference: " << max_chisq_diff << ", max p difference to GSL: " << max_ulps << " ulps\n";
+
+    return(0);
+}
@@ -0,0 +1,134 @@
+/* Copyright (C) 2005  Christoph Helma <helma@in-silico.de>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+
+*/
+
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <stdlib.h>
+#include <math.h>
+#include <gsl/gsl_cdf.h>
+
+#include "chisq.h"
+
+using namespace std;
+
+//! chi-square statistic of ClassFeat::determine_significance() before chisq_significance()
+static float old_chisq(float n_a, float n_i, float f_a, float f_i) {
+
+    float ea;
+    float ei;
+    float chisq;
+
+    if ((f_a+f_i)>1) {
+        ea = n_a*(f_a+f_i)/(n_a+n_i);
+        ei = n_i*(f_a+f_i)/(n_a+n_i);
+        chisq = (f_a-ea-0.5)*(f_a-ea-0.5)/ea + (f_i-ei-0.5)*(f_i-ei-0.5)/ei;
+    }
+    else
+        chisq = 0;
+    return(chisq);
+}
+
+//! distance of two floats in ulps
+static int ulps(float a, float b) {
+    int nr = 0;
+    for (float v = min(a, b); v < max(a, b) && nr < 1000; v = nextafterf(v, max(a, b)))
+        nr++;
+    return(nr);
+}
+
+//! chisq_significance() compared with the statistics of the old per feature test (bit-identical)
+//! and with gsl_cdf_chisq_P() (1 ulp), for all counts of small training sets and random counts of large ones
+int main(int argc, char *argv[]) {
+
+    int max_n = argc > 1 ? atoi(argv[1]) : 60;
+    int nr_random = argc > 2 ? atoi(argv[2]) : 200;
+    long nr_tests = 0;
+    long nr_diff = 0;
+    long nr_p_diff = 0;
+    int max_ulps = 0;
+
+    if (max_n < 1 || nr_random < 0) {
+        cerr << "usage: " << argv[0] << " [max_compounds [random_sets]]\n";
+        return(1);
+    }
+
+    srand(1);
+    for (int set = 0; set < max_n * max_n + nr_random; set++) {
+
+        float n_a;
+        float n_i;
+        vector<float> f_a;
+        vector<float> f_i;
+
+        if (set < max_n * max_n) {	// all counts
+            n_a = set / max_n + 1;
+            n_i = set % max_n + 1;
+            for (int a = 0; a <= n_a; a++)
+                for (int i = 0; i <= n_i; i++) {
+                    f_a.push_back(a);
+                    f_i.push_back(i);
+                }
+        }
+        else {
+            n_a = 1 + rand() % 100000;
+            n_i = 1 + rand() % 100000;
+            for (int k = 0; k < 10000; k++) {
+                f_a.push_back(rand() % ((int) n_a + 1));
+                f_i.push_back(rand() % ((int) n_i + 1));
+                if (rand() % 2) {	// most features are rare
+                    f_a.back() = (int) f_a.back() % 8;
+                    f_i.back() = (int) f_i.back() % 8;
+                }
+            }
+        }
+
+        int nr = f_a.size();
+        vector<float> chisq(nr);
+        vector<float> p(nr);
+        vector<float> scalar_chisq(nr);
+        vector<float> scalar_p(nr);
+
+        chisq_significance(&f_a[0], &f_i[0], nr, n_a, n_i, &chisq[0], &p[0]);
+        chisq_significance_scalar(&f_a[0], &f_i[0], nr, n_a, n_i, &scalar_chisq[0], &scalar_p[0]);
+
+        for (int k = 0; k < nr; k++) {
+            float ref = old_chisq(n_a, n_i, f_a[k], f_i[k]);
+            float ref_p = gsl_cdf_chisq_P(ref, 1);
+            int u = ulps(p[k], ref_p);
+            nr_tests++;
+            if (chisq[k] != ref || scalar_chisq[k] != ref || p[k] != scalar_p[k] || p[k] != chisq_p(ref)) {
+                nr_diff++;
+                if (nr_diff <= 5)
+                    cerr << "n_a " << n_a << " n_i " << n_i << " f_a " << f_a[k] << " f_i " << f_i[k] << ": chisq " << chisq[k] << " scalar " << scalar_chisq[k] << " old " << ref << "\n";
+            }
+            if (u > 1) {
+                nr_p_diff++;
+                if (nr_p_diff <= 5)
+                    cerr << "chisq " << ref << ": p " << p[k] << " gsl " << ref_p << "\n";
+            }
+            max_ulps = max(max_ulps, u);
+        }
+    }
+
+    cout << "features: " << nr_tests << " (" << chisq_isa() << ")\n";
+    cout << "statistics different from the old test: " << nr_diff << "\n";
+    cout << "p values more than 1 ulp from GSL: " << nr_p_diff << " (max " << max_ulps << " ulps)\n";
+
+    return(nr_diff > 0 || nr_p_diff > 0);
+}
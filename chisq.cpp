@@ -0,0 +1,154 @@
+/* Copyright (C) 2005  Christoph Helma <helma@in-silico.de>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+
+*/
+
+#include <math.h>
+
+#include "chisq.h"
+
+// the AVX2 kernel of the statistics is compiled with a target attribute and selected at
+// runtime, it evaluates the scalar expression with the same float and double operations
+// in the same order (avx2 does not imply FMA), i.e. the results are identical
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CHISQ_X86
+#include <immintrin.h>
+#endif
+
+typedef void (*ChisqKernel)(const float *, const float *, int, float, float, float *);
+
+static void chisq_kernel_scalar(const float * f_a, const float * f_i, int nr, float n_a, float n_i, float * chisq) {
+
+    for (int k = 0; k < nr; k++) {
+        float f = f_a[k] + f_i[k];
+        // fragments with total frequency of 1 are not informative, but confounding
+        if (f > 1) {
+            float ea = n_a*f/(n_a+n_i);	// expected actives
+            float ei = n_i*f/(n_a+n_i);	// expected inactives
+            // Yates' correction, i.e. reduce observed frequencies by 0.5
+            chisq[k] = (f_a[k]-ea-0.5)*(f_a[k]-ea-0.5)/ea + (f_i[k]-ei-0.5)*(f_i[k]-ei-0.5)/ei;
+        }
+        else
+            chisq[k] = 0;
+    }
+
+}
+
+#ifdef CHISQ_X86
+
+//! (o-e-0.5)^2/e in double precision
+__attribute__((target("avx2")))
+static __m256d yates_avx2(__m128 o, __m128 e) {
+    __m256d d = _mm256_sub_pd(_mm256_cvtps_pd(_mm_sub_ps(o, e)), _mm256_set1_pd(0.5));
+    return(_mm256_div_pd(_mm256_mul_pd(d, d), _mm256_cvtps_pd(e)));
+}
+
+__attribute__((target("avx2")))
+static void chisq_kernel_avx2(const float * f_a, const float * f_i, int nr, float n_a, float n_i, float * chisq) {
+
+    const __m256 na = _mm256_set1_ps(n_a);
+    const __m256 ni = _mm256_set1_ps(n_i);
+    const __m256 n = _mm256_set1_ps(n_a + n_i);
+    const __m256 one = _mm256_set1_ps(1);
+    int k = 0;
+
+    for (; k + 8 <= nr; k += 8) {
+        __m256 fa = _mm256_loadu_ps(f_a + k);
+        __m256 fi = _mm256_loadu_ps(f_i + k);
+        __m256 f = _mm256_add_ps(fa, fi);
+        __m256 ea = _mm256_div_ps(_mm256_mul_ps(na, f), n);
+        __m256 ei = _mm256_div_ps(_mm256_mul_ps(ni, f), n);
+        __m128 lo = _mm256_cvtpd_ps(_mm256_add_pd(yates_avx2(_mm256_castps256_ps128(fa), _mm256_castps256_ps128(ea)),
+                                                  yates_avx2(_mm256_castps256_ps128(fi), _mm256_castps256_ps128(ei))));
+        __m128 hi = _mm256_cvtpd_ps(_mm256_add_pd(yates_avx2(_mm256_extractf128_ps(fa, 1), _mm256_extractf128_ps(ea, 1)),
+                                                  yates_avx2(_mm256_extractf128_ps(fi, 1), _mm256_extractf128_ps(ei, 1))));
+        __m256 c = _mm256_insertf128_ps(_mm256_castps128_ps256(lo), hi, 1);
+        _mm256_storeu_ps(chisq + k, _mm256_and_ps(c, _mm256_cmp_ps(f, one, _CMP_GT_OQ)));
+    }
+    chisq_kernel_scalar(f_a + k, f_i + k, nr - k, n_a, n_i, chisq + k);
+
+}
+
+#endif
+
+static ChisqKernel select_kernel(const char ** isa) {
+
+#ifdef CHISQ_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        *isa = "avx2";
+        return(chisq_kernel_avx2);
+    }
+#endif
+    *isa = "scalar";
+    return(chisq_kernel_scalar);
+
+}
+
+static const char * kernel_isa = "scalar";
+static ChisqKernel chisq_kernel = select_kernel(&kernel_isa);
+
+float chisq_p(float chisq) {
+
+    if (chisq <= 0)
+        return(0);
+    // P(chisq, df=1) = P(1/2, chisq/2) = erf(sqrt(chisq/2)), erfc is accurate for the large
+    // values of significant features
+    return(1.0 - erfc(sqrt(0.5 * (double) chisq)));
+
+}
+
+void chisq_significance(const float * f_a, const float * f_i, int nr, float n_a, float n_i, float * chisq, float * p) {
+
+    chisq_kernel(f_a, f_i, nr, n_a, n_i, chisq);
+    for (int k = 0; k < nr; k++)
+        p[k] = chisq_p(chisq[k]);
+
+}
+
+void chisq_significance_scalar(const float * f_a, const float * f_i, int nr, float n_a, float n_i, float * chisq, float * p) {
+
+    chisq_kernel_scalar(f_a, f_i, nr, n_a, n_i, chisq);
+    for (int k = 0; k < nr; k++)
+        p[k] = chisq_p(chisq[k]);
+
+}
+
+int chisq_min_frequency(float n_a, float n_i) {
+
+    float cur_chisq = 0;
+    float cur_ea;
+    float cur_ei;
+    int i;
+
+    if (n_a > n_i) {	// exchange na and ni
+        float tmp  = n_a;
+        n_a = n_i;
+        n_i = tmp;
+    }
+    // find minimum frequency for statistical significance
+    for (i=1; cur_chisq < 3.84; i++) {
+        cur_ea = n_a*i/(n_a+n_i);
+        cur_ei = n_i*i/(n_a+n_i);
+        cur_chisq = (i-cur_ea-0.5)*(i-cur_ea-0.5)/cur_ea + (cur_ei+0.5)*(cur_ei+0.5)/cur_ei ;
+    }
+    return(i);
+
+}
+
+const char * chisq_isa() {
+    return(kernel_isa);
+}
@@ -0,0 +1,48 @@
+/* Copyright (C) 2005  Christoph Helma <helma@in-silico.de>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+
+*/
+
+#ifndef CHISQ_H
+#define CHISQ_H
+
+//! chi-square tests of a batch of features (structure of arrays)
+//
+// Feature k occurs in f_a[k] active and f_i[k] inactive compounds of a training set
+// with n_a actives and n_i inactives. The statistics use Yates' correction:
+//   e_a = n_a*(f_a+f_i)/(n_a+n_i), e_i = n_i*(f_a+f_i)/(n_a+n_i)
+//   chisq[k] = (f_a-e_a-0.5)^2/e_a + (f_i-e_i-0.5)^2/e_i if f_a+f_i > 1, 0 otherwise
+//   p[k] = chisq_p(chisq[k])
+// The statistics are bit-identical to ClassFeat::determine_significance() before it used
+// this function (the SIMD variants are compiled without FMA contraction).
+void chisq_significance(const float * f_a, const float * f_i, int nr, float n_a, float n_i, float * chisq, float * p);
+
+//! chisq_significance() without SIMD instructions
+void chisq_significance_scalar(const float * f_a, const float * f_i, int nr, float n_a, float n_i, float * chisq, float * p);
+
+//! P(X <= chisq) of the chi-square distribution with one degree of freedom
+//
+// Computed as 1 - erfc(sqrt(chisq/2)) in double precision, which is within 1 ulp of the
+// float result of gsl_cdf_chisq_P(chisq, 1) (0 for chisq <= 0, NaN stays NaN).
+float chisq_p(float chisq);
+
+//! minimum total frequency (f_a+f_i) of a feature that can be significant (chi-square >= 3.84) for the totals n_a, n_i
+int chisq_min_frequency(float n_a, float n_i);
+
+//! instruction set of chisq_significance() on this CPU ("avx2" or "scalar")
+const char * chisq_isa();
+
+#endif
@@ -39,19 +39,35 @@ private:
 
     map<const string, sFeatRef> feature_map;		// lookup features by name
     vector<sFeatRef> features;
+    vector<FeatRef> changed_features;		// features with new matches since the last take_changed_features()
+    shared_ptr<FeatureStats> feature_stats;	// statistics of all features, indexed by feature id
     shared_ptr<Out> out;
 
+    //! add a new feature to the feature table
+    sFeatRef new_feature(string name);
+
 public:
 
     FeatMolVect< MolType, FeatureType, ActivityType >(char * feat_file, char * structure_file, shared_ptr<Out> out);
+    FeatMolVect< MolType, FeatureType, ActivityType >(Snapshot * snapshot, shared_ptr<Out> out);
     ~FeatMolVect() {
 //            for (unsigned int i=0; i<features.size(); i++) {
 //                delete features[i];
 //            }
     }
 
-    //! read features from a file
-    void read_features(char * feat_file);
+    //! read features from a file, compound numbers are relative to first_compound (features that exist already are extended, if first_compound > 0)
+    void read_features(char * feat_file, int first_compound);
+
+    //! add a match of feature name (created if necessary) to compound comp_nr
+    void add_feature_match(string name, int comp_nr);
+
+    //! return and forget the features that got new matches
+    vector<FeatRef> take_changed_features() {
+        vector<FeatRef> changed;
+        changed.swap(changed_features);
+        return(changed);
+    };
 
     void add_feature(sMolRef s, string name);
 
@@ -64,90 +80,196 @@ public:
 
 // read a feature file
 template <class MolType, class FeatureType, class ActivityType>
-FeatMolVect<MolType, FeatureType, ActivityType>::FeatMolVect(char * feat_file, char * structure_file, shared_ptr<Out> out): MolVect< MolType, FeatureType, ActivityType >(structure_file,out), out(out) {
+FeatMolVect<MolType, FeatureType, ActivityType>::FeatMolVect(char * feat_file, char * structure_file, shared_ptr<Out> out): MolVect< MolType, FeatureType, ActivityType >(structure_file,out), feature_stats(FeatureType::new_stats()), out(out) {
+
+    this->read_features(feat_file, 0);
+
+};
+
+template <class MolType, class FeatureType, class ActivityType>
+void FeatMolVect<MolType, FeatureType, ActivityType>::read_features(char * feat_file, int first_compound) {
 
-    ifstream input;
-    input.open(feat_file);
+    LineReader input;	// maps uncompressed files, decompresses gzip/zstd files on a separate thread
 
-    if (!input) {
+    if (!input.open(feat_file)) {
         *out << "Cannot open " << feat_file << endl;
         out->print_err();
         exit(1);
     }
 
-    string line;
-    string tmp_field;
-    int line_nr =1;
+    const char * pos;
+    const char * end;
+    const char * eol;
+    const char * tab;
+    const char * field_end;
+    string name;
+    string dos_field;
     sFeatRef feat_ptr;
+    int line_nr = 1;
+    clock_t t = clock();
 
     *out << "Reading features from " << feat_file << endl;
     out->print_err();
-    while (getline(input, line)) {
 
-        istringstream iss(line);
-        int i =0;
+    while (input.next(&pos, &end)) {
+
+        // grow geometrically, compressed files come in many blocks
+        size_t nr_lines = features.size() + count_lines(pos, end);
+        if (nr_lines > features.capacity())
+            features.reserve(max(nr_lines, 2 * features.capacity()));
+
+        for (; pos < end; pos = eol + 1, line_nr++) {
 
-        while (getline(iss, tmp_field, '\t') && i < 2) {	// split at tab and read exactly 2 fields
-            remove_dos_cr(&tmp_field);
+            eol = scan_to(pos, end, '\n');
+            if (eol == pos)		// empty line
+                continue;
 
-            if (i==0) {		// SMARTS
+            // SMARTS
+            tab = scan_to(pos, eol, '\t');
+            name.assign(pos, tab);
+            remove_dos_cr(&name);
 
-                feat_ptr.reset(new Feature<FeatureType>(tmp_field)); // initialize Feature with smarts
-                feature_map[tmp_field] = feat_ptr;
-                features.push_back(feat_ptr);
+            typename map<const string, sFeatRef>::iterator known = feature_map.find(name);
 
+            if (first_compound > 0 && known != feature_map.end())	// appended compounds
+                feat_ptr = known->second;
+            else {
+                feat_ptr = this->new_feature(name); // initialize Feature with smarts
             }
+            changed_features.push_back(feat_ptr.get());
 
-            else {			// MATCHES
+            if (tab == eol)
+                continue;
 
-                size_t startpos = 0, endpos = 0;
-                vector<string> tokens;
+            // MATCHES: whitespace separated tokens from "[" to "]" (ignore everything after the second tab)
+            pos = tab + 1;
+            field_end = scan_to(pos, eol, '\t');
 
-                for (;;) {
+            if (scan_to(pos, field_end, '\r') != field_end) {	// DOS line ends: tokenize a cleaned copy
+                dos_field.assign(pos, field_end);
+                remove_dos_cr(&dos_field);
+                pos = dos_field.data();
+                field_end = pos + dos_field.size();
+            }
+
+            int nr_tokens = 0;
+            for (const char * c = pos; c < field_end; c++)
+                if (*c == ' ') nr_tokens++;
+            feat_ptr->reserve_matches(feat_ptr->nr_matches() + nr_tokens);
 
-                    startpos = tmp_field.find_first_not_of(" \t\n",startpos);
-                    endpos   = tmp_field.find_first_of(" \t\n",startpos);
+            for (;;) {
 
-                    if (endpos < tmp_field.size() && startpos <= tmp_field.size())
-                        tokens.push_back(tmp_field.substr(startpos,endpos-startpos));
-                    else
-                        break;
+                while (pos < field_end && *pos == ' ')
+                    pos++;
+                const char * token_end = pos;
+                while (token_end < field_end && *token_end != ' ')
+                    token_end++;
 
-                    startpos = endpos + 1;
+                if (token_end >= field_end)	// tokens have to be terminated by whitespace
+                    break;
 
+                if (token_end - pos == 1 && *pos == '[') {
+                    pos = token_end + 1;
+                    continue;
                 }
+                else if (token_end - pos == 1 && *pos == ']')
+                    break;
 
-                for (unsigned int i = 0 ; i < tokens.size() ; i++ ) {
+                int comp_nr = first_compound + scan_int(pos, token_end);
 
-                    if ( tokens[i] == "[" )
-                        continue;
-                    else if ( tokens[i] == "]" )
-                        break;
+                if (comp_nr < first_compound || comp_nr >= this->get_size()) {
+                    *out << "Invalid compound number " << comp_nr - first_compound << " at line " << line_nr << " of " << feat_file << " ... exiting.\n";
+                    out->print_err();
+                    exit(1);
+                }
 
-                    string comp_id = tokens[i].c_str();
-		   
-                    // AM: read id instead of line no
-                    //int comp_nr = this->get_linenrfromid(comp_id);
+                feat_ptr->add_match(comp_nr);
+                this->get_compound(comp_nr)->add_feature(feat_ptr.get());
 
-                    // AM: OLD IMPLEEMENTATION
-        		    int comp_nr = atoi(comp_id.c_str());
+                pos = token_end + 1;
+            }
 
-                    feat_ptr->add_match(comp_nr);
-                    this->get_compound(comp_nr)->add_feature(feat_ptr.get());
+        }
 
-                }
+    }
 
-            }
+    if (input.failed()) {
+        *out << feat_file << " is corrupt or truncated ... exiting.\n";
+        out->print_err();
+        exit(1);
+    }
+
+    float secs = (float)(clock()-t)/CLOCKS_PER_SEC;
+    float mb = input.get_bytes() / (1024.0 * 1024.0);
+    *out << "Read " << features.size() << " features (" << mb << " MB in " << secs << " sec, ";
+    if (secs > 0)
+        *out << mb / secs << " MB/s)\n";
+    else
+        *out << "n/a MB/s)\n";
+    out->print_err();
+
+};
+
+// take features and matches from a snapshot
+template <class MolType, class FeatureType, class ActivityType>
+FeatMolVect<MolType, FeatureType, ActivityType>::FeatMolVect(Snapshot * snapshot, shared_ptr<Out> out): MolVect< MolType, FeatureType, ActivityType >(snapshot,out), feature_stats(FeatureType::new_stats()), out(out) {
+
+    sFeatRef feat_ptr;
+    const SnapFeature * feat;
+    const int32_t * postings;
+
+    features.reserve(snapshot->get_nr_features());
+
+    for (int n = 0; n < snapshot->get_nr_features(); n++) {
 
-            i++;
+        feat = snapshot->get_feature(n);
+        postings = snapshot->get_postings(feat);
 
+        feat_ptr = this->new_feature(snapshot->get_string(feat->name));
+
+        for (uint32_t i = 0; i < feat->nr_postings; i++) {
+            feat_ptr->add_match(postings[i]);
+            this->get_compound(postings[i])->add_feature(feat_ptr.get());
         }
+    }
+
+};
+
+template <class MolType, class FeatureType, class ActivityType>
+void FeatMolVect<MolType, FeatureType, ActivityType>::add_feature_match(string name, int comp_nr) {
 
-        line_nr++;
+    sFeatRef feat_ptr;
+    typename map<const string, sFeatRef>::iterator pos = feature_map.find(name);
 
+    if (pos != feature_map.end())
+        feat_ptr = pos->second;
+    else {
+        feat_ptr = this->new_feature(name);
     }
 
-    input.close();
+    // keep the matches sorted
+    vector<int> * matches = feat_ptr->get_matches_ptr();
+    vector<int>::iterator match = lower_bound(matches->begin(), matches->end(), comp_nr);
+    if (match != matches->end() && *match == comp_nr)
+        return;
+    matches->insert(match, comp_nr);
+
+    this->get_compound(comp_nr)->add_feature(feat_ptr.get());
+    changed_features.push_back(feat_ptr.get());
+
+};
+
+template <class MolType, class FeatureType, class ActivityType>
+shared_ptr<Feature<FeatureType> > FeatMolVect<MolType, FeatureType, ActivityType>::new_feature(string name) {
+
+    sFeatRef feat_ptr(new Feature<FeatureType>(name));
+
+    feat_ptr->set_id(features.size());
+    feat_ptr->set_stats(feature_stats);
+    feature_map[name] = feat_ptr;
+    features.push_back(feat_ptr);
+    feature_stats->set_nr_features(features.size());
+    return(feat_ptr);
 
 };
 
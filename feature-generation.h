@@ -246,7 +246,7 @@ void FeatGen<MolType, FeatureType, ActivityType>::generate_rex(int max_l) {
 template <class MolType, class FeatureType, class ActivityType>
 void FeatGen<MolType, FeatureType, ActivityType>::read_smarts(char * file, bool print, bool split_bonds) {
 
-    ifstream input;
+    InputFile input;
     input.open(file);
     if (!input) {
         *out << "Cannot open " << file << endl;
@@ -266,6 +266,11 @@ void FeatGen<MolType, FeatureType, ActivityType>::read_smarts(char * file, bool
         new_feat_ptr = new Feature<OBLinFrag>(smarts, split_bonds);
         alphabet.push_back(new_feat_ptr);
     }
+    if (input.failed()) {
+        *out << file << " is corrupt or truncated ... exiting.\n";
+        out->print();
+        exit(1);
+    }
 };
 
 template <class MolType, class FeatureType, class ActivityType>
@@ -472,7 +477,7 @@ void FeatGen<MolType, FeatureType, ActivityType>::match(OBLinFragRef feat_ptr) {
 
     for (cur_mol = compounds.begin(); cur_mol != compounds.end(); cur_mol++) {
 
-        if ( sp->Match(*(*cur_mol)->get_mol_ref(),true) ) {
+        if ( (*cur_mol)->MolType::match(sp) ) {
             feat_ptr->add_match(comp_nr);
         }
 
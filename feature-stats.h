@@ -0,0 +1,260 @@
+/* Copyright (C) 2005  Christoph Helma <helma@in-silico.de>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+
+*/
+
+#ifndef FEATURE_STATS_H
+#define FEATURE_STATS_H
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <math.h>
+
+#include "boost/unordered_map.hpp"
+
+using namespace std;
+using namespace boost;
+
+//! statistics (significance, p, ...) of all features of a training set
+//
+// Struct of arrays: there is one float array per (slot, statistic), indexed by the
+// feature id. A slot is an endpoint id combined with one of nr_states states
+// (e.g. the LOO states of classification features): slot = endpoint * nr_states + state.
+// Arrays are allocated on the first write, unwritten values are 0.
+// Similarity weights of the features are derived from the p values by fill_weights()
+// and dropped by the next write to the slot.
+// Writes to the slots of an endpoint can be made reversible with begin_delta(): the
+// previous values are recorded, finish_delta() updates only the weights of the changed
+// features and rollback() restores the recorded values in O(changes). Generations are
+// never reused, rollback() restores the ones from before begin_delta() together with the
+// weights, i.e. caches of the whole training set stay valid.
+class FeatureStats {
+
+private:
+
+    //! previous value of a statistic (stat -1: weight) of a feature
+    struct Change {
+        int slot;
+        int stat;
+        int feat;
+        float value;
+        Change(int slot, int stat, int feat, float value): slot(slot), stat(stat), feat(feat), value(value) {};
+    };
+
+    int nr_stats;
+    int nr_states;
+    int nr_features;
+    vector<string> endpoints;
+    unordered_map<string, int> ids;
+    vector<vector<float> > columns;	// columns[slot * nr_stats + stat]
+    vector<vector<float> > weights;	// weights[slot], empty if outdated
+    vector<unsigned int> generations;	// generations[slot], changes whenever the weights of slot change
+    unsigned int last_generation;
+    vector<vector<Change> > deltas;	// deltas[endpoint], changes since begin_delta()
+    vector<vector<unsigned int> > delta_generations;	// delta_generations[endpoint], generations of its slots at begin_delta()
+    vector<char> delta_open;
+    bool str_active;	// activity of the LOO test structure
+    int nr_occurring;	// features that occur in the LOO test structure
+
+    void bump_generation(int slot) {
+        generations[slot] = ++last_generation;
+    };
+
+    void bump_generations(int ep) {
+        for (int slot = ep * nr_states; slot < (ep + 1) * nr_states; slot++)
+            this->bump_generation(slot);
+    };
+
+public:
+
+    FeatureStats(int nr_stats, int nr_states): nr_stats(nr_stats), nr_states(nr_states), nr_features(0), last_generation(0), str_active(false), nr_occurring(0) {};
+
+    //! expected number of features (arrays grow on demand)
+    void set_nr_features(int n) {
+        if (n != nr_features)
+            for (unsigned int slot = 0; slot < weights.size(); slot++) {
+                weights[slot].clear();
+                this->bump_generation(slot);
+            }
+        nr_features = n;
+    };
+
+    int get_nr_states() {
+        return(nr_states);
+    };
+
+    //! activity of the current LOO test structure (selects the LOO states of classification features)
+    void set_str_active(bool active) {
+        str_active = active;
+    };
+    bool is_str_active() {
+        return(str_active);
+    };
+
+    //! add nr features that occur in the current LOO test structure (negative: no longer occur)
+    void add_occurring(int nr) {
+        nr_occurring += nr;
+    };
+    int get_nr_occurring() {
+        return(nr_occurring);
+    };
+
+    int get_nr_endpoints() {
+        return(endpoints.size());
+    };
+
+    //! id of endpoint act, -1 if no statistics have been stored for act
+    int get_endpoint(const string & act) {
+        unordered_map<string, int>::iterator found = ids.find(act);
+        return(found == ids.end() ? -1 : found->second);
+    };
+
+    //! id of endpoint act, added if necessary
+    int intern(const string & act) {
+        int ep = this->get_endpoint(act);
+        if (ep < 0) {
+            ep = endpoints.size();
+            endpoints.push_back(act);
+            ids[act] = ep;
+            columns.resize(endpoints.size() * nr_states * nr_stats);
+            weights.resize(endpoints.size() * nr_states);
+            generations.resize(endpoints.size() * nr_states, 0);
+            deltas.resize(endpoints.size());
+            delta_generations.resize(endpoints.size());
+            delta_open.resize(endpoints.size(), 0);
+        }
+        return(ep);
+    };
+
+    float get(int slot, int stat, int feat) {
+        if (slot < 0)
+            return(0);
+        const vector<float> & col = columns[slot * nr_stats + stat];
+        return(feat < (int) col.size() ? col[feat] : 0);
+    };
+
+    void set(int slot, int stat, int feat, float value) {
+        vector<float> & col = columns[slot * nr_stats + stat];
+        if (feat >= (int) col.size())
+            col.resize(max(feat + 1, nr_features), 0);
+        if (delta_open[slot / nr_states]) {	// the weights are updated by finish_delta()
+            deltas[slot / nr_states].push_back(Change(slot, stat, feat, col[feat]));
+            col[feat] = value;
+            return;
+        }
+        col[feat] = value;
+        weights[slot].clear();
+        this->bump_generation(slot);
+    };
+
+    //! record the following writes to the slots of endpoint ep for rollback()
+    void begin_delta(int ep) {
+        deltas[ep].clear();
+        delta_generations[ep].assign(generations.begin() + ep * nr_states, generations.begin() + (ep + 1) * nr_states);
+        delta_open[ep] = 1;
+    };
+
+    bool in_delta(int ep) {
+        return(ep >= 0 && delta_open[ep]);
+    };
+
+    //! recompute the weights of the features whose statistic p_stat has changed since begin_delta(ep)
+    void finish_delta(int ep, int p_stat, float limit) {
+        int nr = deltas[ep].size();
+        for (int i = 0; i < nr; i++) {
+            Change c = deltas[ep][i];
+            if (c.stat != p_stat || c.feat >= (int) weights[c.slot].size())
+                continue;
+            float w = weight(this->get(c.slot, p_stat, c.feat), limit);
+            if (w != weights[c.slot][c.feat]) {
+                deltas[ep].push_back(Change(c.slot, -1, c.feat, weights[c.slot][c.feat]));
+                weights[c.slot][c.feat] = w;
+            }
+        }
+        this->bump_generations(ep);
+    };
+
+    //! restore the statistics, weights and generations of endpoint ep from before begin_delta(ep)
+    void rollback(int ep) {
+        for (int i = deltas[ep].size() - 1; i >= 0; i--) {
+            const Change & c = deltas[ep][i];
+            vector<float> & col = c.stat < 0 ? weights[c.slot] : columns[c.slot * nr_stats + c.stat];
+            if (c.feat < (int) col.size())
+                col[c.feat] = c.value;
+        }
+        for (int k = 0; k < nr_states; k++) {
+            int slot = ep * nr_states + k;
+            if (weights[slot].empty())	// dropped in between (e.g. by set_nr_features()), refilled with a new generation
+                this->bump_generation(slot);
+            else
+                generations[slot] = delta_generations[ep][k];
+        }
+        deltas[ep].clear();
+        delta_open[ep] = 0;
+    };
+
+    //! similarity weight of a feature with p value p: gaussian kernel (like FeatMol::gauss()) if p passes limit, 0 otherwise
+    static float weight(float p, float limit) {
+        if (!(p >= limit))
+            return(0);
+        const float sigma = 0.3;
+        float x = 1.0 - p;
+        if (x > 1.0) x = 1.0;
+        if (x < 0.0) x = 0.0;
+        return(exp(-(x*x)/(2*sigma*sigma)));
+    };
+
+    //! compute the weights of all slots of endpoint ep from statistic p_stat
+    void fill_weights(int ep, int p_stat, float limit) {
+        for (int slot = ep * nr_states; slot < (ep + 1) * nr_states; slot++) {
+            const vector<float> & p = columns[slot * nr_stats + p_stat];
+            vector<float> & w = weights[slot];
+            w.assign(max(nr_features, 1), weight(0, limit));	// unwritten p values are 0
+            for (unsigned int feat = 0; feat < p.size() && feat < w.size(); feat++)
+                w[feat] = weight(p[feat], limit);
+            this->bump_generation(slot);
+        }
+    };
+
+    //! changes whenever the weights of slot change (for caches of derived values)
+    unsigned int get_generation(int slot) {
+        return(slot < 0 ? 0 : generations[slot]);
+    };
+
+    //! weights of slot, NULL if they are outdated
+    const float * get_weights(int slot) {
+        if (slot < 0 || weights[slot].empty())
+            return(NULL);
+        return(&weights[slot][0]);
+    };
+
+    //! size of the weight array of slot (0 if it is outdated)
+    int get_nr_weights(int slot) {
+        return(slot < 0 ? 0 : weights[slot].size());
+    };
+
+    //! contiguous array of a statistic with at least nr values
+    const float * get_column(int slot, int stat, int nr) {
+        vector<float> & col = columns[slot * nr_stats + stat];
+        if ((int) col.size() < nr)
+            col.resize(nr, 0);
+        return(col.empty() ? NULL : &col[0]);
+    };
+
+};
+
+#endif
@@ -41,112 +41,41 @@ void Feat::print(shared_ptr<Out> out) {
 
 // ClassFeat
 
-void ClassFeat::precompute_significance(string act, float n_a, float n_i, float f_a, float f_i) { // AM: determine significance
+FeatureStats * ClassFeat::get_stats() {
+    if (!stats)
+        stats = new_stats();
+    return(stats.get());
+};
 
-    fa[act]=f_a;
-    fi[act]=f_i;
-    na[act]=n_a;
-    ni[act]=n_i;
+void ClassFeat::set_loo_counts(string act, float n_a, float n_i, float f_a, float f_i) {
 
-    //pre-computing 4 significance values for all features for loo classification
-    //the right value for each feature depends on two criteria:
-    // - is the test structure active (reduces either n_a, or n_i)
-    // - does the feature occur in the test structure (if yes then reduce either f_a or f_i)
+    int slot = get_stats()->intern(act) * 4;
 
-    cur_str_active = true;
-    cur_feat_occurs = true;
-    precompute_significance(act);
+    stats->set(slot, FA, row(), f_a);
+    stats->set(slot, FI, row(), f_i);
+    stats->set(slot, NA, row(), n_a);
+    stats->set(slot, NI, row(), n_i);
+}
 
-    cur_str_active = true;
-    cur_feat_occurs = false;
-    precompute_significance(act);
+void ClassFeat::set_loo_significance(string act, bool str_active, bool feat_occurs, float chisq, float p, bool too_infrequent) {
 
-    cur_str_active = false;
-    cur_feat_occurs = true;
-    precompute_significance(act);
+    int slot = get_stats()->intern(act) * 4 + (str_active ? 2 : 0) + (feat_occurs ? 1 : 0);
 
-    cur_str_active = false;
-    cur_feat_occurs = false;
-    precompute_significance(act);
+    stats->set(slot, SIGNIFICANCE, row(), chisq);
+    stats->set(slot, P, row(), p);
+    stats->set(slot, TOO_INFREQUENT, row(), too_infrequent ? 1 : 0);
 }
 
-bool ClassFeat::cur_str_active = false;
-
 void ClassFeat::set_cur_feat_occurs(bool feat_occurs){
+    if (feat_occurs != cur_feat_occurs)
+        get_stats()->add_occurring(feat_occurs ? 1 : -1);
     cur_feat_occurs = feat_occurs;
 }
 
-string ClassFeat::get_map_key(string act)
-{
-    if (cur_str_active)
-        if (cur_feat_occurs)
-            return act.append("_active_occurs");
-        else
-            return act.append("_active");
-    else
-        if (cur_feat_occurs)
-            return act.append("_occurs");
-        else
-            return act;
-}
-
-void ClassFeat::precompute_significance(string act) { // AM: determine significance
-
-    float n_a = get_na(act);
-    float n_i = get_ni(act);
-    float f_a = get_fa(act);
-    float f_i = get_fi(act);
-
-    float ea;
-    float ei;
-    float chisq;
-
-    // fragments with total frequency of 1 are not informative, but confounding
-    if (f_a>=0 && f_i>=0 && (f_a+f_i)>1) {
-
-        ea = n_a*(f_a+f_i)/(n_a+n_i); // expected actives
-        ei = n_i*(f_a+f_i)/(n_a+n_i);  // expected inactives
-
-        // calculate chi square with Yate's correction
-        // i.e. reduce observed frequencies by 0.5
-        chisq = (f_a-ea-0.5)*(f_a-ea-0.5)/ea + (f_i-ei-0.5)*(f_i-ei-0.5)/ei;
-
-    }
-    else
-        chisq = 0;
-
-    significance[get_map_key(act)]=chisq;
-    p[get_map_key(act)]=calc_p(act);
-    float cur_chisq = 0;
-    float cur_ea;
-    float cur_ei;
-    int i;
-
-    if (n_a > n_i) {	// exchange na and ni
-        float tmp  = n_a;
-        n_a = n_i;
-        n_i = tmp;
-    }
-    // find minimum frequency for statistical significance
-    for (i=1; cur_chisq < 3.84; i++) {
-        cur_ea = n_a*i/(n_a+n_i);
-        cur_ei = n_i*i/(n_a+n_i);
-        cur_chisq = (i-cur_ea-0.5)*(i-cur_ea-0.5)/cur_ea + (cur_ei+0.5)*(cur_ei+0.5)/cur_ei ;
-    }
-    if (f_a<0 || f_i<0 || (f_a+f_i) < i)
-        too_infrequent[get_map_key(act)] = true;
-    else
-        too_infrequent[get_map_key(act)] = false;
-};
-
-
 void ClassFeat::determine_significance(string act, float n_a, float n_i, vector<bool> * activities) { // AM: determine significance
 
     vector<bool>::iterator a;
 
-    float ea;
-    float ei;
-    float chisq;
     float f_a=0;
     float f_i=0;
 
@@ -160,47 +89,33 @@ void ClassFeat::determine_significance(string act, float n_a, float n_i, vector<
 
     }
 
-    // fragments with total frequency of 1 are not informative, but confounding
-    if ((f_a+f_i)>1) {
+    this->determine_significance(act, n_a, n_i, f_a, f_i);
 
-        ea = n_a*(f_a+f_i)/(n_a+n_i); // expected actives
-        ei = n_i*(f_a+f_i)/(n_a+n_i);  // expected inactives
+};
 
-        // calculate chi square with Yate's correction
-        // i.e. reduce observed frequencies by 0.5
-        chisq = (f_a-ea-0.5)*(f_a-ea-0.5)/ea + (f_i-ei-0.5)*(f_i-ei-0.5)/ei;
+void ClassFeat::determine_significance(string act, float n_a, float n_i, float f_a, float f_i) {
 
-    }
+    float chisq;
+    float p;
 
+    chisq_significance(&f_a, &f_i, 1, n_a, n_i, &chisq, &p);
+    this->set_significance(act, n_a, n_i, f_a, f_i, chisq, p, chisq_min_frequency(n_a, n_i));
+
+};
+
+void ClassFeat::set_significance(string act, float n_a, float n_i, float f_a, float f_i, float chisq, float p, int min_frequency) {
+
+    int slot = get_stats()->intern(act) * 4;	// LOO state 0
+    stats->set(slot, FA, row(), f_a);
+    stats->set(slot, FI, row(), f_i);
+    stats->set(slot, NA, row(), n_a);
+    stats->set(slot, NI, row(), n_i);
+    stats->set(slot, SIGNIFICANCE, row(), chisq);
+    stats->set(slot, P, row(), p);
+    if ((f_a+f_i) < min_frequency)
+        stats->set(slot, TOO_INFREQUENT, row(), 1);
     else
-        chisq = 0;
-
-    fa[act]=f_a;
-    fi[act]=f_i;
-    na[act]=n_a;
-    ni[act]=n_i;
-    significance[act]=chisq;
-    p[act]=calc_p(act);
-    float cur_chisq = 0;
-    float cur_ea;
-    float cur_ei;
-    int i;
-
-    if (n_a > n_i) {	// exchange na and ni
-        float tmp  = n_a;
-        n_a = n_i;
-        n_i = tmp;
-    }
-    // find minimum frequency for statistical significance
-    for (i=1; cur_chisq < 3.84; i++) {
-        cur_ea = n_a*i/(n_a+n_i);
-        cur_ei = n_i*i/(n_a+n_i);
-        cur_chisq = (i-cur_ea-0.5)*(i-cur_ea-0.5)/cur_ea + (cur_ei+0.5)*(cur_ei+0.5)/cur_ei ;
-    }
-    if ((f_a+f_i) < i)
-        too_infrequent[act] = true;
-    else
-        too_infrequent[act] = false;
+        stats->set(slot, TOO_INFREQUENT, row(), 0);
 
 };
 
@@ -238,44 +153,48 @@ float ClassFeat::get_p_limit() {
 
 float ClassFeat::calc_p(string act) {
 
-    return gsl_cdf_chisq_P(significance[get_map_key(act)], 1);
+    return chisq_p(get_significance(act));
 };
 
 float ClassFeat::get_p(string act) {
 
-    return p[get_map_key(act)];
+    return get_stats()->get(get_slot(get_endpoint(act)), P, row());
 };
 
 float ClassFeat::get_na(string act) {
 
-    if (cur_str_active)
-        return na[act]-1;
+    float na = get_stats()->get(get_endpoint(act) * 4, NA, row());	// negative slot for unknown endpoints
+    if (cur_str_active())
+        return na-1;
     else
-        return na[act];
+        return na;
 };
 
 float ClassFeat::get_ni(string act) {
 
-    if (cur_str_active)
-        return ni[act];
+    float ni = get_stats()->get(get_endpoint(act) * 4, NI, row());
+    if (cur_str_active())
+        return ni;
     else
-        return ni[act]-1;
+        return ni-1;
 };
 
 float ClassFeat::get_fa(string act) {
 
-    if (cur_str_active && cur_feat_occurs)
-        return fa[act]-1;
+    float fa = get_stats()->get(get_endpoint(act) * 4, FA, row());
+    if (cur_str_active() && cur_feat_occurs)
+        return fa-1;
     else
-        return fa[act];
+        return fa;
 };
 
 float ClassFeat::get_fi(string act) {
 
-    if (!cur_str_active && cur_feat_occurs)
-        return fi[act]-1;
+    float fi = get_stats()->get(get_endpoint(act) * 4, FI, row());
+    if (!cur_str_active() && cur_feat_occurs)
+        return fi-1;
     else
-        return fi[act];
+        return fi;
 };
 
 void ClassFeat::print_specifics(string act, shared_ptr<Out> out) {
@@ -303,84 +222,26 @@ void ClassFeat::print_specifics(string act, shared_ptr<Out> out) {
 
 // RegrFeat
 
-void RegrFeat::determine_significance(string act, vector<float> all_activities, vector<float> feat_activities) {
+FeatureStats * RegrFeat::get_stats() {
+    if (!stats)
+        stats = new_stats();
+    return(stats.get());
+};
+
+void RegrFeat::set_ks_significance(string act, float d, float en1, float en2, float median, float all_median) {
 
     // Kolmogorov-Smirnov Test
     // numerical recipies in C pp 626, extended version with better sensitivity at the ends
-    unsigned int j1=0, j2=0;
-    float d,d1,d2,d_1,d_2,dt1,dt2,en1,en2,en,fn1=0,fn2=0,alam;
-    d1 = d2 = d_1 = d_2 = 0.0;
-
-    sort(feat_activities.begin(),feat_activities.end());
-    sort(all_activities.begin(), all_activities.end());
-
-    en1 = all_activities.size();
-    en2 = feat_activities.size();
+    float en,alam;
 
-    while (j1 < en1 && j2 < en2) {
-        if ((!isnan(d1=all_activities[j1])) && (!isnan(d2=feat_activities[j2]))) {
-            if (d1 <= d2) { // next step is in all_activities
-                j1++;
-                fn1=j1/en1;
-            }
-
-            if (d2 <= d1) { // next step is in feat_activities
-                j2++;
-                fn2=j2/en2;
-            }
-
-        }
-        else {
-            if (isnan(d1)) {
-                j1++;
-            }
-            if (isnan(d2)){
-                j2++;
-            }
-            continue;
-        }
-        dt1=fn2-fn1;
-        dt2=fn1-fn2;
-        if (dt1 > d_1) d_1=dt1;
-        if (dt2 > d_2) d_2=dt2;
-    }
-    d = d_1 + d_2;
     en=sqrt(en1*en2/(en1+en2));
     alam=(en+0.155+0.24/en)*d;
 
-    /*
-    // KS probability function
-    a2 = -2.0 *alam*alam;
-    p = 0;	// if probability function does not converge
-    fac2 = 4.0*alam*alam;
-    for (j=1;j<=100;j++) {
-    	term = fac*((fac2*j*j)-1.0)*exp(a2*j*j);
-    	sum += term;
-    	if (fabs(term) <= 0.001*termbf || fabs(term) <= 1.0e-8*sum) {
-    		p=1-sum;
-    		break;
-    	}
-    	termbf=fabs(term);
-    }
-    */
-
-    // compute and compare medians to determine activation property
-    float aasum, aamedian, aamean, aavar, aadev, aaskew, aakurt;
-    computeStats(all_activities.begin(), all_activities.end(), aasum, aamedian, aamean, aavar, aadev, aaskew, aakurt);
-    float fasum, famedian, famean, favar, fadev, faskew, fakurt;
-    
-    // DEBUG-AM
-    if (!feat_activities.size()) {
-        cerr << "Missing feature activities for " << get_name() << endl;
-        exit(1);
-    }
-
-    computeStats(feat_activities.begin(), feat_activities.end(), fasum, famedian, famean, favar, fadev, faskew, fakurt);
-
-    median[act]=famedian;
-    global_median[act]=aamedian;
-    significance[act]=alam;
-    p[act]=calc_p(act);
+    // medians determine the activation property
+    set(act, MEDIAN, median);
+    set(act, GLOBAL_MEDIAN, all_median);
+    set(act, SIGNIFICANCE, alam);
+    set(act, P, calc_p(act));
 };
 
 
@@ -435,13 +296,13 @@ void RegrFeat::determine_significance(string act, float global_med, vector<float
         med = numeric_limits<float>::quiet_NaN();
         sig = 0;
     }
-    significance[act]=sig;
-    p[act]=calc_p(act);
-    median[act]=med;
-    global_median[act]=global_med;
-    feature_larger[act]=f_l;
-    feature_smaller[act]=f_s;
-    nr[act]=n;
+    set(act, SIGNIFICANCE, sig);
+    set(act, P, calc_p(act));
+    set(act, MEDIAN, med);
+    set(act, GLOBAL_MEDIAN, global_med);
+    set(act, FEATURE_LARGER, f_l);
+    set(act, FEATURE_SMALLER, f_s);
+    set(act, NR, n);
 };
 
 
@@ -453,9 +314,9 @@ void RegrFeat::print_header(shared_ptr<Out> out) {
 void RegrFeat::print(string act,shared_ptr<Out> out) {
 
     *out << "    - smarts: '" << this->get_name() << "'\n";
-    *out << "      p_ks: '" << this->p[act] << "'\n";
+    *out << "      p_ks: '" << get(act, P) << "'\n";
     *out << "      property: '";
-    if (median[act]>global_median[act]) {
+    if (get(act, MEDIAN) > get(act, GLOBAL_MEDIAN)) {
         *out << "deactivating";
     }
     else {
@@ -472,24 +333,25 @@ float RegrFeat::get_p_limit() {
 };
 
 float RegrFeat::get_global_median(string act) {
-    return(global_median[act]);
+    return(get(act, GLOBAL_MEDIAN));
 };
 
 float RegrFeat::get_median(string act) {
-    return(median[act]);
+    return(get(act, MEDIAN));
 };
 
 float RegrFeat::get_p(string act) {
-    return(p[act]);
+    return(get(act, P));
 };
 
 float RegrFeat::calc_p(string act) {
 
     float p,a2,fac=2,sum=0,term,termbf=0,fac2;
+    float significance = get(act, SIGNIFICANCE);
     // KS probability function
-    a2 = -2.0 *significance[act]*significance[act];
+    a2 = -2.0 *significance*significance;
     p = 0;	// if probability function does not converge
-    fac2 = 4.0*significance[act]*significance[act];
+    fac2 = 4.0*significance*significance;
     for (int j=1;j<=100;j++) {
         term = fac*((fac2*j*j)-1.0)*exp(a2*j*j);
         sum += term;
@@ -504,7 +366,7 @@ float RegrFeat::calc_p(string act) {
 };
 
 void RegrFeat::print_specifics(string act, shared_ptr<Out> out) {
-    float p = this->p[act];
+    float p = get(act, P);
     *out << this->get_name() << "\t" << p << "\t";
     out->print();
 }
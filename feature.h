@@ -32,6 +32,8 @@
 #include <openbabel/parsmart.h>
 
 #include "io.h"
+#include "feature-stats.h"
+#include "chisq.h"
 
 using namespace std;
 using namespace OpenBabel;
@@ -43,10 +45,27 @@ private:
 
     string name;
 
+protected:
+
+    //! dense index in the training set features (-1 for features that are not part of a training set)
+    int id;
+
 public:
 
-    Feat() {};
-    Feat(string newname): name(newname) {};
+    Feat(): id(-1) {};
+    Feat(string newname): name(newname), id(-1) {};
+
+    int get_id() {
+        return(id);
+    };
+    void set_id(int new_id) {
+        id = new_id;
+    };
+
+    //! row in the statistics table (features without id get a private table)
+    int row() {
+        return(id < 0 ? 0 : id);
+    };
 
     string get_name();
     void set_name(string newname);
@@ -60,22 +79,24 @@ class ClassFeat: public Feat {
 
 private:
 
-    map<string, float> na;
-    map<string, float> ni;
-    map<string, float> fa;
-    map<string, float> fi;
-    map<string, float> significance;
-    map<string, float> p;
-    map<string, bool> too_infrequent;
+    //! statistics in the FeatureStats table, na .. fi are stored for the LOO state 0 only
+    enum { NA, NI, FA, FI, SIGNIFICANCE, P, TOO_INFREQUENT, NR_STATS };
 
-    float cur_sig;
-    float cur_p;
+    //! na, ni, fa, fi, significance, p and too_infrequent for each endpoint and LOO state
+    shared_ptr<FeatureStats> stats;
 
     // MG : precompute significance
-    static bool cur_str_active;
     bool cur_feat_occurs;
-    void precompute_significance(string act);
-    string get_map_key(string act);
+    //! activity of the LOO test structure (shared by all features of the statistics table)
+    bool cur_str_active() {
+        return(get_stats()->is_str_active());
+    };
+    //! slot of endpoint ep for the current LOO state (-1 for unknown endpoints)
+    int get_slot(int ep) {
+        if (ep < 0) return(-1);
+        return(ep * 4 + (cur_str_active() ? 2 : 0) + (cur_feat_occurs ? 1 : 0));
+    };
+    FeatureStats * get_stats();
     // MG
 
 public:
@@ -87,49 +108,115 @@ public:
         cur_feat_occurs = false;
     };
 
+    //! table for the statistics of all features of a training set (features without a table use a private one)
+    static shared_ptr<FeatureStats> new_stats() {
+        return(shared_ptr<FeatureStats>(new FeatureStats(NR_STATS, 4)));
+    };
+    void set_stats(shared_ptr<FeatureStats> new_stats) {
+        stats = new_stats;
+    };
+
+    //! endpoint id of act for get_p(int) (-1 if there are no statistics for act)
+    int get_endpoint(string act) {
+        return(this->get_stats()->get_endpoint(act));
+    };
+
     //! Determine feature significance using chi-sq test
     void determine_significance(string act, float n_a, float n_i, vector<bool> * activities); // AM: determine significance
+    //! chi-sq test for the counts f_a, f_i of the feature (n_a, n_i: totals of the training set)
+    void determine_significance(string act, float n_a, float n_i, float f_a, float f_i);
+    //! store the counts and the results of chisq_significance() for them (min_frequency: chisq_min_frequency() of the totals)
+    void set_significance(string act, float n_a, float n_i, float f_a, float f_i, float chisq, float p, int min_frequency);
+    //! chi-sq test for the totals n_a, n_i after removing d_a active and d_i inactive occurrences from the counts of the last determine_significance() call
+    void delta_significance(string act, float n_a, float n_i, float d_a, float d_i) {
+        int slot = get_stats()->intern(act) * 4;	// LOO state 0
+        this->determine_significance(act, n_a, n_i, stats->get(slot, FA, row()) - d_a, stats->get(slot, FI, row()) - d_i);
+    };
 
     // MG : precompute significance
-    void precompute_significance(string act, float n_a, float n_i, float f_a, float f_i);
-    static void set_cur_str_active(bool str_active){
-        cur_str_active = str_active;
+    //! store the counts of the whole training set for the LOO states (LOO state 0, see get_na() .. get_fi())
+    void set_loo_counts(string act, float n_a, float n_i, float f_a, float f_i);
+    //! store the chi-sq test of the LOO state str_active, feat_occurs (computed for the counts without the test structure)
+    void set_loo_significance(string act, bool str_active, bool feat_occurs, float chisq, float p, bool too_infrequent);
+    void set_cur_str_active(bool str_active){
+        get_stats()->set_str_active(str_active);
     };
     void set_cur_feat_occurs(bool feat_occurs);
     // MG
+    //! true while the weights of training compounds depend on the LOO test structure (some features of the statistics table occur in it)
+    bool weights_depend_on_query() {
+        return(get_stats()->get_nr_occurring() > 0);
+    };
 
     void print_header(shared_ptr<Out> out);
     void print(string act,shared_ptr<Out> out);
     void print_specifics(string act, shared_ptr<Out> out);
 
-    void set_cur_significance(string act) {
-        cur_sig = significance[get_map_key(act)];
-    };
-    void set_cur_p(string act) {
-        cur_p = p[get_map_key(act)];
-    };
-
     float get_significance(string act) {
-        return (significance[get_map_key(act)]);
+        return (get_stats()->get(get_slot(get_endpoint(act)), SIGNIFICANCE, row()));
     };
 
-    float get_cur_significance() {
-        return (cur_sig);
-    };
-    float get_cur_p() {
-        return (cur_p);
-    };
     float get_sig_limit();
     float get_p_limit();
     float calc_p(string act);
     float get_p(string act);	//! returns the p value of the feature
+    //! p value for endpoint id ep (from get_endpoint()) in the current LOO state
+    float get_p(int ep) {
+        return(stats->get(get_slot(ep), P, row()));
+    };
+    //! similarity weight for endpoint id ep in the current LOO state, gauss(p) if p passes the limit, 0 otherwise
+    float get_weight(int ep) {
+        return(get_slot_weight(get_slot(ep)));
+    };
+    //! slot of endpoint id ep for features that do not occur in the LOO test structure
+    int get_base_slot(int ep) {
+        if (ep < 0) return(-1);
+        return(ep * 4 + (cur_str_active() ? 2 : 0));
+    };
+    //! similarity weight in slot (get_slot() or get_base_slot())
+    float get_slot_weight(int slot) {
+        const float * w = stats->get_weights(slot);
+        if (w) return(w[row()]);
+        return(FeatureStats::weight(stats->get(slot, P, row()), get_p_limit()));
+    };
+    //! changes whenever the weights of slot change
+    unsigned int get_weight_generation(int slot) {
+        return(stats->get_generation(slot));
+    };
+    //! weights of all features of the statistics table in slot (indexed by feature id), NULL if they have not been filled
+    const float * get_slot_weights(int slot, int * nr) {
+        *nr = stats->get_nr_weights(slot);
+        return(stats->get_weights(slot));
+    };
+    //! precompute the similarity weights of all features in the statistics table for endpoint act
+    void fill_weights(string act) {
+        int ep = get_endpoint(act);
+        if (ep >= 0) stats->fill_weights(ep, P, get_p_limit());
+    };
+    //! record the following statistics changes of endpoint act for rollback_delta() (the table is shared by all features)
+    void begin_delta(string act) {
+        get_stats()->begin_delta(get_stats()->intern(act));
+    };
+    bool in_delta(string act) {
+        return(get_stats()->in_delta(get_endpoint(act)));
+    };
+    //! update the weights of the features whose p values have changed since begin_delta()
+    void finish_delta(string act) {
+        int ep = get_endpoint(act);
+        if (ep >= 0) stats->finish_delta(ep, P, get_p_limit());
+    };
+    //! restore the statistics and weights of endpoint act from before begin_delta()
+    void rollback_delta(string act) {
+        int ep = get_endpoint(act);
+        if (ep >= 0) stats->rollback(ep);
+    };
     float get_na(string act);
     float get_ni(string act);
     float get_fa(string act);
     float get_fi(string act);
 
     bool get_too_infrequent(string act) {
-        return (too_infrequent[get_map_key(act)]);
+        return (get_stats()->get(get_slot(get_endpoint(act)), TOO_INFREQUENT, row()) != 0);
     };
 };
 
@@ -140,25 +227,43 @@ class RegrFeat: public Feat {
 
 private:
 
-    map<string, float> median;
-    map<string, float> global_median;
-    map<string, int> feature_larger;
-    map<string, int> feature_smaller;
-    map<string, int> nr;
-    map<string, float> significance;
-    map<string, float> p;
-    float cur_sig;
-    float cur_p;
-    map<string, bool> too_infrequent;
+    //! statistics in the FeatureStats table
+    enum { MEDIAN, GLOBAL_MEDIAN, FEATURE_LARGER, FEATURE_SMALLER, NR, SIGNIFICANCE, P, TOO_INFREQUENT, NR_STATS };
+
+    //! median .. too_infrequent for each endpoint
+    shared_ptr<FeatureStats> stats;
+
+    FeatureStats * get_stats();
+
+    float get(string act, int stat) {
+        return(get_stats()->get(get_endpoint(act), stat, row()));
+    };
+    void set(string act, int stat, float value) {
+        get_stats()->set(get_stats()->intern(act), stat, row(), value);
+    };
 
 public:
 
     RegrFeat();
     RegrFeat(string name): Feat(name)  {};
 
+    //! table for the statistics of all features of a training set (features without a table use a private one)
+    static shared_ptr<FeatureStats> new_stats() {
+        return(shared_ptr<FeatureStats>(new FeatureStats(NR_STATS, 1)));
+    };
+    void set_stats(shared_ptr<FeatureStats> new_stats) {
+        stats = new_stats;
+    };
+
+    //! endpoint id of act for get_p(int) (-1 if there are no statistics for act)
+    int get_endpoint(string act) {
+        return(this->get_stats()->get_endpoint(act));
+    };
+
     //! Determine feature significance using KS test
     void determine_significance(string act, float median_all, vector<float> * activities);
-    void determine_significance(string act, vector<float> all_activities, vector<float> feat_activities);
+    //! store the KS test of the feature's en2 activities (median: their median) against all en1 activities (all_median: their median), d: KS distance (see ActivityRanks::ks())
+    void set_ks_significance(string act, float d, float en1, float en2, float median, float all_median);
     void determine_significance_ks_e(string act, vector<float> all_activities, vector<float> feat_activities);
 
     //MG:
@@ -166,39 +271,84 @@ public:
         fprintf(stderr, "Not implemented for regression");
         exit(1);
     }
+    void set_cur_str_active(bool str_active){
+        fprintf(stderr, "Not implemented for regression");
+        exit(1);
+    }
     //MG
+    //! weights of training compounds never depend on the test structure
+    bool weights_depend_on_query() {
+        return(false);
+    };
 
     void print_header(shared_ptr<Out> out);
     void print(string act,shared_ptr<Out> out);
     void print_specifics(string act, shared_ptr<Out> out);
 
     float get_significance(string act) {
-        return(significance[act]);
+        return(get(act, SIGNIFICANCE));
     };	//! returns the p value of the feature
-    void set_cur_significance(string act) {
-        cur_sig = significance[act];
-    };
-    void set_cur_p(string act) {
-        cur_p = p[act];
-    };
-    float get_cur_significance() {
-        return (cur_sig);
-    };
-    float get_cur_p() {
-        return (cur_p);
-    };
 //		float get_sig_limit();
     float get_p_limit();
     float get_global_median(string act);
     float get_median(string act);
     float calc_p(string act);
     float get_p(string act);	//! returns the p value of the feature
+    //! p value for endpoint id ep (from get_endpoint())
+    float get_p(int ep) {
+        return(stats->get(ep, P, row()));
+    };
+    //! similarity weight for endpoint id ep, gauss(p) if p passes the limit, 0 otherwise
+    float get_weight(int ep) {
+        return(get_slot_weight(ep));
+    };
+    //! slot of endpoint id ep (there are no LOO states for regression)
+    int get_base_slot(int ep) {
+        return(ep);
+    };
+    //! similarity weight in slot
+    float get_slot_weight(int slot) {
+        const float * w = stats->get_weights(slot);
+        if (w) return(w[row()]);
+        return(FeatureStats::weight(stats->get(slot, P, row()), get_p_limit()));
+    };
+    //! changes whenever the weights of slot change
+    unsigned int get_weight_generation(int slot) {
+        return(stats->get_generation(slot));
+    };
+    //! weights of all features of the statistics table in slot (indexed by feature id), NULL if they have not been filled
+    const float * get_slot_weights(int slot, int * nr) {
+        *nr = stats->get_nr_weights(slot);
+        return(stats->get_weights(slot));
+    };
+    //! precompute the similarity weights of all features in the statistics table for endpoint act
+    void fill_weights(string act) {
+        int ep = get_endpoint(act);
+        if (ep >= 0) stats->fill_weights(ep, P, get_p_limit());
+    };
+    //! record the following statistics changes of endpoint act for rollback_delta() (the table is shared by all features)
+    void begin_delta(string act) {
+        get_stats()->begin_delta(get_stats()->intern(act));
+    };
+    bool in_delta(string act) {
+        return(get_stats()->in_delta(get_endpoint(act)));
+    };
+    //! update the weights of the features whose p values have changed since begin_delta()
+    void finish_delta(string act) {
+        int ep = get_endpoint(act);
+        if (ep >= 0) stats->finish_delta(ep, P, get_p_limit());
+    };
+    //! restore the statistics and weights of endpoint act from before begin_delta()
+    void rollback_delta(string act) {
+        int ep = get_endpoint(act);
+        if (ep >= 0) stats->rollback(ep);
+    };
 
     bool get_too_infrequent(string act) {
-        return (too_infrequent[act]);
+        return (get(act, TOO_INFREQUENT) != 0);
     };
     void set_too_infrequent(string act) {
-        too_infrequent[act] = true;
+        set(act, TOO_INFREQUENT, 1);
     };
 
 };
@@ -290,6 +440,10 @@ public:
     Feature(string name, bool split_string): FeatureType(name, split_string) { };
     Feature(string can_sma, LinFrag fragment, vector<int> pot_matches): FeatureType(can_sma,fragment,pot_matches) {};
 
+    void reserve_matches(int nr) {
+        matches.reserve(nr);
+    };
+
     void add_match(int comp_nr) {
         matches.push_back(comp_nr);
     };
@@ -369,27 +523,16 @@ bool Feature<FeatureType>::more_specific(FeatureType * f2) {
 
 };
 
-template <class FeatureType>
-class greater_sig {
-
-    typedef Feature<FeatureType> * FeatRef;
-
-public:
-
-    bool operator() (const FeatRef f1,const FeatRef f2) {
-        return (f1->get_cur_significance() > f2->get_cur_significance());
-    }
-};
-
+//! orders (p value, feature) pairs by descending p value
 template <class FeatureType>
 class greater_p {
 
-    typedef Feature<FeatureType> * FeatRef;
+    typedef pair<float, Feature<FeatureType> *> RankedFeat;
 
 public:
 
-    bool operator() (const FeatRef f1,const FeatRef f2) {
-        return (f1->get_cur_p() > f2->get_cur_p());
+    bool operator() (const RankedFeat & f1, const RankedFeat & f2) {
+        return (f1.first > f2.first);
     }
 };
 
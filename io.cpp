@@ -17,6 +17,18 @@
 
 */
 
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <zlib.h>
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
 #include "io.h"
 
 void ConsoleOut::print() {
@@ -45,3 +57,431 @@ string StringOut::get_yaml() {
     return old_data;
 };
 
+bool MappedFile::open(const char * file) {
+
+    struct stat st;
+
+    this->close();
+
+    fd = ::open(file, O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    if (fstat(fd, &st) != 0) {
+        this->close();
+        return false;
+    }
+
+    size = st.st_size;
+    if (size > 0) {
+        void * addr = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+        if (addr == MAP_FAILED) {
+            this->close();
+            return false;
+        }
+        data = (char *) addr;
+    }
+
+    return true;
+};
+
+void MappedFile::close() {
+
+    if (data != NULL)
+        munmap(data, size);
+    if (fd >= 0)
+        ::close(fd);
+
+    fd = -1;
+    data = NULL;
+    size = 0;
+};
+
+const char * scan_to(const char * pos, const char * end, char c) {
+
+    const char * found = (const char *) memchr(pos, c, end - pos);
+    return (found == NULL ? end : found);
+};
+
+size_t count_lines(const char * pos, const char * end) {
+
+    size_t nr = 0;
+
+    while (pos < end) {
+        pos = scan_to(pos, end, '\n') + 1;
+        nr++;
+    }
+    return nr;
+};
+
+int scan_int(const char * pos, const char * end) {
+
+    int value = 0;
+    bool negative = false;
+
+    while (pos < end && (*pos == ' ' || *pos == '\t' || *pos == '\n' || *pos == '\r' || *pos == '\f' || *pos == '\v'))
+        pos++;
+
+    if (pos < end && (*pos == '-' || *pos == '+')) {
+        negative = (*pos == '-');
+        pos++;
+    }
+
+    while (pos < end && *pos >= '0' && *pos <= '9') {
+        value = value * 10 + (*pos - '0');
+        pos++;
+    }
+
+    return (negative ? -value : value);
+};
+
+// compressed input files
+
+Compression detect_compression(const char * file) {
+
+    unsigned char magic[4] = {0,0,0,0};
+    FILE * fp = fopen(file, "rb");
+
+    if (fp == NULL)
+        return NO_COMPRESSION;
+
+    size_t n = fread(magic, 1, 4, fp);
+    fclose(fp);
+
+    if (n >= 2 && magic[0] == 0x1f && magic[1] == 0x8b)
+        return GZIP_COMPRESSION;
+    if (n == 4 && magic[0] == 0x28 && magic[1] == 0xb5 && magic[2] == 0x2f && magic[3] == 0xfd)
+        return ZSTD_COMPRESSION;
+
+    return NO_COMPRESSION;
+};
+
+//! exit with an error message if file has a compression that this build cannot read
+static void check_compression(const char * file, Compression compression) {
+
+#ifndef HAVE_ZSTD
+    if (compression == ZSTD_COMPRESSION) {
+        fprintf(stderr, "%s is zstd compressed, but lazar was compiled without zstd support (HAVE_ZSTD in the Makefile) ... exiting.\n", file);
+        exit(1);
+    }
+#endif
+};
+
+// Decompressor
+
+Decompressor::Decompressor(): compression(NO_COMPRESSION), started(false), finished(false), stopped(false), error(false) {
+    pthread_mutex_init(&lock, NULL);
+    pthread_cond_init(&changed, NULL);
+};
+
+Decompressor::~Decompressor() {
+    this->close();
+    pthread_cond_destroy(&changed);
+    pthread_mutex_destroy(&lock);
+};
+
+bool Decompressor::open(const char * new_file, Compression new_compression) {
+
+    FILE * fp;
+
+    this->close();
+
+    if ((fp = fopen(new_file, "rb")) == NULL)
+        return false;
+    fclose(fp);
+
+    file = new_file;
+    compression = new_compression;
+    finished = stopped = error = false;
+
+    if (pthread_create(&thread, NULL, Decompressor::run, this) != 0)
+        return false;
+
+    started = true;
+    return true;
+};
+
+void Decompressor::close() {
+
+    if (!started)
+        return;
+
+    pthread_mutex_lock(&lock);
+    stopped = true;
+    pthread_cond_broadcast(&changed);
+    pthread_mutex_unlock(&lock);
+
+    pthread_join(thread, NULL);
+    started = false;
+
+    while (!blocks.empty()) {
+        delete blocks.front();
+        blocks.pop_front();
+    }
+};
+
+void * Decompressor::run(void * decompressor) {
+
+    Decompressor * d = (Decompressor *) decompressor;
+
+    if (d->compression == ZSTD_COMPRESSION)
+        d->decompress_zstd();
+    else
+        d->decompress_gzip();	// zlib reads uncompressed files unchanged
+
+    return NULL;
+};
+
+bool Decompressor::push_block(vector<char> * block) {
+
+    pthread_mutex_lock(&lock);
+    while (blocks.size() >= max_blocks && !stopped)
+        pthread_cond_wait(&changed, &lock);
+    bool ok = !stopped;
+    if (ok) {
+        blocks.push_back(block);
+        pthread_cond_broadcast(&changed);
+    }
+    pthread_mutex_unlock(&lock);
+
+    if (!ok)
+        delete block;
+    return ok;
+};
+
+void Decompressor::finish(bool failed) {
+
+    pthread_mutex_lock(&lock);
+    finished = true;
+    error = failed;
+    pthread_cond_broadcast(&changed);
+    pthread_mutex_unlock(&lock);
+};
+
+void Decompressor::decompress_gzip() {
+
+    gzFile gz = gzopen(file.c_str(), "rb");
+    bool failed = (gz == NULL);
+
+    while (!failed) {
+
+        vector<char> * block = new vector<char>(block_size);
+        int n = gzread(gz, &(*block)[0], block_size);
+
+        if (n <= 0) {
+            int errnum = Z_OK;
+            gzerror(gz, &errnum);
+            failed = (n < 0 || (errnum != Z_OK && errnum != Z_STREAM_END));
+            delete block;
+            break;
+        }
+
+        block->resize(n);
+        if (!this->push_block(block))
+            break;
+    }
+
+    if (gz != NULL)
+        gzclose(gz);
+    this->finish(failed);
+};
+
+void Decompressor::decompress_zstd() {
+
+#ifdef HAVE_ZSTD
+    FILE * fp = fopen(file.c_str(), "rb");
+    ZSTD_DStream * stream = ZSTD_createDStream();
+    vector<char> in(ZSTD_DStreamInSize());
+    size_t last = 0;
+    bool failed = (fp == NULL || stream == NULL);
+
+    if (!failed)
+        ZSTD_initDStream(stream);
+
+    while (!failed) {
+
+        size_t n = fread(&in[0], 1, in.size(), fp);
+        if (n == 0) {
+            failed = (last != 0 || ferror(fp));	// last frame is incomplete
+            break;
+        }
+
+        ZSTD_inBuffer input = { &in[0], n, 0 };
+        bool stop = false;
+
+        while (input.pos < input.size && !failed && !stop) {
+            vector<char> * block = new vector<char>(block_size);
+            ZSTD_outBuffer output = { &(*block)[0], block->size(), 0 };
+            last = ZSTD_decompressStream(stream, &output, &input);
+            if (ZSTD_isError(last)) {
+                failed = true;
+                delete block;
+                break;
+            }
+            block->resize(output.pos);
+            if (block->empty())
+                delete block;
+            else if (!this->push_block(block))
+                stop = true;
+        }
+        if (stop)
+            break;
+    }
+
+    if (stream != NULL)
+        ZSTD_freeDStream(stream);
+    if (fp != NULL)
+        fclose(fp);
+    this->finish(failed);
+#else
+    this->finish(true);	// compiled without zstd support
+#endif
+};
+
+bool Decompressor::read_block(vector<char> * block) {
+
+    vector<char> * next = NULL;
+
+    if (!started)
+        return false;
+
+    pthread_mutex_lock(&lock);
+    while (blocks.empty() && !finished)
+        pthread_cond_wait(&changed, &lock);
+    if (!blocks.empty()) {
+        next = blocks.front();
+        blocks.pop_front();
+        pthread_cond_broadcast(&changed);
+    }
+    pthread_mutex_unlock(&lock);
+
+    if (next == NULL)
+        return false;
+
+    block->swap(*next);
+    delete next;
+    return true;
+};
+
+bool Decompressor::failed() {
+
+    pthread_mutex_lock(&lock);
+    bool failed = error;
+    pthread_mutex_unlock(&lock);
+    return failed;
+};
+
+// DecompressorBuf
+
+DecompressorBuf::int_type DecompressorBuf::underflow() {
+
+    if (gptr() < egptr())
+        return traits_type::to_int_type(*gptr());
+
+    do {
+        if (!decompressor.read_block(&block))
+            return traits_type::eof();
+    } while (block.empty());
+
+    setg(&block[0], &block[0], &block[0] + block.size());
+    return traits_type::to_int_type(*gptr());
+};
+
+// InputFile
+
+void InputFile::open(const char * file) {
+
+    Compression compression = detect_compression(file);
+    bool ok;
+
+    check_compression(file, compression);
+    this->close();
+
+    if (compression == NO_COMPRESSION) {
+        ok = (file_buf.open(file, ios::in) != NULL);
+        this->rdbuf(&file_buf);
+    }
+    else {
+        ok = decompressor_buf.open(file, compression);
+        this->rdbuf(&decompressor_buf);
+    }
+
+    if (ok)
+        this->clear();
+    else
+        this->setstate(ios::failbit);
+};
+
+void InputFile::close() {
+
+    if (file_buf.is_open())
+        file_buf.close();
+    decompressor_buf.close();
+};
+
+// LineReader
+
+bool LineReader::open(const char * file) {
+
+    compression = detect_compression(file);
+    check_compression(file, compression);
+    at_end = false;
+    buffer.clear();
+    buffer_start = 0;
+    bytes = 0;
+
+    if (compression == NO_COMPRESSION)
+        return mapped.open(file);
+    else
+        return decompressor.open(file, compression);
+};
+
+bool LineReader::next(const char ** begin, const char ** end) {
+
+    if (at_end)
+        return false;
+
+    if (compression == NO_COMPRESSION) {	// the whole mapping at once
+        at_end = true;
+        *begin = mapped.get_data();
+        *end = *begin + mapped.get_size();
+        bytes = mapped.get_size();
+        return (mapped.get_size() > 0);
+    }
+
+    // keep the incomplete last line of the previous block
+    buffer.erase(buffer.begin(), buffer.begin() + buffer_start);
+    buffer_start = 0;
+
+    for (;;) {
+
+        if (!decompressor.read_block(&block)) {	// end of file: hand out the rest
+            at_end = true;
+            if (buffer.empty())
+                return false;
+            buffer_start = buffer.size();
+            break;
+        }
+
+        size_t old_size = buffer.size();
+        buffer.insert(buffer.end(), block.begin(), block.end());
+
+        // last complete line in the new data
+        size_t n = buffer.size();
+        while (n > old_size && buffer[n-1] != '\n')
+            n--;
+        if (n > old_size) {
+            buffer_start = n;
+            break;
+        }
+    }
+
+    *begin = &buffer[0];
+    *end = &buffer[0] + buffer_start;
+    bytes += buffer_start;
+    return true;
+};
+
+bool LineReader::failed() {
+    return (compression != NO_COMPRESSION && decompressor.failed());
+};
@@ -22,6 +22,11 @@
 #include <string>
 #include <iostream>
 #include <sstream>
+#include <fstream>
+#include <vector>
+#include <deque>
+#include <stddef.h>
+#include <pthread.h>
 
 #include "boost/smart_ptr.hpp"
 
@@ -54,4 +59,166 @@ public:
     void print_err();
     string get_yaml();
 };
+
+//! read-only memory mapping of a file, shared with other processes mapping the same file
+class MappedFile {
+
+private:
+
+    int fd;
+    char * data;
+    size_t size;
+
+    MappedFile(const MappedFile&);
+    MappedFile& operator=(const MappedFile&);
+
+public:
+
+    MappedFile(): fd(-1), data(NULL), size(0) {};
+    ~MappedFile() { this->close(); };
+
+    bool open(const char * file);	//!< map the whole file, returns false if it cannot be opened or mapped
+    void close();
+
+    const char * get_data() {
+        return(data);
+    };
+    size_t get_size() {
+        return(size);
+    };
+};
+
+// compressed input files
+
+enum Compression { NO_COMPRESSION, GZIP_COMPRESSION, ZSTD_COMPRESSION };
+
+//! determine the compression of a file from its magic bytes
+Compression detect_compression(const char * file);
+
+//! decompresses a gzip or zstd file on its own thread into a bounded queue of blocks
+class Decompressor {
+
+private:
+
+    static const size_t block_size = 1 << 20;
+    static const size_t max_blocks = 4;
+
+    string file;
+    Compression compression;
+    deque<vector<char> *> blocks;
+    bool started;
+    bool finished;	// the thread has decompressed everything (or failed)
+    bool stopped;	// the reader is not interested in more blocks
+    bool error;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+
+    Decompressor(const Decompressor&);
+    Decompressor& operator=(const Decompressor&);
+
+    static void * run(void * decompressor);
+    bool push_block(vector<char> * block);	// false if the reader has stopped
+    void decompress_gzip();
+    void decompress_zstd();
+    void finish(bool failed);
+
+public:
+
+    Decompressor();
+    ~Decompressor();
+
+    //! start decompressing file, returns false if it cannot be opened
+    bool open(const char * file, Compression compression);
+    //! replace block with the next decompressed block, returns false at the end of the file
+    bool read_block(vector<char> * block);
+    //! true if the file is corrupt or truncated (valid after read_block() returned false)
+    bool failed();
+    void close();
+};
+
+//! streambuf that reads from a Decompressor
+class DecompressorBuf: public streambuf {
+
+private:
+
+    Decompressor decompressor;
+    vector<char> block;
+
+protected:
+
+    int_type underflow();
+
+public:
+
+    bool open(const char * file, Compression compression) {
+        return(decompressor.open(file, compression));
+    };
+    void close() {
+        decompressor.close();
+    };
+    bool failed() {
+        return(decompressor.failed());
+    };
+};
+
+//! input file stream, gzip and zstd compressed files are decompressed transparently
+class InputFile: public istream {
+
+private:
+
+    filebuf file_buf;
+    DecompressorBuf decompressor_buf;
+
+public:
+
+    InputFile(): istream(NULL) {};
+
+    //! exits if file is zstd compressed and zstd support is not compiled in
+    void open(const char * file);
+    void close();
+    //! true if a compressed file is corrupt or truncated (valid at the end of the file)
+    bool failed() {
+        return(decompressor_buf.failed());
+    };
+};
+
+//! hands out a file in buffers of complete lines, the mapped file itself or decompressed blocks for compressed files
+class LineReader {
+
+private:
+
+    MappedFile mapped;
+    Decompressor decompressor;
+    Compression compression;
+    bool at_end;
+    vector<char> buffer;	// decompressed data, [buffer_start, buffer.size()) has not been handed out
+    size_t buffer_start;
+    vector<char> block;
+    size_t bytes;
+
+public:
+
+    LineReader(): compression(NO_COMPRESSION), at_end(false), buffer_start(0), bytes(0) {};
+
+    //! returns false if file cannot be opened, exits if it is zstd compressed and zstd support is not compiled in
+    bool open(const char * file);
+    //! next range of complete lines (a last line without newline included), returns false at the end of the file
+    bool next(const char ** begin, const char ** end);
+    //! true if a compressed file is corrupt or truncated (valid after next() returned false)
+    bool failed();
+    //! (uncompressed) bytes handed out so far
+    size_t get_bytes() {
+        return(bytes);
+    };
+};
+
+// pointer based scanning of (mapped) text buffers, without temporary strings
+
+//! position of the first c in [pos,end), end if there is none
+const char * scan_to(const char * pos, const char * end, char c);
+//! number of lines in [pos,end) (a last line without newline counts)
+size_t count_lines(const char * pos, const char * end);
+//! integer at the start of [pos,end) with the semantics of atoi()
+int scan_int(const char * pos, const char * end);
 #endif
@@ -0,0 +1,212 @@
+/* Copyright (C) 2005  Christoph Helma <helma@in-silico.de>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+
+*/
+
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <stdlib.h>
+
+#include "activity-ranks.h"
+
+using namespace std;
+
+//! KS distance and medians of RegrFeat::determine_significance() before ActivityRanks (merge of the sorted value lists)
+static void old_ks(vector<float> all_activities, vector<float> feat_activities, float * d, float * feat_median, float * all_median) {
+
+    unsigned int j1=0, j2=0;
+    float d1,d2,d_1,d_2,dt1,dt2,en1,en2,fn1=0,fn2=0;
+    d1 = d2 = d_1 = d_2 = 0.0;
+
+    sort(feat_activities.begin(),feat_activities.end());
+    sort(all_activities.begin(), all_activities.end());
+
+    en1 = all_activities.size();
+    en2 = feat_activities.size();
+
+    while (j1 < en1 && j2 < en2) {
+        if ((!isnan(d1=all_activities[j1])) && (!isnan(d2=feat_activities[j2]))) {
+            if (d1 <= d2) {
+                j1++;
+                fn1=j1/en1;
+            }
+            if (d2 <= d1) {
+                j2++;
+                fn2=j2/en2;
+            }
+        }
+        else {
+            if (isnan(d1)) j1++;
+            if (isnan(d2)) j2++;
+            continue;
+        }
+        dt1=fn2-fn1;
+        dt2=fn1-fn2;
+        if (dt1 > d_1) d_1=dt1;
+        if (dt2 > d_2) d_2=dt2;
+    }
+    *d = d_1 + d_2;
+
+    float aasum, aamean, aavar, aadev, aaskew, aakurt;
+    computeStats(all_activities.begin(), all_activities.end(), aasum, *all_median, aamean, aavar, aadev, aaskew, aakurt);
+    float fasum, famean, favar, fadev, faskew, fakurt;
+    computeStats(feat_activities.begin(), feat_activities.end(), fasum, *feat_median, famean, favar, fadev, faskew, fakurt);
+}
+
+//! random training set: compounds with one or two values (or none), few distinct values so that they tie
+static void random_set(int nr_compounds, vector<vector<float> > * values, vector<float> * all) {
+
+    int levels = 1 + rand() % 50;
+
+    values->assign(nr_compounds, vector<float>());
+    all->clear();
+    for (int n = 0; n < nr_compounds; n++) {
+        if (rand() % 5 == 0)
+            continue;
+        (*values)[n].push_back((rand() % levels) * 0.37f - 3);
+        if (rand() % 4 == 0)
+            (*values)[n].push_back((rand() % levels) * 0.37f - 3);
+        all->insert(all->end(), (*values)[n].begin(), (*values)[n].end());
+    }
+}
+
+//! ranks of the values of a training set
+static boost::shared_ptr<ActivityRanks> rank_values(const vector<vector<float> > & values, const vector<float> & all) {
+
+    boost::shared_ptr<ActivityRanks> ranks(new ActivityRanks(all));
+    for (unsigned int n = 0; n < values.size(); n++) {
+        if (values[n].empty())
+            ranks->add_compound(NULL, NULL);
+        else
+            ranks->add_compound(&values[n][0], &values[n][0] + values[n].size());
+    }
+    return(ranks);
+}
+
+//! ActivityRanks::ks() compared with the merge of the sorted value lists on random training sets, and
+//! LooRanks::ks() compared with both for the training sets without a left out compound
+int main(int argc, char *argv[]) {
+
+    int nr_sets = argc > 1 ? atoi(argv[1]) : 1000;
+    int nr_features = 50;
+    int nr_left_out = 20;	// per training set
+    long nr_tests = 0;
+    long nr_diff = 0;
+    long nr_loo_tests = 0;
+    long nr_loo_diff = 0;
+
+    if (nr_sets < 1) {
+        cerr << "usage: " << argv[0] << " [training_sets]\n";
+        return(1);
+    }
+
+    srand(1);
+    for (int set = 0; set < nr_sets; set++) {
+
+        int nr_compounds = 2 + rand() % 400;
+        vector<vector<float> > values;
+        vector<float> all;
+        ActivityRanks::Scratch scratch;
+
+        random_set(nr_compounds, &values, &all);
+        if (all.empty())
+            continue;
+        boost::shared_ptr<ActivityRanks> ranks = rank_values(values, all);
+        LooRanks loo(ranks, nr_features);
+        vector<vector<int> > feat_comps(nr_features);
+
+        for (int f = 0; f < nr_features; f++) {
+            vector<int> & comps = feat_comps[f];
+            vector<float> feat_values;
+            float d = 0, median = 0, old_d, old_median, old_all_median;
+            int nr;
+            bool found;
+
+            for (int n = 0; n < nr_compounds; n++) {
+                if (rand() % (1 + f) == 0) {
+                    comps.push_back(n);
+                    feat_values.insert(feat_values.end(), values[n].begin(), values[n].end());
+                }
+            }
+            found = ranks->ks(comps, &scratch, &d, &nr, &median);
+            nr_tests++;
+            if (feat_values.empty()) {
+                if (found || nr != 0) nr_diff++;
+                continue;
+            }
+            old_ks(all, feat_values, &old_d, &old_median, &old_all_median);
+            if (!found || nr != (int) feat_values.size() || d != old_d || median != old_median || ranks->get_median() != old_all_median) {
+                nr_diff++;
+                if (nr_diff <= 5)
+                    cerr << "set " << set << " feature " << f << ": d " << d << " merge " << old_d << ", median " << median << " merge " << old_median << "\n";
+            }
+            loo.add_feature(f, comps, &scratch, median);
+        }
+
+        // leave out compounds with one value (LOO predictions)
+        for (int k = 0; k < nr_left_out; k++) {
+            int c = rand() % nr_compounds;
+            int g;
+            float all_median;
+            vector<vector<float> > rest_values = values;
+            vector<float> rest;
+            vector<float> loo_values;
+
+            if (values[c].size() != 1 || !loo.left_out(c, &g, &all_median))
+                continue;
+            rest_values[c].clear();
+            for (int n = 0; n < nr_compounds; n++)
+                rest.insert(rest.end(), rest_values[n].begin(), rest_values[n].end());
+            if (rest.empty())
+                continue;
+            boost::shared_ptr<ActivityRanks> rest_ranks = rank_values(rest_values, rest);	// full pass without c
+
+            for (int f = 0; f < nr_features; f++) {
+                vector<int> & comps = feat_comps[f];
+                vector<float> feat_values;
+                float d = 0, median = 0, full_d = 0, full_median = 0, old_d, old_median, old_all_median;
+                int nr, full_nr;
+                bool found, full_found;
+                bool occurs = binary_search(comps.begin(), comps.end(), c);
+
+                for (unsigned int j = 0; j < comps.size(); j++)
+                    feat_values.insert(feat_values.end(), rest_values[comps[j]].begin(), rest_values[comps[j]].end());
+                found = loo.ks(f, g, occurs, &loo_values, &d, &nr, &median);
+                full_found = rest_ranks->ks(comps, &scratch, &full_d, &full_nr, &full_median);
+                nr_loo_tests++;
+                if (found != full_found || nr != full_nr || all_median != rest_ranks->get_median()) {
+                    nr_loo_diff++;
+                    continue;
+                }
+                if (!found)
+                    continue;
+                old_ks(rest, feat_values, &old_d, &old_median, &old_all_median);
+                if (d != full_d || median != full_median || d != old_d || median != old_median || all_median != old_all_median) {
+                    nr_loo_diff++;
+                    if (nr_loo_diff <= 5)
+                        cerr << "set " << set << " feature " << f << " without " << c << ": d " << d << " full " << full_d << " merge " << old_d << ", median " << median << " full " << full_median << " merge " << old_median << "\n";
+                }
+            }
+        }
+    }
+
+    cout << "features: " << nr_tests << ", with a left out compound: " << nr_loo_tests << "\n";
+    cout << "KS tests different from the merge: " << nr_diff << "\n";
+    cout << "LOO KS tests different from a full pass and the merge: " << nr_loo_diff << "\n";
+
+    return(nr_diff > 0 || nr_loo_diff > 0);
+}
@@ -33,6 +33,15 @@ using namespace boost;
 extern float sig_thr;
 extern bool kernel;
 extern bool quantitative;
+extern int nr_threads;
+extern int window_size;
+extern bool prune_neighbors;
+extern int lsh_bands;
+extern int lsh_rows;
+extern int lsh_sample;
+extern unsigned int sim_cache_size;
+extern string sim_matrix;
+extern bool fused_endpoints;
 
 //! lazar predictions
 int main(int argc, char *argv[], char *envp[]) {
@@ -44,6 +53,8 @@ int main(int argc, char *argv[], char *envp[]) {
     bool f_file = false;
     bool a_file = false;
     bool i_file = false;
+    bool b_file = false;
+    bool B_file = false;
     bool loo = false;
     //bool daemon = false;
     char* smi_file = NULL;
@@ -51,6 +62,8 @@ int main(int argc, char *argv[], char *envp[]) {
     char* feature_file = NULL;
     char* alphabet_file = NULL;
     char* input_file = NULL;
+    char* snapshot_file = NULL;
+    char* from_snapshot_file = NULL;
 
     //int port = 0;
     string smiles;
@@ -59,8 +72,24 @@ int main(int argc, char *argv[], char *envp[]) {
     shared_ptr< Predictor<OBLazMol,RegrFeat,float> > train_set_r;
 
 
+    static struct option long_options[] = {
+        {"snapshot", required_argument, NULL, 'b'},
+        {"from-snapshot", required_argument, NULL, 'B'},
+        {"threads", required_argument, NULL, 'j'},
+        {"window", required_argument, NULL, 'w'},
+        {"lazy", required_argument, NULL, 'l'},
+        {"prune", no_argument, NULL, 'P'},
+        {"lsh", required_argument, NULL, 'L'},
+        {"lsh-rows", required_argument, NULL, 'R'},
+        {"lsh-sample", required_argument, NULL, 'S'},
+        {"sim-cache", required_argument, NULL, 'C'},
+        {"sim-matrix", required_argument, NULL, 'M'},
+        {"fused", no_argument, NULL, 'F'},
+        {NULL, 0, NULL, 0}
+    };
+
     // argument parsing
-    while ((c = getopt(argc, argv, "rkxhs:t:f:a:i:p:m:")) != -1) {
+    while ((c = getopt_long(argc, argv, "rkxhPFs:t:f:a:i:p:m:b:B:j:w:l:L:R:S:C:M:", long_options, NULL)) != -1) {
         switch (c) {
         case 's':
             smi_file = optarg;
@@ -82,6 +111,51 @@ int main(int argc, char *argv[], char *envp[]) {
             input_file = optarg;
             i_file = true;
             break;
+        case 'b':
+            snapshot_file = optarg;
+            b_file = true;
+            break;
+        case 'B':
+            from_snapshot_file = optarg;
+            B_file = true;
+            break;
+        case 'j':
+            nr_threads = atoi(optarg);
+            if (nr_threads < 1) status = 1;
+            break;
+        case 'w':
+            window_size = atoi(optarg);
+            if (window_size < 1) status = 1;
+            break;
+        case 'l':
+            if (atoi(optarg) < 1) status = 1;
+            else mol_cache.set_capacity(atoi(optarg));
+            break;
+        case 'P':
+            prune_neighbors = true;
+            break;
+        case 'L':
+            lsh_bands = atoi(optarg);
+            if (lsh_bands < 1) status = 1;
+            break;
+        case 'R':
+            lsh_rows = atoi(optarg);
+            if (lsh_rows < 1) status = 1;
+            break;
+        case 'S':
+            lsh_sample = atoi(optarg);
+            if (lsh_sample < 0) status = 1;
+            break;
+        case 'C':
+            if (atoi(optarg) < 1) status = 1;
+            else sim_cache_size = atoi(optarg);
+            break;
+        case 'M':
+            sim_matrix = optarg;
+            break;
+        case 'F':
+            fused_endpoints = true;
+            break;
         case 'h':
             status = 1;
             break;
@@ -107,21 +181,32 @@ int main(int argc, char *argv[], char *envp[]) {
         }
     }
 
-    // structures, activities and features are always required
-    if (!s_file | !t_file | !f_file)
+    // structures, activities and features are always required (unless they are read from a snapshot)
+    if (!B_file && (!s_file | !t_file | !f_file))
+        status = 1;
+
+    // writing a snapshot requires the text files
+    if (b_file && B_file)
         status = 1;
 
-    // no alphabet required for LOO
-    if (!loo & !a_file)
+    // no alphabet required for LOO and snapshots
+    if (!loo & !b_file & !a_file)
         status = 1;
 
     // print usage and examples for incorrect input
     if (status)  {
-        cerr << "usage: " << argv[0] << " -s smiles_structures -t training_set -f feature_set [-r [-m significance_threshold]] [-k] [-a alphabet_file [\"smiles_string\"|-i test_set_file|-p port]|-x]\n";
+        cerr << "usage: " << argv[0] << " {-s smiles_structures -t training_set -f feature_set|-B snapshot_file} [-r [-m significance_threshold]] [-k] [-j threads] [-l cache_size] [--prune|--lsh bands [--lsh-rows rows] [--lsh-sample n]] [--sim-cache pairs] [--sim-matrix file_prefix] [--fused] [-a alphabet_file [\"smiles_string\"|-i test_set_file [-w window_size]|-p port]|-x]\n";
+        cerr << "       " << argv[0] << " -s smiles_structures -t training_set -f feature_set [-r] -b snapshot_file\n";
         cerr << "\nexamples:\n";
         cerr << "\t# leave-one-out crossvalidation\n\t" << argv[0] <<  " -s smiles_structures -t training_set -f feature_set -x [-r] [-k]\n";
         cerr << "\t# predict smiles_string\n\t" << argv[0] <<  " -s smiles_structures -t training_set -f feature_set -a alphabet_file \"smiles_string\" [-r] [-k]\n";
         cerr << "\t# predict test_set_file\n\t" << argv[0] <<  " -s smiles_structures -t training_set -f feature_set -a alphabet_file -i test_set_file [-r] [-k]\n";
+        cerr << "\t# predict large test_set_file, reading window_size structures at a time\n\t" << argv[0] <<  " -s smiles_structures -t training_set -f feature_set -a alphabet_file -i test_set_file -w window_size [-r] [-k]\n";
+        cerr << "\t# approximate neighbors from an LSH index (bands * rows MinHashes, more bands: better recall, more rows: fewer candidates), recall measured on every n-th prediction\n\t" << argv[0] <<  " -s smiles_structures -t training_set -f feature_set -a alphabet_file -i test_set_file --lsh 20 --lsh-rows 4 --lsh-sample 10 [-r] [-k]\n";
+        cerr << "\t# training sets with many endpoints: similarities for all endpoints in one pass over the training set\n\t" << argv[0] <<  " -s smiles_structures -t training_set -f feature_set -a alphabet_file -i test_set_file --fused [-r] [-k]\n";
+        cerr << "\t# kernel models: keep up to n similarities of training compound pairs per endpoint, precompute all pairs in file_prefix.<slot> (up to 50000 compounds)\n\t" << argv[0] <<  " -s smiles_structures -t training_set -f feature_set -a alphabet_file -i test_set_file -k --sim-cache 1000000 --sim-matrix file_prefix [-r]\n";
+        cerr << "\t# save training set as binary snapshot\n\t" << argv[0] <<  " -s smiles_structures -t training_set -f feature_set --snapshot snapshot_file [-r]\n";
+        cerr << "\t# predict test_set_file from a snapshot (replaces -s, -t and -f in all modes)\n\t" << argv[0] <<  " --from-snapshot snapshot_file -a alphabet_file -i test_set_file [-r] [-k]\n";
         return(status);
     }
 
@@ -129,6 +214,19 @@ int main(int argc, char *argv[], char *envp[]) {
     shared_ptr<Out> out(new ConsoleOut());         // write to STDOUT/STDERR
 
     obErrorLog.StopLogging();
+
+    // write snapshot (no R needed)
+    if (b_file) {
+        if (!quantitative) {
+            train_set_c.reset( new Predictor<OBLazMol,ClassFeat,bool>(smi_file, train_file, feature_file, out) );
+            train_set_c->write_snapshot(snapshot_file);
+        }
+        else {
+            train_set_r.reset( new Predictor<OBLazMol,RegrFeat,float>(smi_file, train_file, feature_file, out) );
+            train_set_r->write_snapshot(snapshot_file);
+        }
+        return(0);
+    }
    
     // initialize R
     cerr << "Initializing R environment...";
@@ -153,11 +251,13 @@ int main(int argc, char *argv[], char *envp[]) {
         if (loo) {            // LOO crossvalidation
             out->print();
             if (!quantitative) {
-                train_set_c.reset( new Predictor<OBLazMol,ClassFeat,bool>(smi_file, train_file, feature_file, out) );
+                if (B_file) train_set_c.reset( new Predictor<OBLazMol,ClassFeat,bool>(from_snapshot_file, out) );
+                else train_set_c.reset( new Predictor<OBLazMol,ClassFeat,bool>(smi_file, train_file, feature_file, out) );
                 train_set_c->loo_predict();
             }
             else {
-                train_set_r.reset( new Predictor<OBLazMol,RegrFeat,float>(smi_file, train_file, feature_file, out) );
+                if (B_file) train_set_r.reset( new Predictor<OBLazMol,RegrFeat,float>(from_snapshot_file, out) );
+                else train_set_r.reset( new Predictor<OBLazMol,RegrFeat,float>(smi_file, train_file, feature_file, out) );
                 train_set_r->loo_predict();
             }
             out->print();
@@ -171,11 +271,13 @@ int main(int argc, char *argv[], char *envp[]) {
                 optind++;
                 out->print();
                 if (!quantitative) {
-                    train_set_c.reset ( new Predictor<OBLazMol,ClassFeat,bool>(smi_file, train_file, feature_file, alphabet_file,out) );
+                    if (B_file) train_set_c.reset ( new Predictor<OBLazMol,ClassFeat,bool>(from_snapshot_file, alphabet_file, out) );
+                    else train_set_c.reset ( new Predictor<OBLazMol,ClassFeat,bool>(smi_file, train_file, feature_file, alphabet_file,out) );
                     train_set_c->predict_smi(smiles); // AM: start SMILES -> predictor.h
                 }
                 else {
-                    train_set_r.reset ( new Predictor<OBLazMol,RegrFeat,float>(smi_file, train_file, feature_file, alphabet_file,out) );
+                    if (B_file) train_set_r.reset ( new Predictor<OBLazMol,RegrFeat,float>(from_snapshot_file, alphabet_file, out) );
+                    else train_set_r.reset ( new Predictor<OBLazMol,RegrFeat,float>(smi_file, train_file, feature_file, alphabet_file,out) );
                     train_set_r->predict_smi(smiles); // AM: start SMILES -> predictor.h
                 }
             }
@@ -183,11 +285,19 @@ int main(int argc, char *argv[], char *envp[]) {
             else {            // read input file batch predictions
                 out->print();
                 if (!quantitative) {
-                    train_set_c.reset( new Predictor<OBLazMol,ClassFeat,bool>(smi_file, train_file, feature_file, alphabet_file, input_file, out) );
+                    if (B_file) {
+                        train_set_c.reset( new Predictor<OBLazMol,ClassFeat,bool>(from_snapshot_file, alphabet_file, out) );
+                        train_set_c->read_test_structures(input_file);
+                    }
+                    else train_set_c.reset( new Predictor<OBLazMol,ClassFeat,bool>(smi_file, train_file, feature_file, alphabet_file, input_file, out) );
                     train_set_c->predict_fold(); // AM: start SMILES -> predictor.h
                 }
                 else {
-                    train_set_r.reset ( new Predictor<OBLazMol,RegrFeat,float>(smi_file, train_file, feature_file, alphabet_file, input_file, out) );
+                    if (B_file) {
+                        train_set_r.reset( new Predictor<OBLazMol,RegrFeat,float>(from_snapshot_file, alphabet_file, out) );
+                        train_set_r->read_test_structures(input_file);
+                    }
+                    else train_set_r.reset ( new Predictor<OBLazMol,RegrFeat,float>(smi_file, train_file, feature_file, alphabet_file, input_file, out) );
                     train_set_r->predict_fold(); // AM: start SMILES -> predictor.h
                 }
                 out->print();
@@ -195,5 +305,23 @@ int main(int argc, char *argv[], char *envp[]) {
         }
     //}
 
+    if (train_set_c)
+        cerr << "Feature weights filled in " << train_set_c->get_weight_secs() << " sec" << endl;
+    if (train_set_r)
+        cerr << "Feature weights filled in " << train_set_r->get_weight_secs() << " sec" << endl;
+
+    if (train_set_c && train_set_c->get_nr_lsh_samples())
+        cerr << "LSH recall " << train_set_c->get_lsh_recall() << " (" << train_set_c->get_nr_lsh_samples() << " sampled predictions)" << endl;
+    if (train_set_r && train_set_r->get_nr_lsh_samples())
+        cerr << "LSH recall " << train_set_r->get_lsh_recall() << " (" << train_set_r->get_nr_lsh_samples() << " sampled predictions)" << endl;
+
+    if (train_set_c && sim_cache_size)
+        cerr << "Similarity cache: " << train_set_c->get_sim_cache_hits() << " hits, " << train_set_c->get_sim_cache_misses() << " misses" << endl;
+    if (train_set_r && sim_cache_size)
+        cerr << "Similarity cache: " << train_set_r->get_sim_cache_hits() << " hits, " << train_set_r->get_sim_cache_misses() << " misses" << endl;
+
+    if (mol_cache.is_enabled())
+        cerr << "OBMol cache: " << mol_cache.get_hits() << " hits, " << mol_cache.get_misses() << " misses" << endl;
+
     return (0);
 }
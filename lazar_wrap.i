@@ -17,6 +17,15 @@ using namespace std;
 extern float sig_thr;
 extern bool kernel;
 extern bool quantitative;
+extern int nr_threads;
+extern int window_size;
+extern bool prune_neighbors;
+extern int lsh_bands;
+extern int lsh_rows;
+extern int lsh_sample;
+extern unsigned int sim_cache_size;
+extern string sim_matrix;
+extern bool fused_endpoints;
 # "END GLOBAL VARIABLES"
 
 
@@ -53,6 +62,30 @@ class Predictor {
         Predictor(char* structure_file, char* act_file, char* feat_file, char* alphabet_file, shared_ptr<Out> out);
         # "Predictor constructor for batch prediction"
         Predictor(char* structure_file, char* act_file, char* feat_file, char* alphabet_file, char* input_file, shared_ptr<Out> out);
+        # "Predictor constructor for LOO from a training set snapshot"
+        Predictor(char* snapshot_file, shared_ptr<Out> out);
+        # "Predictor constructor for single SMILES and batch prediction from a training set snapshot"
+        Predictor(char* snapshot_file, char* alphabet_file, shared_ptr<Out> out);
+        # "save the training set as snapshot"
+        void write_snapshot(char* snapshot_file);
+        # "append structures, features and activities to the training set"
+        void append(char* structure_file, char* act_file, char* feat_file);
+        # "append a single structure to the training set"
+        bool add_compound(string id, string smiles);
+        # "add a match of a feature to a training compound"
+        bool add_feature_match(string name, string id);
+        # "add an activity value to a training compound"
+        bool add_activity(string id, string act, ActivityType value);
+        # "time spent to precompute similarity weights"
+        float get_weight_secs();
+        # "mean recall of the approximate (LSH) neighbors on the sampled predictions"
+        double get_lsh_recall();
+        int get_nr_lsh_samples();
+        # "lookups of training compound pairs answered by the similarity cache"
+        unsigned long get_sim_cache_hits();
+        unsigned long get_sim_cache_misses();
+        # "read test structures for batch predictions"
+        void read_test_structures(char* input_file);
         # "predict a single smiles"
         void predict_smi(string smiles);
         # "batch prediction: predict witheld fold, i.e. compounds must occur in smi database, do make testset to generate fold tool."
@@ -71,6 +104,17 @@ class Predictor {
 %template(ClassificationPredictor) Predictor<OBLazMol, ClassFeat, bool>;
 %template(RegressionPredictor) Predictor<OBLazMol, RegrFeat, float>;
 
+# "LRU cache for the OBMols of lazy molecules"
+class MolCache {
+    public:
+        void set_capacity(unsigned int new_capacity);
+        bool is_enabled();
+        unsigned long get_hits();
+        unsigned long get_misses();
+        unsigned int get_size();
+};
+extern MolCache mol_cache;
+
 class StringOut {
     public:
         string get_yaml();
@@ -64,6 +64,72 @@ void LazMol::set_output(shared_ptr<Out> newout) {
     out = newout;
 };
 
+// MolCache
+
+MolCache mol_cache;
+
+MolCache::MolCache(): capacity(0), hits(0), misses(0) {
+    pthread_mutex_init(&lock, NULL);
+};
+
+MolCache::~MolCache() {
+    pthread_mutex_destroy(&lock);
+};
+
+void MolCache::set_capacity(unsigned int new_capacity) {
+
+    pthread_mutex_lock(&lock);
+    capacity = new_capacity;
+    while (lru.size() > capacity) {
+        index.erase(lru.back().first);
+        lru.pop_back();
+    }
+    pthread_mutex_unlock(&lock);
+};
+
+shared_ptr<OBMol> MolCache::get(const OBLazMol * mol) {
+
+    shared_ptr<OBMol> obmol;
+
+    pthread_mutex_lock(&lock);
+    unordered_map<const OBLazMol *, LRUList::iterator>::iterator found = index.find(mol);
+    if (found != index.end()) {
+        lru.splice(lru.begin(), lru, found->second);	// move to front
+        obmol = found->second->second;
+        hits++;
+    }
+    else
+        misses++;
+    pthread_mutex_unlock(&lock);
+
+    return(obmol);
+};
+
+void MolCache::put(const OBLazMol * mol, shared_ptr<OBMol> obmol) {
+
+    pthread_mutex_lock(&lock);
+    if (capacity > 0 && index.find(mol) == index.end()) {
+        if (lru.size() >= capacity) {
+            index.erase(lru.back().first);
+            lru.pop_back();
+        }
+        lru.push_front(make_pair(mol, obmol));
+        index[mol] = lru.begin();
+    }
+    pthread_mutex_unlock(&lock);
+};
+
+void MolCache::erase(const OBLazMol * mol) {
+
+    pthread_mutex_lock(&lock);
+    unordered_map<const OBLazMol *, LRUList::iterator>::iterator found = index.find(mol);
+    if (found != index.end()) {
+        lru.erase(found->second);
+        index.erase(found);
+    }
+    pthread_mutex_unlock(&lock);
+};
+
 // OBLazMol
 
 OBLazMol::OBLazMol(int nr, string new_descr, string new_smiles, shared_ptr<Out> out):
@@ -71,11 +137,97 @@ OBLazMol::OBLazMol(int nr, string new_descr, string new_smiles, shared_ptr<Out>
         LazMol(nr,new_descr,new_smiles,out), out(out) {
 
 //		static OBMol mol;
-    string tmp_inchi;
     OBConversion conv(&cin,&cout);
     conv.SetInAndOutFormats("SMI","INCHI");
-    if (!conv.ReadString(&mol,new_smiles)) {
-        *out << "\nError reading molecule nr. " << nr <<  endl;
+    this->read_smiles(&conv);
+};
+
+OBLazMol::OBLazMol(int nr, string new_descr, string new_smiles, OBConversion * conv, shared_ptr<Out> out):
+
+        LazMol(nr,new_descr,new_smiles,out), out(out) {
+
+    this->read_smiles(conv);
+};
+
+OBLazMol::OBLazMol(int nr, string new_descr, string new_smiles, string new_inchi, shared_ptr<Out> out):
+
+        LazMol(nr,new_descr,new_smiles,out), out(out) {
+
+    this->set_inchi(new_inchi);
+};
+
+OBLazMol::~OBLazMol() {
+    if (mol_cache.is_enabled())
+        mol_cache.erase(this);
+};
+
+// Global state of OpenBabel that concurrent OBConversions share:
+// - format plugins are loaded and looked up on first use
+// - the element, isotope and type tables and the atom and aromaticity typers initialize themselves on first use
+// - 2.x perceives implicit valences while it reads SMILES (OBMol::AssignSpinMultiplicity()) with the global
+//   typers, whose shared OBSmartsPatterns keep the match list of their last call; 3.x stores implicit hydrogens
+//   and reads SMILES without the typers
+// - the InChI format is one plugin object per process and libinchi is not reentrant
+// - the message log (obErrorLog) is one list
+// init_openbabel() does the first uses in the calling thread. Afterwards only the InChI output is serialized
+// with HAVE_OPENBABEL3, with 2.x the SMILES parsing is serialized, too. The list follows the OpenBabel 2.3
+// and 3.1 code, no version has been checked with a thread sanitizer.
+static pthread_mutex_t ob_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void lock_parse() {
+#ifndef HAVE_OPENBABEL3
+    pthread_mutex_lock(&ob_lock);
+#endif
+};
+
+static void unlock_parse() {
+#ifndef HAVE_OPENBABEL3
+    pthread_mutex_unlock(&ob_lock);
+#endif
+};
+
+static void lock_inchi() {
+#ifdef HAVE_OPENBABEL3
+    pthread_mutex_lock(&ob_lock);
+#endif
+};
+
+static void unlock_inchi() {
+#ifdef HAVE_OPENBABEL3
+    pthread_mutex_unlock(&ob_lock);
+#endif
+};
+
+void OBLazMol::init_openbabel() {
+
+    static bool done = false;
+    OBConversion conv(&cin,&cout);
+    OBMol new_mol;
+
+    if (done)
+        return;
+    done = true;
+
+    obErrorLog.StopLogging();
+    conv.SetInAndOutFormats("SMI","INCHI");
+    conv.SetOptions("w",OBConversion::OUTOPTIONS);
+    // one conversion with aromatic rings, charges and stereo initializes the tables and typers
+    if (conv.ReadString(&new_mol, "C[C@@H](N)C(=O)Oc1ccccc1[N+](=O)[O-]"))
+        conv.WriteString(&new_mol);
+};
+
+void OBLazMol::read_smiles(OBConversion * conv) {
+
+    lock_parse();
+
+    shared_ptr<OBMol> new_mol(new OBMol());
+
+    // lazy molecules keep only SMILES and InChI
+    if (!mol_cache.is_enabled())
+        mol = new_mol;
+
+    if (!conv->ReadString(new_mol.get(),this->get_smiles())) {
+        *out << "\nError reading molecule nr. " << this->get_line_nr() <<  endl;
         out->print_err();
     }
     else {
@@ -86,8 +238,10 @@ OBLazMol::OBLazMol(int nr, string new_descr, string new_smiles, shared_ptr<Out>
 //        atom->UnsetAromatic(); 
 
         // don't warn about undefined stereo
-        conv.SetOptions("w",OBConversion::OUTOPTIONS);
-        string inchi = conv.WriteString(&mol);
+        conv->SetOptions("w",OBConversion::OUTOPTIONS);
+        lock_inchi();
+        string inchi = conv->WriteString(new_mol.get());
+        unlock_inchi();
         // remove newline
         string::size_type pos = inchi.find_last_not_of("\n");
         if (pos != string::npos) {
@@ -96,18 +250,55 @@ OBLazMol::OBLazMol(int nr, string new_descr, string new_smiles, shared_ptr<Out>
         this->set_inchi(inchi);
 //			cerr << new_smiles << "\t" << inchi << endl;
     }
+
+    new_mol.reset();	// the OBMol of lazy molecules is deleted under the lock, too
+    unlock_parse();
+};
+
+shared_ptr<OBMol> OBLazMol::parse() {
+
+    shared_ptr<OBMol> new_mol(new OBMol());
+    OBConversion conv(&cin,&cout);
+    conv.SetInAndOutFormats("SMI","INCHI");
+    if (!conv.ReadString(new_mol.get(),this->get_smiles())) {
+        *out << "\nError reading molecule nr. " << this->get_line_nr() <<  endl;
+        out->print_err();
+    }
+    return(new_mol);
+};
+
+shared_ptr<OBMol> OBLazMol::get_mol() {
+
+    shared_ptr<OBMol> cached;
+
+    if (mol)
+        return(mol);
+
+    if (!mol_cache.is_enabled()) {	// parse once and keep the molecule
+        mol = this->parse();
+        return(mol);
+    }
+
+    cached = mol_cache.get(this);
+    if (!cached) {
+        cached = this->parse();
+        mol_cache.put(this, cached);
+    }
+    return(cached);
 };
 
 OBMol * OBLazMol::get_mol_ref() {
-    return(&mol);
+    return(this->get_mol().get());
 };
 
 bool OBLazMol::match(OBSmartsPattern * smarts_pattern) {
-    return (smarts_pattern->Match(mol,true));
+    shared_ptr<OBMol> obmol = this->get_mol();
+    return (smarts_pattern->Match(*obmol,true));
 };
 
 int OBLazMol::match_freq(OBSmartsPattern * smarts_pattern) {
-    smarts_pattern->Match(mol,false);
+    shared_ptr<OBMol> obmol = this->get_mol();
+    smarts_pattern->Match(*obmol,false);
     vector<vector<int> > maplist;
     maplist = smarts_pattern->GetUMapList();
     return (maplist.size());
@@ -119,6 +310,8 @@ vector<string> OBLazMol::sssr() {
     OBElementTable element_table;
 
     // identify the smallest set of smallest rings //
+    shared_ptr<OBMol> obmol = this->get_mol();
+    OBMol & mol = *obmol;
     vector<OBRing*> ringsystems = mol.GetSSSR();
 
     vector<OBRing*>::iterator cur_ring;
@@ -35,12 +35,16 @@
 #include <gsl/gsl_multifit.h>
 #include <list>
 #include <time.h>
+#include <pthread.h>
 
+#include "boost/unordered_map.hpp"
 #include "openbabel/obconversion.h"
 #include "feature.h"
 #include "io.h"
 #include "rutils.h"
 #include "stats.h"
+#include "activity-store.h"
+#include "similarity-cache.h"
 
 using namespace std;
 using namespace OpenBabel;
@@ -76,24 +80,86 @@ public:
 
 };
 
+class OBLazMol;
+
+//! size bounded LRU cache for the OBMol objects of lazy OBLazMols
+class MolCache {
+
+private:
+
+    typedef list<pair<const OBLazMol *, shared_ptr<OBMol> > > LRUList;
+
+    unsigned int capacity;	// 0: lazy molecules disabled
+    LRUList lru;	// most recently used first
+    unordered_map<const OBLazMol *, LRUList::iterator> index;
+    unsigned long hits;
+    unsigned long misses;
+    pthread_mutex_t lock;
+
+public:
+
+    MolCache();
+    ~MolCache();
+
+    //! keep at most capacity OBMols, OBLazMols created afterwards keep only SMILES and InChI (0 disables lazy molecules)
+    void set_capacity(unsigned int new_capacity);
+
+    bool is_enabled() {
+        return(capacity > 0);
+    };
+
+    //! cached OBMol of mol (or an empty pointer) and update the counters
+    shared_ptr<OBMol> get(const OBLazMol * mol);
+    //! add the OBMol of mol and evict the least recently used one if the cache is full
+    void put(const OBLazMol * mol, shared_ptr<OBMol> obmol);
+    //! forget mol (when it is destroyed)
+    void erase(const OBLazMol * mol);
+
+    unsigned long get_hits() {
+        return(hits);
+    };
+    unsigned long get_misses() {
+        return(misses);
+    };
+    unsigned int get_size() {
+        return(lru.size());
+    };
+
+};
+
+//! OBMol cache for lazy molecules
+extern MolCache mol_cache;
+
 //! molecule class with an OBMol object for pattern matching
 class OBLazMol: public LazMol {
 
 private:
 
-    OBMol mol;	// OBMol object
+    shared_ptr<OBMol> mol;	// OBMol object, empty for lazy molecules and molecules from snapshots
     shared_ptr<Out> out;
 
+    shared_ptr<OBMol> parse();	// read the SMILES string into a new OBMol
+    shared_ptr<OBMol> get_mol();	// OBMol from the object, the cache or the SMILES string
+    void read_smiles(OBConversion * conv);	// read the SMILES string and determine the InChI (partly serialized, see lazmol.cpp)
+
 public:
 
     OBLazMol(int nr, string id, string new_smiles, shared_ptr<Out> out);
+    //! use conv (with SMI/INCHI formats set) instead of a new OBConversion, e.g. one per loader thread
+    OBLazMol(int nr, string id, string new_smiles, OBConversion * conv, shared_ptr<Out> out);
+    //! initialize the global state of OpenBabel in the calling thread, before threads construct molecules (stops obErrorLog)
+    static void init_openbabel();
+    //! use a known InChI and defer SMILES parsing until the OBMol is needed (e.g. for snapshots)
+    OBLazMol(int nr, string id, string new_smiles, string new_inchi, shared_ptr<Out> out);
+    ~OBLazMol();
 
     bool match(OBSmartsPattern * smarts_pattern);	//!< match a OBSmartsPattern
     int match_freq(OBSmartsPattern * smarts_pattern);	//!< match a OBSmartsPattern and return the number of matches
-    OBMol * get_mol_ref();	//!< return the reference to the corresponding OBMol object
+    OBMol * get_mol_ref();	//!< return the reference to the corresponding OBMol object (for lazy molecules valid until mol_cache evicts it)
     vector<string> sssr();	//!< identify the smallest set of smallest rings
     void set_output(shared_ptr<Out> newout) {
         out = newout;
+        LazMol::set_output(newout);
     };
 
 };
@@ -114,10 +180,11 @@ class FeatMol: public MolType {
 private:
 
     FeatVect features;
-    FeatVect pred_features;
-    FeatVect common_feat;
-    FeatVect sig_pred;
-    FeatVect sig_common;
+
+    //! ids of features (sorted) and the features in the same order, for merging feature sets without allocations
+    //! (the same features as in features, add_feature() skips a feature id that is already present in both)
+    vector<int> feature_ids;
+    FeatVect id_features;
 
     vector<string> unknown_features;
 
@@ -126,6 +193,13 @@ private:
     map<string, bool > available;
     map<string, bool > available_bak;
 
+    //! activities of training set compounds are kept in the store of their MolVect (the maps above are unused then)
+    ActivityStore<ActivityType> * act_store;
+    int store_nr;
+
+    //! similarities with the other training compounds of the MolVect (keyed by store_nr)
+    SimilarityCache * sim_cache;
+
     //! tanimoto distance
     float similarity;
 
@@ -135,9 +209,11 @@ private:
 
 public:
 
-    FeatMol(int nr): MolType(nr), similarity(0) {};
-    FeatMol(int i, string id, string smi): MolType(i, id, smi), similarity(0) {};
-    FeatMol(int i, string id, string smi, shared_ptr<Out> out): MolType(i, id, smi, out), similarity(0), out(out) {};
+    FeatMol(int nr): MolType(nr), act_store(NULL), store_nr(-1), sim_cache(NULL), similarity(0) {};
+    FeatMol(int i, string id, string smi): MolType(i, id, smi), act_store(NULL), store_nr(-1), sim_cache(NULL), similarity(0) {};
+    FeatMol(int i, string id, string smi, shared_ptr<Out> out): MolType(i, id, smi, out), act_store(NULL), store_nr(-1), sim_cache(NULL), similarity(0), out(out) {};
+    FeatMol(int i, string id, string smi, string inchi, shared_ptr<Out> out): MolType(i, id, smi, inchi, out), act_store(NULL), store_nr(-1), sim_cache(NULL), similarity(0), out(out) {};
+    FeatMol(int i, string id, string smi, OBConversion * conv, shared_ptr<Out> out): MolType(i, id, smi, conv, out), act_store(NULL), store_nr(-1), sim_cache(NULL), similarity(0), out(out) {};
 
     bool find_f_in_n(RegrFeat* f, shared_ptr<FeatMol<MolType,RegrFeat,float> > n);
 
@@ -164,8 +240,6 @@ public:
 
     void unite_features(vector<Feature<FeatureType> *>* lr_features, sRegrMolVect * neighbors);
 
-    void extract_neighbors(sRegrMolVect* np, multimap<float,sMolRef>* sim_sorted_neighbors);
-
     void set_y(shared_ptr<FeatMol<MolType,RegrFeat,float> > cur_n, gsl_vector* y, string act, int rc); //!< Prepare regression: set neighbor activities and weights
 
     void set_y_w(shared_ptr<FeatMol<MolType,RegrFeat,float> > cur_n, gsl_vector* y, gsl_vector* w, string act, int rc); //!< Prepare regression: set neighbor activities and weights
@@ -177,9 +251,21 @@ public:
 //		void calculate_prediction(RegrMolVect * neighbors, string act); //!< Calculate prediction using the set of neighbors
 
     bool is_available(string act) {
+        if (act_store) return(act_store->is_available(act_store->get_id(act), store_nr));
         return(available[act]);
     };
 
+    //! keep activities in store as compound nr
+    void attach_activities(ActivityStore<ActivityType> * store, int nr) {
+        act_store = store;
+        store_nr = nr;
+    };
+
+    //! look up similarities with other training compounds in cache
+    void attach_similarities(SimilarityCache * cache) {
+        sim_cache = cache;
+    };
+
     bool db_act_available(string act) {
         if (db_activities.size() > 0)
             return(true);
@@ -194,9 +280,7 @@ public:
         db_activities.clear();
     };
 
-    map<string, vector<ActivityType> > get_activities() {
-        return activities;
-    };
+    map<string, vector<ActivityType> > get_activities();
     map<string, vector<ActivityType> > get_db_activities() {
         return db_activities;
     };
@@ -210,7 +294,8 @@ public:
     void set_available(map<string, bool> new_avail);
 
     void clear_act() {
-        activities.clear();
+        if (act_store) act_store->clear_values(store_nr);
+        else activities.clear();
     }
 
     void print_neighbor(string act);
@@ -229,50 +314,60 @@ public:
         return(features);
     };
 
-    void set_features(FeatVect f) {
-	    features=f;
-    };
+    void set_features(FeatVect f);
 
     void print_features(string act);
 
     void add_feature(Feature<FeatureType> * feat);
 
-    void clear_features() {
-        features.clear();
+    //! features sorted by id
+    FeatVect * get_sorted_features() {
+        return(&id_features);
     };
 
-    void common_features(sMolRef test);
+    //! ids of get_sorted_features()
+    vector<int> * get_feature_ids() {
+        return(&feature_ids);
+    };
 
-    FeatVect get_common_features() {
-        return(common_feat);
+    void clear_features() {
+        features.clear();
+        feature_ids.clear();
+        id_features.clear();
     };
 
-    void common_features(sMolRef m1, sMolRef m2, FeatVect* inter, FeatVect* uni);
+    //! weighted Tanimoto index of the feature sets of m1 and m2
+    float weighted_tanimoto(MolRef m1, MolRef m2, string act);
 
-    void relevant_features(sMolRef test, string act);
+    //! weighted_tanimoto() of two training compounds, cached if both share a similarity cache
+    float pair_similarity(MolRef m1, MolRef m2, string act);
 
     //! Determine similarity of two compounds as weighted Tanimoto index
     float get_similarity(sMolRef m2, string act, sMolRef m1);
 
-    vector<ActivityType> get_act(string act) {
-        return(activities[act]);
-    }
+    vector<ActivityType> get_act(string act);
 
     //! needs inchi strings
     bool equal(const sMolRef mol);
 
     float get_similarity();
 
+    void set_similarity(float sim) {
+        similarity = sim;
+    };
+
     void remove();
 
     void set_na(string act) {
-        available[act] = false;
+        if (act_store) act_store->set_available(act_store->intern(act), store_nr, false);
+        else available[act] = false;
     }
 
     void set_activity(string name, ActivityType act);
 
     void restore() {
-        available = available_bak;
+        if (act_store) act_store->restore(store_nr);
+        else available = available_bak;
     }
 
     bool matches(Feature<FeatureType> * feat_ptr);
@@ -287,6 +382,7 @@ public:
 
     void set_output(shared_ptr<Out> newout) {
         out = newout;
+        MolType::set_output(newout);
     }
 
 };
@@ -713,21 +809,6 @@ void FeatMol<MolType,FeatureType,ActivityType>::unite_features(vector<Feature<Fe
     (*lr_features) = tmp_features;
 }
 
-template <typename MolType, typename FeatureType, typename ActivityType>
-void FeatMol<MolType,FeatureType,ActivityType>::extract_neighbors(sRegrMolVect* np, multimap<float,sMolRef>* sim_sorted_neighbors) {
-
-    typename multimap<float,sMolRef>::iterator cur_sn;
-
-    np->clear();
-    cur_sn = sim_sorted_neighbors->end();
-    if (cur_sn != sim_sorted_neighbors->begin()) {
-        do {
-            cur_sn--;
-            np->push_back(cur_sn->second);
-        } while (cur_sn != sim_sorted_neighbors->begin());
-    }
-}
-
 
 template <typename MolType, typename FeatureType, typename ActivityType>
 void FeatMol<MolType,FeatureType,ActivityType>::set_y(shared_ptr<FeatMol<MolType,RegrFeat,float> > cur_n, gsl_vector* y, string act, int rc) {
@@ -822,8 +903,8 @@ void FeatMol<MolType,FeatureType,ActivityType>::print_db_activity(string act, bo
 
 
     if (loo) {
-        if (available_bak[act]) {
-            vector<ActivityType> vals = activities[act];
+        if (act_store ? act_store->was_available(act_store->get_id(act), store_nr) : available_bak[act]) {
+            vector<ActivityType> vals = this->get_act(act);
             typename vector<ActivityType>::iterator cur_v;
             *out << "db_activity: [";
             for (cur_v = vals.begin(); cur_v != vals.end(); cur_v++) {
@@ -855,7 +936,41 @@ void FeatMol<MolType,FeatureType,ActivityType>::print_db_activity(string act, bo
 
 template <typename MolType, typename FeatureType, typename ActivityType>
 void FeatMol<MolType,FeatureType,ActivityType>::copy_activities(sMolRef test_mol) {
-    test_mol->set_db_activities(activities);
+    test_mol->set_db_activities(this->get_activities());
+};
+
+template <typename MolType, typename FeatureType, typename ActivityType>
+map<string, vector<ActivityType> > FeatMol<MolType,FeatureType,ActivityType>::get_activities() {
+
+    if (!act_store)
+        return(activities);
+
+    map<string, vector<ActivityType> > acts;
+    const typename ActivityStore<ActivityType>::Value * begin;
+    const typename ActivityStore<ActivityType>::Value * end;
+
+    for (int ep = 0; ep < act_store->get_nr_endpoints(); ep++) {
+        act_store->get_values(ep, store_nr, &begin, &end);
+        if (begin != end)
+            acts[act_store->get_name(ep)].assign(begin, end);
+    }
+    return(acts);
+};
+
+template <typename MolType, typename FeatureType, typename ActivityType>
+vector<ActivityType> FeatMol<MolType,FeatureType,ActivityType>::get_act(string act) {
+
+    if (!act_store)
+        return(activities[act]);
+
+    const typename ActivityStore<ActivityType>::Value * begin;
+    const typename ActivityStore<ActivityType>::Value * end;
+    int ep = act_store->get_id(act);
+
+    if (ep < 0)
+        return(vector<ActivityType>());
+    act_store->get_values(ep, store_nr, &begin, &end);
+    return(vector<ActivityType>(begin, end));
 };
 
 template <typename MolType, typename FeatureType, typename ActivityType>
@@ -887,6 +1002,16 @@ template <typename MolType, typename FeatureType, typename ActivityType>
 void FeatMol<MolType,FeatureType,ActivityType>::replace_activities(map<string, vector<ActivityType> > new_act) {
     typename map<string, vector<ActivityType> >::iterator cur_map;
     typename vector<ActivityType>::iterator cur_act;
+    if (act_store) {
+        act_store->clear_values(store_nr);
+        for (cur_map=new_act.begin();cur_map!=new_act.end();cur_map++) {
+            int ep = act_store->intern(cur_map->first);
+            for (cur_act=((*cur_map).second).begin();cur_act!=((*cur_map).second).end();cur_act++)
+                act_store->add_value(ep, store_nr, *cur_act);
+        }
+        act_store->finalize();
+        return;
+    }
     activities.clear();
     for (cur_map=new_act.begin();cur_map!=new_act.end();cur_map++) {
         for (cur_act=((*cur_map).second).begin();cur_act!=((*cur_map).second).end();cur_act++) {
@@ -898,6 +1023,15 @@ void FeatMol<MolType,FeatureType,ActivityType>::replace_activities(map<string, v
 
 template <typename MolType, typename FeatureType, typename ActivityType>
 void FeatMol<MolType,FeatureType,ActivityType>::set_available(map<string, bool> new_avail) {
+    if (act_store) {
+        map<string, bool>::iterator cur_a;
+        for (int ep = 0; ep < act_store->get_nr_endpoints(); ep++) {
+            cur_a = new_avail.find(act_store->get_name(ep));
+            act_store->set_available(ep, store_nr, cur_a != new_avail.end() && cur_a->second);
+            act_store->set_available_bak(ep, store_nr, cur_a != new_avail.end() && cur_a->second);
+        }
+        return;
+    }
     available = new_avail;
     available_bak = new_avail;
 };
@@ -905,6 +1039,7 @@ void FeatMol<MolType,FeatureType,ActivityType>::set_available(map<string, bool>
 template <typename MolType, typename FeatureType, typename ActivityType>
 void FeatMol<MolType,FeatureType,ActivityType>::print_neighbor(string act) {
 
+    vector<ActivityType> vals = this->get_act(act);
     typename vector<ActivityType>::iterator cur_act;
 
     *out << "    - line_nr: " << this->get_line_nr()+1 << "\n";
@@ -912,8 +1047,8 @@ void FeatMol<MolType,FeatureType,ActivityType>::print_neighbor(string act) {
     *out << "      smiles: '" << this->get_smiles() << "'\n";
     *out << "      inchi: '" << this->get_inchi() << "'\n";
     *out << "      activity: [";
-    for (cur_act = activities[act].begin(); cur_act != activities[act].end(); cur_act++) {
-        if (cur_act != activities[act].begin()) *out << ", ";
+    for (cur_act = vals.begin(); cur_act != vals.end(); cur_act++) {
+        if (cur_act != vals.begin()) *out << ", ";
         *out << *cur_act;
     }
     *out << "]\n";
@@ -973,8 +1108,13 @@ void FeatMol<MolType,FeatureType,ActivityType>::print_features(string act) {
         vector<int> common_matches;
         typename FeatVect::iterator cur_feat;
         typename FeatVect::iterator cur_nonr;
+        vector<pair<float, Feature<FeatureType> *> > ranked;
 
-        sort(features.begin(),features.end(),greater_p<FeatureType>());
+        for (cur_feat=features.begin();cur_feat!=features.end();cur_feat++)
+            ranked.push_back(make_pair((*cur_feat)->get_p(act), *cur_feat));
+        sort(ranked.begin(),ranked.end(),greater_p<FeatureType>());
+        for (unsigned int i = 0; i < ranked.size(); i++)
+            features[i] = ranked[i].second;
 
         // determine nonredundant features
         for (cur_feat=features.begin();cur_feat!=features.end();cur_feat++) {
@@ -1010,130 +1150,125 @@ void FeatMol<MolType,FeatureType,ActivityType>::print_features(string act) {
 
 template <typename MolType, typename FeatureType, typename ActivityType>
 void FeatMol<MolType,FeatureType,ActivityType>::add_feature(Feature<FeatureType> * feat) {
+
+    // features are usually added in id order, a feature that is already present is skipped
+    vector<int>::iterator pos = feature_ids.end();
+    if (!feature_ids.empty() && feature_ids.back() >= feat->get_id()) {
+        pos = lower_bound(feature_ids.begin(), feature_ids.end(), feat->get_id());
+        if (*pos == feat->get_id())
+            return;
+    }
     features.push_back(feat);
+    id_features.insert(id_features.begin() + (pos - feature_ids.begin()), feat);
+    feature_ids.insert(pos, feat->get_id());
 }
 
-
 template <typename MolType, typename FeatureType, typename ActivityType>
-void FeatMol<MolType,FeatureType,ActivityType>::common_features(sMolRef m1, sMolRef m2, FeatVect* inter, FeatVect* uni) {
+void FeatMol<MolType,FeatureType,ActivityType>::set_features(FeatVect f) {
 
-    inter->clear();
-    uni->clear();
+    typename FeatVect::iterator cur_feat;
 
-    FeatVect m1_features = m1->get_features();
-    FeatVect m2_features = m2->get_features();
+    this->clear_features();
+    for (cur_feat = f.begin(); cur_feat != f.end(); cur_feat++)
+        this->add_feature(*cur_feat);
+}
 
-    sort(m1_features.begin(), m1_features.end());
-    sort(m2_features.begin(), m2_features.end());
 
-    set_union(m1_features.begin(),m1_features.end(),
-              m2_features.begin(),m2_features.end(),
-              insert_iterator<FeatVect>((*uni),(*uni).begin()));
+template <typename MolType, typename FeatureType, typename ActivityType>
+float FeatMol<MolType,FeatureType,ActivityType>::weighted_tanimoto(MolRef m1, MolRef m2, string act) {
+
+    const int * ids1 = m1->feature_ids.empty() ? NULL : &m1->feature_ids[0];
+    const int * ids2 = m2->feature_ids.empty() ? NULL : &m2->feature_ids[0];
+    int n1 = m1->feature_ids.size();
+    int n2 = m2->feature_ids.size();
+    int i1 = 0;
+    int i2 = 0;
+    int nr_u = 0;	// significant features in the union
+    int ep = -1;	// endpoint id of act in the feature statistics
+    bool common;
+    Feature<FeatureType> * feat;
+    float c = 0;
+    float u = 0;
+    float w;
+
+    if (n1 > 0) ep = m1->id_features[0]->get_endpoint(act);
+    else if (n2 > 0) ep = m2->id_features[0]->get_endpoint(act);
+
+    // merge the sorted id arrays: union features contribute to u, common features to c
+    while (i1 < n1 || i2 < n2) {
+        if (i2 == n2 || (i1 < n1 && ids1[i1] < ids2[i2])) {
+            feat = m1->id_features[i1++];
+            common = false;
+        }
+        else if (i1 == n1 || ids2[i2] < ids1[i1]) {
+            feat = m2->id_features[i2++];
+            common = false;
+        }
+        else {
+            feat = m1->id_features[i1++];
+            i2++;
+            common = true;
+        }
+
+        w = feat->get_weight(ep);	// gauss(p), 0 if p is below the limit
+        if (w > 0) {
+            nr_u++;
+            u = u + w;
+            if (common) c = c + w;
+        }
+    }
 
-    set_intersection(m1_features.begin(),m1_features.end(),
-                     m2_features.begin(),m2_features.end(),
-                     insert_iterator<FeatVect>((*inter),(*inter).begin()));
+    if (nr_u > 1 && u > 0)
+        return(c/u);
+    return(0.0);
 
 };
 
 template <typename MolType, typename FeatureType, typename ActivityType>
-void FeatMol<MolType,FeatureType,ActivityType>::common_features(sMolRef test) {
+float FeatMol<MolType,FeatureType,ActivityType>::pair_similarity(MolRef m1, MolRef m2, string act) {
+
+    Feature<FeatureType> * feat;
+    int slot;
+    unsigned int generation;
+    float sim;
 
-    pred_features.clear();
-    common_feat.clear();
+    if (!m1->sim_cache || m1->sim_cache != m2->sim_cache)
+        return(weighted_tanimoto(m1, m2, act));
 
-    FeatVect test_features = test->get_features();
-    FeatVect train_features = this->get_features();
+    if (m1->id_features.size() > 0) feat = m1->id_features[0];
+    else if (m2->id_features.size() > 0) feat = m2->id_features[0];
+    else return(0.0);
 
-    sort(test_features.begin(),test_features.end());
-    sort(train_features.begin(),train_features.end());
+    // LOO weights depend on the features of the test structure
+    if (feat->weights_depend_on_query())
+        return(weighted_tanimoto(m1, m2, act));
 
-    set_union(train_features.begin(),train_features.end(),
-              test_features.begin(),test_features.end(),
-              insert_iterator<FeatVect >(pred_features,pred_features.begin()));
+    slot = feat->get_base_slot(feat->get_endpoint(act));
+    if (slot < 0)
+        return(weighted_tanimoto(m1, m2, act));
+    generation = feat->get_weight_generation(slot);
 
-    set_intersection(train_features.begin(),train_features.end(),
-                     test_features.begin(),test_features.end(),
-                     insert_iterator<FeatVect >(common_feat,common_feat.begin()));
+    if (!m1->sim_cache->get(slot, generation, m1->store_nr, m2->store_nr, &sim)) {
+        sim = weighted_tanimoto(m1, m2, act);
+        m1->sim_cache->put(slot, generation, m1->store_nr, m2->store_nr, sim);
+    }
+    return(sim);
 
 };
 
 template <typename MolType, typename FeatureType, typename ActivityType>
 float FeatMol<MolType,FeatureType,ActivityType>::get_similarity(sMolRef m2, string act, sMolRef m1=sMolRef()) {
-    float tanimoto;
-    typename FeatVect::iterator cur_feat;
-
-    float c=0;
-    float u=0;
-    float p=0;
-
-    typedef vector<Feature<FeatureType> *> FeatVect;
-    FeatVect suni, sinter, uv, iv;
 
-    // compose union and intersect sets
     if (m1 != sMolRef()) {
-        // sim between two training compounds: calculate sets
-        common_features(m1,m2,&iv,&uv);
-    }
-    else {
-        // sim between one training compound and test compound: re-use sets
-        uv = this->pred_features;
-        iv = this->common_feat;
-    }
-
-    // set significances in union feature set
-    for (cur_feat = uv.begin(); cur_feat != uv.end(); cur_feat++) {
-        (*cur_feat)->set_cur_p(act);
-    }
-
-    // determine u = sum of significances of union feature set
-    for (cur_feat = uv.begin(); cur_feat != uv.end(); cur_feat++) {
-        p = (*cur_feat)->get_cur_p();
-        if (p >= (*cur_feat)->get_p_limit()) { // (*)
-            p = gauss(p);
-            suni.push_back(*cur_feat);
-            u = u + p;
-        }
-    }
-
-    tanimoto = 0.0;
-    if (suni.size() > 1) {
-        // intersect significance endowed features with common features
-        sort(suni.begin(),suni.end(),greater_p<FeatureType>());
-        sort(iv.begin(),iv.end(),greater_p<FeatureType>());
-        set_intersection(iv.begin(),iv.end(),
-                         suni.begin(),suni.end(),
-                         insert_iterator<FeatVect >(sinter,sinter.begin()),
-                         greater_p<FeatureType>());
-
-        // determine c = sum of significances of common feature set
-        for (cur_feat = sinter.begin(); cur_feat != sinter.end(); cur_feat++) {
-            p = (*cur_feat)->get_cur_p();
-            if (p >= (*cur_feat)->get_p_limit()) { // test is needed if (*) is not applied to suni.push_back()
-                p = gauss(p);
-                c = c + p;
-            }
-        }
-
-        // determine Tanimoto index and store as similarity
-        if (u>0) {
-            tanimoto = c/u;
-        }
+        // sim between two training compounds
+        return(pair_similarity(m1.get(), m2.get(), act));
     }
-
-    return tanimoto;
+    return(0.0);
 
 };
 
 
 
-template <typename MolType, typename FeatureType, typename ActivityType>
-void FeatMol<MolType,FeatureType,ActivityType>::relevant_features(sMolRef test, string act) {
-
-    similarity = get_similarity(test, act);
-
-};
-
 template <typename MolType, typename FeatureType, typename ActivityType>
 float FeatMol<MolType,FeatureType,ActivityType>::get_similarity() {
 
@@ -1159,6 +1294,11 @@ void FeatMol<MolType,FeatureType,ActivityType>::remove() {
 
     map<string, bool>::iterator cur_a;
 
+    if (act_store) {
+        act_store->remove(store_nr);
+        return;
+    }
+
     available_bak = available;
 
     for (cur_a = available.begin(); cur_a != available.end(); cur_a++) {
@@ -1171,6 +1311,12 @@ void FeatMol<MolType,FeatureType,ActivityType>::remove() {
 
 template <typename MolType, typename FeatureType, typename ActivityType>
 void FeatMol<MolType,FeatureType,ActivityType>::set_activity(string name, ActivityType act) {
+    if (act_store) {
+        int ep = act_store->intern(name);
+        act_store->add_value(ep, store_nr, act);
+        act_store->set_available(ep, store_nr, true);
+        return;
+    }
     activities[name].push_back(act);
     available[name] = true;
 };
@@ -1217,9 +1363,7 @@ vector<Feature<FeatureType> *> FeatMol<MolType,FeatureType,ActivityType>::get_si
 
 template <typename MolType, typename FeatureType, typename ActivityType>
 bool FeatMol<MolType,FeatureType,ActivityType>::match(Feature<OBLinFrag> * feat_ptr) {
-    OBSmartsPattern * sp = feat_ptr->get_smarts_pattern();
-    OBMol * mol = this->get_mol_ref();
-    return ( sp->Match(*mol, true) );
+    return ( MolType::match(feat_ptr->get_smarts_pattern()) );
 };
 
 template <typename MolType, typename FeatureType, typename ActivityType>
@@ -20,8 +20,16 @@
 #define LAZMOLVECT_H
 
 #include <string>
+#include <sys/time.h>
 
+#include "boost/unordered_map.hpp"
 #include "lazmol.h"
+#include "parallel.h"
+#include "snapshot.h"
+#include "neighbor-selection.h"
+#include "similarity.h"
+#include "lsh-index.h"
+#include "similarity-cache.h"
 
 using namespace std;
 using namespace OpenBabel;
@@ -29,12 +37,386 @@ using namespace OpenBabel;
 float sig_thr = 0.9;
 bool kernel = false;
 bool quantitative = false;
+int nr_threads = 1;
+int window_size = 0;
+bool prune_neighbors = false;
+int lsh_bands = 0;
+int lsh_rows = 4;
+int lsh_sample = 10;
+unsigned int sim_cache_size = 0;
+string sim_matrix = "";
+bool fused_endpoints = false;
+const int max_dense_compounds = 50000;
 
 void remove_dos_cr(string* str) {
     string nl = "\r";
     for (string::size_type i = str->find(nl); i!=string::npos; i=str->find(nl)) str->erase(i,1); // erase dos cr
 }
 
+//! split a line of a structure file into ID and SMILES
+void split_structure_line(string & line, string * id, string * smi) {
+
+    string tmp_field;
+    istringstream iss(line);
+    int field_nr = 0;
+
+    *id = -1;
+    *smi = "";
+
+    while (getline(iss, tmp_field, '\t')) {	// split at tabs
+
+        if (field_nr == 0)
+            *id = tmp_field;
+        else if (field_nr == 1)
+            *smi = tmp_field;
+
+        field_nr++;
+    }
+
+    remove_dos_cr(smi);
+}
+
+
+//! build the FeatMols of a structure file in chunks of lines, one OBConversion and error buffer per thread
+//
+// init() initializes the global state of OpenBabel before the threads start. The threads parse SMILES
+// concurrently with OpenBabel 3 (HAVE_OPENBABEL3), the InChI output and the 2.x parsing are serialized
+// in OBLazMol::read_smiles().
+template <class MolType, class FeatureType, class ActivityType>
+class ParallelMolReader: public ParallelJobs {
+
+public:
+
+    typedef shared_ptr<FeatMol < MolType, FeatureType, ActivityType > > sMolRef ;
+
+    static const int chunk_size = 256;
+
+    int first_line_nr;
+    vector<string> ids;
+    vector<string> smiles;
+    vector<sMolRef> mols;	//!< results in line order
+    vector<string> messages;	//!< error messages of each line
+
+private:
+
+    vector<shared_ptr<OBConversion> > convs;
+    vector<shared_ptr<Out> > outs;
+
+public:
+
+    ParallelMolReader(): first_line_nr(0) {};
+
+    int get_nr_chunks() {
+        return((ids.size() + chunk_size - 1) / chunk_size);
+    };
+
+    //! set up the per thread objects (in the calling thread, OpenBabel initializes its global state on first use)
+    void init(int nr_threads) {
+        MolType::init_openbabel();
+        mols.resize(ids.size());
+        messages.resize(ids.size());
+        for (int t = 0; t < nr_threads; t++) {
+            convs.push_back(shared_ptr<OBConversion>(new OBConversion(&cin,&cout)));
+            convs.back()->SetInAndOutFormats("SMI","INCHI");
+            outs.push_back(shared_ptr<Out>(new Out()));
+        }
+    };
+
+    void run(int thread_nr, int chunk_nr) {
+        unsigned int end = min((unsigned int) ids.size(), (unsigned int) (chunk_nr+1) * chunk_size);
+        for (unsigned int n = chunk_nr * chunk_size; n < end; n++) {
+            mols[n].reset(new FeatMol<MolType,FeatureType,ActivityType>(first_line_nr + n, ids[n], smiles[n], convs[thread_nr].get(), outs[thread_nr]));
+            messages[n] = outs[thread_nr]->str();
+            outs[thread_nr]->str("");
+        }
+    };
+
+};
+
+//! reads a structure file window by window, only the current window is kept in memory
+template <class MolType, class FeatureType, class ActivityType>
+class MolStream {
+
+public:
+
+    typedef shared_ptr<FeatMol < MolType, FeatureType, ActivityType > > sMolRef ;
+
+private:
+
+    InputFile input;
+    string file;
+    int line_nr;
+    shared_ptr<Out> out;
+
+public:
+
+    MolStream(char * structure_file, shared_ptr<Out> out);
+
+    //! replace mols with the next window_size structures (parsed on nr_threads threads), returns false at the end of the file
+    bool read_window(int window_size, vector<sMolRef> * mols);
+
+};
+
+template <class MolType, class FeatureType, class ActivityType>
+MolStream<MolType, FeatureType, ActivityType>::MolStream(char * structure_file, shared_ptr<Out> out): file(structure_file), line_nr(0), out(out) {
+
+    input.open(structure_file);
+
+    if (!input) {
+        *out << "Cannot open " << structure_file << endl;
+        out->print_err();
+        exit(1);
+    }
+
+    *out << "Reading structures from " << structure_file << endl;
+    out->print_err();
+
+};
+
+template <class MolType, class FeatureType, class ActivityType>
+bool MolStream<MolType, FeatureType, ActivityType>::read_window(int window_size, vector<sMolRef> * mols) {
+
+    string line;
+    string id;
+    string smi;
+    ParallelMolReader<MolType,FeatureType,ActivityType> reader;
+
+    mols->clear();
+    reader.first_line_nr = line_nr;
+
+    while ((int) reader.ids.size() < window_size && getline(input, line)) {
+        split_structure_line(line, &id, &smi);
+        reader.ids.push_back(id);
+        reader.smiles.push_back(smi);
+    }
+
+    if (input.failed()) {
+        *out << file << " is corrupt or truncated ... exiting.\n";
+        out->print_err();
+        exit(1);
+    }
+
+    reader.init(nr_threads);
+    run_parallel(&reader, reader.get_nr_chunks(), nr_threads);
+
+    for (unsigned int n = 0; n < reader.mols.size(); n++) {
+        *out << reader.messages[n];
+        out->print_err();
+        reader.mols[n]->set_output(out);
+        mols->push_back(reader.mols[n]);
+    }
+
+    line_nr += mols->size();
+    return(mols->size() > 0);
+
+};
+
+//! weighted Tanimoto similarities of a query to training compounds, chunks of candidates are scored on a thread pool
+//
+// Each chunk writes its similarities into sims (not into the compounds) and keeps the available
+// candidates that may become neighbors in tops (see NeighborSelection::reduce()).
+template <class MolType, class FeatureType, class ActivityType>
+class SimilarityScorer: public ParallelJobs {
+
+public:
+
+    typedef shared_ptr<FeatMol < MolType, FeatureType, ActivityType > > sMolRef ;
+
+    static const int chunk_size = 512;
+
+    vector<sMolRef> * compounds;
+    sMolRef test;
+    string act;
+
+    //! dense query weights for weighted_tanimoto_block() (query_w == NULL: FeatMol::weighted_tanimoto())
+    const float * query_w;
+    const float * other_w;
+    int nr_weights;
+    float query_weight;
+    int query_nr;
+
+    //! input and results of run()
+    const vector<int> * candidates;
+    vector<float> sims;	//!< similarity of (*candidates)[i]
+    vector<NeighborSelection> tops;	//!< per chunk, empty if ep < 0
+    ActivityStore<ActivityType> * store;
+    int ep;	//!< endpoint id of act in store
+
+    SimilarityScorer(): compounds(NULL), query_w(NULL), other_w(NULL), nr_weights(0), query_weight(0), query_nr(0), candidates(NULL), store(NULL), ep(-1) {};
+
+    //! similarities of compounds comps[0] .. comps[nr-1] to test in sims[0] .. sims[nr-1] (may be called concurrently)
+    void score(const int * comps, int nr, float * sims);
+
+    int get_nr_chunks() {
+        return((candidates->size() + chunk_size - 1) / chunk_size);
+    };
+
+    void init() {
+        sims.resize(candidates->size());
+        tops.assign(this->get_nr_chunks(), NeighborSelection());
+    };
+
+    void run(int thread_nr, int chunk_nr) {
+        int begin = chunk_nr * chunk_size;
+        int end = min((int) candidates->size(), begin + chunk_size);
+        this->score(&(*candidates)[begin], end - begin, &sims[begin]);
+        if (ep >= 0) {
+            for (int i = begin; i < end; i++)
+                if (store->is_available(ep, (*candidates)[i]))
+                    tops[chunk_nr].add(sims[i], (*candidates)[i]);
+            tops[chunk_nr].reduce(neighbor_cutoff, min_neighbors);
+        }
+    };
+
+};
+
+template <class MolType, class FeatureType, class ActivityType>
+void SimilarityScorer<MolType, FeatureType, ActivityType>::score(const int * comps, int nr, float * sims) {
+
+    vector<const int *> ids;
+    vector<int> lens;
+    vector<int> pos;
+    vector<float> block;
+    vector<int> * feature_ids;
+
+    // compounds with features beyond the weight arrays are scored by the merge
+    for (int i = 0; i < nr; i++) {
+        feature_ids = (*compounds)[comps[i]]->get_feature_ids();
+        if (!query_w || (!feature_ids->empty() && feature_ids->back() >= nr_weights)) {
+            sims[i] = (*compounds)[comps[i]]->weighted_tanimoto((*compounds)[comps[i]].get(), test.get(), act);
+            continue;
+        }
+        ids.push_back(feature_ids->empty() ? NULL : &(*feature_ids)[0]);
+        lens.push_back(feature_ids->size());
+        pos.push_back(i);
+    }
+
+    if (ids.empty())
+        return;
+    block.resize(ids.size());
+    weighted_tanimoto_block(query_w, other_w, query_weight, query_nr, &ids[0], &lens[0], ids.size(), &block[0]);
+    for (unsigned int k = 0; k < pos.size(); k++)
+        sims[pos[k]] = block[k];
+
+};
+
+//! rows of the dense similarity matrix of a training set, one job per row and one pair of weight arrays per thread
+//
+// Row i has the similarities of compound i to compounds i .. nr-1, compound i is the query of
+// weighted_tanimoto_block() for this row.
+class SimilarityMatrixFiller: public ParallelJobs {
+
+public:
+
+    vector<const int *> ids;	//!< feature ids of each compound
+    vector<int> lens;
+    const float * weights;	//!< base weights indexed by feature id
+    int nr_weights;
+    float * dense;	//!< packed upper triangle, see SimilarityCache::dense_index()
+
+private:
+
+    vector<vector<float> > query_w;
+    vector<vector<float> > other_w;
+
+public:
+
+    SimilarityMatrixFiller(): weights(NULL), nr_weights(0), dense(NULL) {};
+
+    void init(int nr_threads) {
+        query_w.assign(max(nr_threads, 1), vector<float>(nr_weights, 0));
+        other_w.assign(max(nr_threads, 1), vector<float>(weights, weights + nr_weights));
+    };
+
+    void run(int thread_nr, int i) {
+        float * q = &query_w[thread_nr][0];
+        float * o = &other_w[thread_nr][0];
+        int nr = ids.size();
+        float query_weight = 0;
+        int query_nr = 0;
+        int f;
+
+        for (int j = 0; j < lens[i]; j++) {
+            f = ids[i][j];
+            q[f] = weights[f];
+            o[f] = 0;
+            query_weight += weights[f];
+            if (weights[f] > 0) query_nr++;
+        }
+        weighted_tanimoto_block(q, o, query_weight, query_nr, &ids[i], &lens[i], nr - i, dense + SimilarityCache::dense_index(i, i, nr));
+        for (int j = 0; j < lens[i]; j++) {
+            f = ids[i][j];
+            q[f] = 0;
+            o[f] = weights[f];
+        }
+    };
+
+};
+
+//! weighted Tanimoto similarities of a query for all endpoints in one pass over the features of each candidate
+//
+// weights has the base weights of all endpoints feature by feature (weights[f * nr_endpoints + e]),
+// so each feature of a candidate is looked up once for all endpoints. The results are a block of
+// endpoints x candidates (sims[e * ids.size() + i]).
+class MultiEndpointScorer: public ParallelJobs {
+
+public:
+
+    static const int chunk_size = 512;
+
+    int nr_endpoints;
+    const float * weights;
+    const char * in_query;	//!< 1 for the features of the query, indexed by feature id
+    vector<float> query_weight;	//!< per endpoint
+    vector<int> query_nr;
+    vector<const int *> ids;	//!< feature ids of each candidate
+    vector<int> lens;
+    vector<float> sims;
+
+    MultiEndpointScorer(): nr_endpoints(0), weights(NULL), in_query(NULL) {};
+
+    int get_nr_chunks() {
+        return((ids.size() + chunk_size - 1) / chunk_size);
+    };
+
+    void init() {
+        sims.assign(nr_endpoints * ids.size(), 0);
+    };
+
+    void run(int thread_nr, int chunk_nr) {
+        int nr = ids.size();
+        int end = min(nr, (chunk_nr + 1) * chunk_size);
+        vector<float> common(nr_endpoints);
+        vector<float> other(nr_endpoints);
+        vector<int> nr_u(nr_endpoints);
+        const float * w;
+        float u;
+
+        for (int i = chunk_nr * chunk_size; i < end; i++) {
+            common.assign(nr_endpoints, 0);
+            other.assign(nr_endpoints, 0);
+            nr_u = query_nr;
+            for (int j = 0; j < lens[i]; j++) {
+                w = weights + (size_t) ids[i][j] * nr_endpoints;
+                if (in_query[ids[i][j]]) {
+                    for (int e = 0; e < nr_endpoints; e++)
+                        common[e] += w[e];
+                }
+                else {
+                    for (int e = 0; e < nr_endpoints; e++) {
+                        other[e] += w[e];
+                        if (w[e] > 0) nr_u[e]++;
+                    }
+                }
+            }
+            for (int e = 0; e < nr_endpoints; e++) {
+                u = query_weight[e] + other[e];
+                sims[(size_t) e * nr + i] = (nr_u[e] > 1 && u > 0) ? common[e] / u : 0;
+            }
+        }
+    };
+
+};
 
 //! container for LazMol objects
 template <class MolType, class FeatureType, class ActivityType>
@@ -49,36 +431,179 @@ protected:
 
     vector<sMolRef> compounds;
     shared_ptr<Out> out;
-    map<string, int> id2line_map;
+
+    //! hash indexes into compounds
+    unordered_map<string, int> id_index;
+    unordered_map<string, vector<int> > inchi_index;
+    unordered_map<string, vector<int> > smiles_index;
+
+    //! activity values of all compounds, compound n is compounds[n]
+    ActivityStore<ActivityType> activity_store;
+
+    //! query of common_features()
+    sMolRef query;
+    //! candidates of the last relevant_features() call and the summed weights of their common features (0 for other compounds)
+    vector<int> candidates;
+    vector<float> common_weights;
+
+    //! prune_neighbors: relevant_features() leaves the similarities to get_neighbors(), which
+    //! computes them only for candidates that may become neighbors
+    sMolRef pending_query;
+    string pending_act;
+    int pending_slot;	// base weight slot of pending_act, see Feature::get_base_slot()
+    //! weights of the common features (current LOO state) and of the query features in the base slot, per candidate
+    vector<double> bound_common;
+    vector<double> bound_shared;
+    double query_weight;
+    int nr_pruned;
+
+    //! summed base weights of the features of each compound, cached per weight slot
+    struct Masses {
+        unsigned int generation;
+        vector<double> mass;
+        vector<int> nr_features;	// feature count at the time mass was summed
+        Masses(): generation(0) {};
+    };
+    unordered_map<int, Masses> masses;
+
+    //! ranking of the neighbor candidates (reused between queries)
+    NeighborSelection selection;
+    //! prune_neighbors: candidates in the order of their upper bounds (reused between queries)
+    BoundedScan scan;
+
+    //! dense query weights for weighted_tanimoto_block(), see prepare_scorer()
+    vector<float> block_query;
+    vector<float> block_other;	// base weights of block_slot, 0 for the query features
+    int block_slot;
+    unsigned int block_generation;
+    shared_ptr<SimilarityScorer<MolType, FeatureType, ActivityType> > scorer;	// created on demand (feature types without similarities have no scorer)
+
+    //! act of the candidates that relevant_features() has left in selection (empty if there are none)
+    string selection_act;
+
+    //! set up scorer for test and act (ep: endpoint id of the feature statistics), the dense weights are used if they have been filled
+    void prepare_scorer(sMolRef test, string act, int ep);
+
+    //! reset the query weights of prepare_scorer()
+    void release_scorer();
+
+    //! lsh_bands > 0: approximate candidates from an LSH index of the significant features (base weights of lsh_slot)
+    shared_ptr<LshIndex> lsh;
+    int lsh_slot;
+    unsigned int lsh_generation;
+    int lsh_nr_compounds;
+    int lsh_nr_queries;
+    sMolRef lsh_check;	// query whose recall the next get_neighbors() call measures
+    double lsh_recall;	// of the last get_neighbors() call, -1 if it has not been measured
+    double lsh_recall_sum;
+    int lsh_nr_samples;
+
+    //! fused_endpoints: similarities of the candidates of relevant_features(test, acts) for each act in fused_acts
+    MultiEndpointScorer fused;
+    vector<string> fused_acts;
+    vector<float> fused_weights;	// base weights of fused_slots, feature by feature
+    vector<int> fused_slots;
+    vector<unsigned int> fused_generations;
+    vector<char> fused_query;
+
+    //! reset the similarities and bounds of the previous candidates
+    void clear_candidates();
+
+    //! similarities of pairs of training compounds (see FeatMol::pair_similarity()), created by attach_activities()
+    shared_ptr<SimilarityCache> sim_cache;
+
+    //! candidates of test from the LSH index (rebuilt if the weights in the base slot of ep have changed)
+    void lsh_candidates(sMolRef test, int ep, vector<int> * cands);
+
+    //! recall of neighbors (from the LSH candidates) with respect to the neighbors from all compounds that share a feature with test
+    void measure_recall(sMolRef test, string act, int ep, vector<sMolRef>* neighbors);
+
+    //! summed weights in slot of the features of each compound
+    const vector<double> & get_masses(int slot, Feature<FeatureType> * feat);
+
+    //! neighbors from upper bounds of the similarities, returns false if nothing could be pruned (the similarities are complete then)
+    bool get_pruned_neighbors(sMolRef test, string act, int ep, vector<sMolRef>* neighbors);
+
+    //! add compounds[n] to the hash indexes
+    void index_compound(int n);
+
+    //! keep the activities of compounds[first] .. compounds.back() in activity_store
+    void attach_activities(int first);
 
 public:
 
     ~MolVect() {};
-    MolVect() {};
+    MolVect(): pending_slot(-1), query_weight(0), nr_pruned(0), block_slot(-1), block_generation(0), lsh_slot(-1), lsh_generation(0), lsh_nr_compounds(0), lsh_nr_queries(0), lsh_recall(-1), lsh_recall_sum(0), lsh_nr_samples(0) {};
 
-    //! MolVect constructor: reads SMILES from file (called by FeatMolVect())
+    //! MolVect constructor: reads SMILES from file (called by FeatMolVect()), the structures are parsed on nr_threads threads
     MolVect(char * structure_file, shared_ptr<Out> out);
 
+    //! MolVect constructor: takes structures and InChIs from a snapshot (called by FeatMolVect())
+    MolVect(Snapshot * snapshot, shared_ptr<Out> out);
+
+    //! append the structures of a SMILES file, returns the index of the first new compound
+    int read_structures(char * structure_file);
+
+    //! append a single structure, returns its index (-1 if the ID is not unique)
+    int add_compound(string id, string smiles);
+
     //! add a new feature to compound comp_nr
     void add_feature(int comp_nr, Feature<FeatureType> * feat_ptr) {
         compounds[comp_nr]->add_feature(feat_ptr);
     };
 
-    //! determine common features with the training compounds. Results are used to find neighbors later.
+    //! set the query compound for relevant_features()
     void common_features(sMolRef test_compound);
 
-    //! Determine similarity as weighted tanimoto index.
+    //! Determine similarity as weighted tanimoto index (only for compounds that share a significant feature with test, all others have similarity 0), scored on nr_threads threads
     void relevant_features(sMolRef test, string act);
 
+    //! similarities for all endpoints acts in one pass (fused_endpoints), returns false if relevant_features(test, act)
+    //! has to be called for each endpoint (approximate or pruned neighbors, LOO weights, weights that have not been filled)
+    bool relevant_features(sMolRef test, const vector<string> & acts);
+
+    //! take the similarities of endpoint act from the last relevant_features(test, acts) call, returns false if act was not part of it
+    bool select_endpoint(string act);
+
     //! determine unknown features
     void determine_unknown(string act, sMolRef test);
 
     //! remove duplicates of the query structure
     vector<sMolRef> remove_duplicates(sMolRef test_comp);
 
-    //! Get Neighbors by using at least five compounds if any neighbors available
+    //! Get Neighbors by using at least five compounds if any neighbors available, sorted by similarity (descending)
     void get_neighbors(string act, vector<sMolRef>* neighbors);
 
+    //! number of candidates that the last get_neighbors() call skipped with prune_neighbors
+    int get_nr_pruned() {
+        return(nr_pruned);
+    };
+
+    //! recall of the last get_neighbors() call with lsh_bands (-1 if it was not sampled)
+    double get_lsh_recall() {
+        return(lsh_recall);
+    };
+
+    //! mean recall of the sampled get_neighbors() calls with lsh_bands
+    double get_mean_lsh_recall() {
+        return(lsh_nr_samples ? lsh_recall_sum / lsh_nr_samples : 0);
+    };
+
+    int get_nr_lsh_samples() {
+        return(lsh_nr_samples);
+    };
+
+    //! fill the dense similarity matrix of all training compounds for endpoint act in the file sim_matrix.<slot>
+    //! (at most max_dense_compounds, reused if the file matches the current weights)
+    void precompute_similarities(string act);
+
+    unsigned long get_sim_cache_hits() {
+        return(sim_cache ? sim_cache->get_hits() : 0);
+    };
+    unsigned long get_sim_cache_misses() {
+        return(sim_cache ? sim_cache->get_misses() : 0);
+    };
+
     vector<sMolRef> get_compounds() {
         return(compounds);
     };
@@ -100,22 +625,30 @@ public:
 };
 
 template <class MolType, class FeatureType, class ActivityType>
-MolVect<MolType, FeatureType, ActivityType>::MolVect(char * structure_file, shared_ptr<Out> out): out(out) {
+MolVect<MolType, FeatureType, ActivityType>::MolVect(char * structure_file, shared_ptr<Out> out): out(out), pending_slot(-1), query_weight(0), nr_pruned(0), block_slot(-1), block_generation(0), lsh_slot(-1), lsh_generation(0), lsh_nr_compounds(0), lsh_nr_queries(0), lsh_recall(-1), lsh_recall_sum(0), lsh_nr_samples(0) {
+
+    this->read_structures(structure_file);
+
+};
+
+template <class MolType, class FeatureType, class ActivityType>
+int MolVect<MolType, FeatureType, ActivityType>::read_structures(char * structure_file) {
 
     string line;
-    string tmp_field;
     string id;
     string smi;
     string inchi;
-    vector<string> ids, dup_ids;
+    vector<string> dup_ids;
     vector<string>::iterator dup_id;
-    vector<string> inchis;
-    vector<string>::iterator dup_inchi;
 
     sMolRef mol_ptr;
     int line_nr = 0;
+    int first_compound = compounds.size();
+    ParallelMolReader<MolType,FeatureType,ActivityType> reader;
+    struct timeval start, end;
+    float secs;
 
-    ifstream input;
+    InputFile input;
     input.open(structure_file);
 
     if (!input) {
@@ -127,42 +660,53 @@ MolVect<MolType, FeatureType, ActivityType>::MolVect(char * structure_file, shar
     *out << "Reading structures from " << structure_file << endl;
     out->print_err();
 
-    line_nr = 0;
-
     while (getline(input, line)) {
+        split_structure_line(line, &id, &smi);
+        reader.ids.push_back(id);
+        reader.smiles.push_back(smi);
+    }
 
-        istringstream iss(line);
-
-        int field_nr = 0;
-        id = -1;
-        smi = "";
+    if (input.failed()) {
+        *out << structure_file << " is corrupt or truncated ... exiting.\n";
+        out->print_err();
+        exit(1);
+    }
 
-        while (getline(iss, tmp_field, '\t')) {	// split at tabs
+    input.close();
 
-            if (field_nr == 0)
-                id = tmp_field;
-            else if (field_nr == 1)
-                smi = tmp_field;
+    // parse SMILES and create InChIs (wall clock time, the threads run concurrently)
+    gettimeofday(&start, NULL);
+    reader.first_line_nr = first_compound;
+    reader.init(nr_threads);
+    run_parallel(&reader, reader.get_nr_chunks(), nr_threads);
+    gettimeofday(&end, NULL);
+    secs = (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1e6;
+    *out << "Parsed " << reader.mols.size() << " structures on " << nr_threads << " threads in " << secs << " sec (";
+    if (secs > 0)
+        *out << reader.mols.size() / secs << " structures/s)\n";
+    else
+        *out << "n/a structures/s)\n";
+    out->print_err();
 
-            field_nr++;
-        }
+    // merge in line order
+    compounds.reserve(first_compound + reader.mols.size());
 
-        // ID
-        dup_id = find(ids.begin(), ids.end(), id);
+    for (line_nr = 0; line_nr < (int) reader.mols.size(); line_nr++) {
 
-        if (dup_id == ids.end())
-            ids.push_back(id);
+        id = reader.ids[line_nr];
+        mol_ptr = reader.mols[line_nr];
+        reader.mols[line_nr].reset();
 
-        else {
+        // ID
+        if (id_index.find(id) != id_index.end()) {
             *out << id << " (line " << line_nr << ") is not a unique ID ... exiting.\n";
             out->print_err();
             exit(1);
         }
 
-        // SMILES
-        remove_dos_cr(&smi);
-
-        mol_ptr.reset(new FeatMol<MolType,FeatureType,ActivityType>(line_nr, id, smi,out));
+        *out << reader.messages[line_nr];
+        out->print_err();
+        mol_ptr->set_output(out);
 
         inchi = mol_ptr->get_inchi();
 
@@ -170,12 +714,9 @@ MolVect<MolType, FeatureType, ActivityType>::MolVect(char * structure_file, shar
         // (warning already printed in FeatMol constructor)
         if (inchi.size()>0)
         {
-            dup_inchi = find(inchis.begin(), inchis.end(), inchi);
+            dup_ids =  this->get_idfrominchi(inchi);
 
-            if (dup_inchi == inchis.end())
-                inchis.push_back(inchi);
-            else {
-                dup_ids =  this->get_idfrominchi(inchi);
+            if (dup_ids.size() > 0) {
                 *out << "Compounds " << id ;
                 for (dup_id=dup_ids.begin();dup_id!=dup_ids.end();dup_id++) {
                     *out << " and " << *dup_id;
@@ -186,13 +727,94 @@ MolVect<MolType, FeatureType, ActivityType>::MolVect(char * structure_file, shar
         }
 
         compounds.push_back(mol_ptr);
-    	id2line_map.insert(make_pair(id, line_nr));
-        line_nr++;
+        this->index_compound(compounds.size()-1);
     }
 
-    input.close();
+    this->attach_activities(first_compound);
+    return(first_compound);
+};
+
+template <class MolType, class FeatureType, class ActivityType>
+int MolVect<MolType, FeatureType, ActivityType>::add_compound(string id, string smiles) {
+
+    sMolRef mol_ptr;
+    vector<string> dup_ids;
+    vector<string>::iterator dup_id;
+    string inchi;
+
+    if (id_index.find(id) != id_index.end()) {
+        *out << id << " is not a unique ID, compound not added.\n";
+        out->print_err();
+        return(-1);
+    }
+
+    remove_dos_cr(&smiles);
+    mol_ptr.reset(new FeatMol<MolType,FeatureType,ActivityType>(compounds.size(), id, smiles, out));
+
+    inchi = mol_ptr->get_inchi();
+    if (inchi.size()>0) {
+        dup_ids =  this->get_idfrominchi(inchi);
+        if (dup_ids.size() > 0) {
+            *out << "Compounds " << id ;
+            for (dup_id=dup_ids.begin();dup_id!=dup_ids.end();dup_id++) {
+                *out << " and " << *dup_id;
+            }
+            *out << " have identical structures.\n";
+            out->print_err();
+        }
+    }
+
+    compounds.push_back(mol_ptr);
+    this->index_compound(compounds.size()-1);
+    this->attach_activities(compounds.size()-1);
+    return(compounds.size()-1);
+
+};
+
+
+template <class MolType, class FeatureType, class ActivityType>
+MolVect<MolType, FeatureType, ActivityType>::MolVect(Snapshot * snapshot, shared_ptr<Out> out): out(out), pending_slot(-1), query_weight(0), nr_pruned(0), block_slot(-1), block_generation(0), lsh_slot(-1), lsh_generation(0), lsh_nr_compounds(0), lsh_nr_queries(0), lsh_recall(-1), lsh_recall_sum(0), lsh_nr_samples(0) {
+
+    sMolRef mol_ptr;
+    const SnapCompound * comp;
+
+    compounds.reserve(snapshot->get_nr_compounds());
+
+    // SMILES are parsed on demand, IDs and InChIs have been checked when the snapshot was written
+    for (int n = 0; n < snapshot->get_nr_compounds(); n++) {
+        comp = snapshot->get_compound(n);
+        mol_ptr.reset(new FeatMol<MolType,FeatureType,ActivityType>(comp->line_nr, snapshot->get_string(comp->id), snapshot->get_string(comp->smiles), snapshot->get_string(comp->inchi), out));
+        compounds.push_back(mol_ptr);
+        this->index_compound(n);
+    }
+    this->attach_activities(0);
+};
+
+template <class MolType, class FeatureType, class ActivityType>
+void MolVect<MolType, FeatureType, ActivityType>::index_compound(int n) {
+
+    id_index[compounds[n]->get_id()] = n;
+    inchi_index[compounds[n]->get_inchi()].push_back(n);
+    smiles_index[compounds[n]->get_smiles()].push_back(n);
+
 };
 
+template <class MolType, class FeatureType, class ActivityType>
+void MolVect<MolType, FeatureType, ActivityType>::attach_activities(int first) {
+
+    activity_store.set_nr_compounds(compounds.size());
+    for (unsigned int n = first; n < compounds.size(); n++)
+        compounds[n]->attach_activities(&activity_store, n);
+
+    if (sim_cache_size == 0 && sim_matrix.empty())
+        return;
+    if (!sim_cache)
+        sim_cache.reset(new SimilarityCache());
+    sim_cache->set_capacity(sim_cache_size);
+    for (unsigned int n = first; n < compounds.size(); n++)
+        compounds[n]->attach_similarities(sim_cache.get());
+
+};
 
 template <class MolType, class FeatureType, class ActivityType>
 vector<shared_ptr<FeatMol < MolType, FeatureType, ActivityType > > > MolVect<MolType, FeatureType, ActivityType>::remove_duplicates(sMolRef test_comp) {
@@ -219,68 +841,607 @@ vector<shared_ptr<FeatMol < MolType, FeatureType, ActivityType > > > MolVect<Mol
 template <class MolType, class FeatureType, class ActivityType>
 void MolVect<MolType, FeatureType, ActivityType>::common_features(sMolRef test) {
 
-    typename vector<sMolRef>::iterator cur_mol;
+    query = test;
 
-    for (cur_mol=compounds.begin();cur_mol!=compounds.end();cur_mol++) {
-        (*cur_mol)->common_features(test);
+};
+
+template <class MolType, class FeatureType, class ActivityType>
+void MolVect<MolType, FeatureType, ActivityType>::clear_candidates() {
+
+    vector<int>::iterator cur_c;
+
+    for (cur_c = candidates.begin(); cur_c != candidates.end(); cur_c++) {
+        compounds[*cur_c]->set_similarity(0);
+        common_weights[*cur_c] = 0;
+        if (!bound_common.empty()) {
+            bound_common[*cur_c] = 0;
+            bound_shared[*cur_c] = 0;
+        }
     }
+    candidates.clear();
+    common_weights.resize(compounds.size(), 0);
+    pending_query.reset();
+    selection_act.clear();
+    lsh_check.reset();
+    fused_acts.clear();
 
 };
 
 template <class MolType, class FeatureType, class ActivityType>
 void MolVect<MolType, FeatureType, ActivityType>::relevant_features(sMolRef test, string act) {
 
-    typename vector<sMolRef>::iterator cur_mol;
+    vector<Feature<FeatureType> *> * query_features = test->get_sorted_features();
+    typename vector<Feature<FeatureType> *>::iterator cur_feat;
+    vector<int> * matches;
+    vector<int>::iterator cur_m;
+    int ep;
+    float w;
+    float b;
+
+    this->clear_candidates();
+
+    if (query_features->empty())
+        return;
+
+    ep = query_features->front()->get_endpoint(act);
+
+    if (prune_neighbors && lsh_bands == 0) {
+        // collect the common weights and the base weights of the query features for the bounds in get_neighbors()
+        bound_common.resize(compounds.size(), 0);
+        bound_shared.resize(compounds.size(), 0);
+        pending_slot = query_features->front()->get_base_slot(ep);
+        query_weight = 0;
+        for (cur_feat = query_features->begin(); cur_feat != query_features->end(); cur_feat++) {
+            w = (*cur_feat)->get_weight(ep);
+            b = (*cur_feat)->get_slot_weight(pending_slot);
+            query_weight += w;
+            if (w > 0 || b > 0) {
+                matches = (*cur_feat)->get_matches_ptr();
+                for (cur_m = matches->begin(); cur_m != matches->end(); cur_m++) {
+                    if (bound_common[*cur_m] == 0 && bound_shared[*cur_m] == 0)
+                        candidates.push_back(*cur_m);
+                    bound_common[*cur_m] += w;
+                    bound_shared[*cur_m] += b;
+                }
+            }
+        }
+        pending_query = test;
+        pending_act = act;
+        return;
+    }
 
-    for (cur_mol=compounds.begin();cur_mol!=compounds.end();cur_mol++) {
-        (*cur_mol)->relevant_features(test, act);
+    if (lsh_bands > 0) {
+        // approximate: compounds that share an LSH bucket with test
+        this->lsh_candidates(test, ep, &candidates);
+        if (lsh_sample > 0 && lsh_nr_queries++ % lsh_sample == 0)
+            lsh_check = test;
+    }
+    else {
+        // walk the postings of the significant query features
+        for (cur_feat = query_features->begin(); cur_feat != query_features->end(); cur_feat++) {
+            w = (*cur_feat)->get_weight(ep);
+            if (w > 0) {
+                matches = (*cur_feat)->get_matches_ptr();
+                for (cur_m = matches->begin(); cur_m != matches->end(); cur_m++) {
+                    if (common_weights[*cur_m] == 0)
+                        candidates.push_back(*cur_m);
+                    common_weights[*cur_m] += w;
+                }
+            }
+        }
     }
 
+    // exact similarities for compounds with common significant features, in chunks on nr_threads threads
+    if (candidates.empty())
+        return;
+    this->prepare_scorer(test, act, ep);
+    scorer->candidates = &candidates;
+    scorer->store = &activity_store;
+    scorer->ep = activity_store.get_id(act);
+    scorer->init();
+    run_parallel(scorer.get(), scorer->get_nr_chunks(), nr_threads);
+    this->release_scorer();
+
+    for (unsigned int i = 0; i < candidates.size(); i++)
+        compounds[candidates[i]]->set_similarity(scorer->sims[i]);
+
+    // merge the best candidates of the chunks for get_neighbors()
+    selection.clear();
+    for (unsigned int c = 0; c < scorer->tops.size(); c++)
+        selection.add(scorer->tops[c]);
+    selection_act = act;
+
+};
+
+template <class MolType, class FeatureType, class ActivityType>
+bool MolVect<MolType, FeatureType, ActivityType>::relevant_features(sMolRef test, const vector<string> & acts) {
+
+    vector<Feature<FeatureType> *> * query_features = test->get_sorted_features();
+    typename vector<Feature<FeatureType> *>::iterator cur_feat;
+    Feature<FeatureType> * feat;
+    vector<int> * matches;
+    vector<int>::iterator cur_m;
+    vector<int> * feature_ids;
+    int nr_endpoints = acts.size();
+    int nr_weights = 0;
+    int nr;
+    int id;
+    const float * w;
+    float sum;
+    bool changed = false;
+
+    this->clear_candidates();
+
+    if (prune_neighbors || lsh_bands > 0 || query_features->empty() || acts.empty() || query_features->front()->weights_depend_on_query())
+        return(false);
+
+    // base weights of all endpoints, feature by feature (rebuilt if any slot has changed)
+    feat = query_features->front();
+    fused_slots.resize(nr_endpoints, -1);
+    fused_generations.resize(nr_endpoints, 0);
+    for (int e = 0; e < nr_endpoints; e++) {
+        int slot = feat->get_base_slot(feat->get_endpoint(acts[e]));
+        if (slot < 0 || !feat->get_slot_weights(slot, &nr) || (e > 0 && nr != nr_weights))
+            return(false);
+        nr_weights = nr;
+        if (slot != fused_slots[e] || feat->get_weight_generation(slot) != fused_generations[e]) {
+            fused_slots[e] = slot;
+            fused_generations[e] = feat->get_weight_generation(slot);
+            changed = true;
+        }
+    }
+    if (nr_weights == 0)
+        return(false);
+    if (changed || (int) fused_weights.size() != nr_weights * nr_endpoints) {
+        fused_weights.resize((size_t) nr_weights * nr_endpoints);
+        for (int e = 0; e < nr_endpoints; e++) {
+            w = feat->get_slot_weights(fused_slots[e], &nr);
+            for (int f = 0; f < nr_weights; f++)
+                fused_weights[(size_t) f * nr_endpoints + e] = w[f];
+        }
+    }
+
+    fused.nr_endpoints = nr_endpoints;
+    fused.weights = &fused_weights[0];
+    fused.query_weight.assign(nr_endpoints, 0);
+    fused.query_nr.assign(nr_endpoints, 0);
+    fused.ids.clear();
+    fused.lens.clear();
+    fused_query.assign(nr_weights, 0);
+    fused.in_query = &fused_query[0];
+
+    // query weights and the postings of the query features that are significant for any endpoint
+    for (cur_feat = query_features->begin(); cur_feat != query_features->end(); cur_feat++) {
+        id = (*cur_feat)->get_id();
+        if (id < 0 || id >= nr_weights)
+            return(false);
+        fused_query[id] = 1;
+        w = &fused_weights[(size_t) id * nr_endpoints];
+        sum = 0;
+        for (int e = 0; e < nr_endpoints; e++) {
+            fused.query_weight[e] += w[e];
+            if (w[e] > 0) fused.query_nr[e]++;
+            sum += w[e];
+        }
+        if (sum > 0) {
+            matches = (*cur_feat)->get_matches_ptr();
+            for (cur_m = matches->begin(); cur_m != matches->end(); cur_m++) {
+                if (common_weights[*cur_m] == 0)
+                    candidates.push_back(*cur_m);
+                common_weights[*cur_m] += sum;
+            }
+        }
+    }
+
+    for (unsigned int i = 0; i < candidates.size(); i++) {
+        feature_ids = compounds[candidates[i]]->get_feature_ids();
+        if (!feature_ids->empty() && feature_ids->back() >= nr_weights)
+            return(false);	// features without weights
+        fused.ids.push_back(feature_ids->empty() ? NULL : &(*feature_ids)[0]);
+        fused.lens.push_back(feature_ids->size());
+    }
+
+    fused.init();
+    run_parallel(&fused, fused.get_nr_chunks(), nr_threads);
+    fused_acts = acts;
+    return(true);
+
+};
+
+template <class MolType, class FeatureType, class ActivityType>
+bool MolVect<MolType, FeatureType, ActivityType>::select_endpoint(string act) {
+
+    int nr = candidates.size();
+    int e = find(fused_acts.begin(), fused_acts.end(), act) - fused_acts.begin();
+    int ep = activity_store.get_id(act);
+    const float * sims;
+
+    if (e == (int) fused_acts.size())
+        return(false);
+
+    selection.clear();
+    selection_act = act;
+    if (nr == 0)
+        return(true);
+    sims = &fused.sims[(size_t) e * nr];
+    for (int i = 0; i < nr; i++) {
+        compounds[candidates[i]]->set_similarity(sims[i]);
+        if (ep >= 0 && activity_store.is_available(ep, candidates[i]))
+            selection.add(sims[i], candidates[i]);
+    }
+    return(true);
+
 };
 
 template <class MolType, class FeatureType, class ActivityType>
 void MolVect<MolType, FeatureType, ActivityType>::get_neighbors(string act, vector<sMolRef>* neighbors) {
 
-    typename vector<sMolRef>::iterator cur_mol;
+    int ep = activity_store.get_id(act);
+    int nr_compounds = compounds.size();
     neighbors->clear();
+    nr_pruned = 0;
+    lsh_recall = -1;
+
+    if (ep < 0)		// no activities for act
+        return;
+
+    if (lsh_check) {
+        sMolRef check = lsh_check;
+        lsh_check.reset();
+        this->get_neighbors(act, neighbors);
+        this->measure_recall(check, act, ep, neighbors);
+        return;
+    }
 
+    if (pending_query && pending_act == act) {
+        sMolRef test = pending_query;
+        pending_query.reset();
+        if (this->get_pruned_neighbors(test, act, ep, neighbors))
+            return;
+    }
 
-    multimap<float,sMolRef> sim_sorted_neighbors;
-    sim_sorted_neighbors.clear();
-    for (cur_mol=compounds.begin();cur_mol!=compounds.end();cur_mol++) {
-        if ((*cur_mol)->is_available(act)) {
-            float sim = (*cur_mol)->get_similarity();
-            sim_sorted_neighbors.insert(sim_sorted_neighbors.end(),pair<float, sMolRef>(sim,(*cur_mol)));
+    // best candidates of relevant_features(): valid unless compounds without common features (similarity 0) would be selected
+    if (selection_act == act) {
+        int nr_available = activity_store.count_available(ep);
+        selection_act.clear();
+        const vector<pair<float, int> > & merged = selection.select(neighbor_cutoff, min_neighbors, nr_available);
+        if (merged.empty() || ((int) merged.size() >= min(min_neighbors, nr_available - 1) && merged.back().first > 0)) {
+            for (unsigned int i = 0; i < merged.size(); i++)
+                neighbors->push_back(compounds[merged[i].second]);
+            return;
+        }
+    }
+
+    selection.clear();
+    for (int n = 0; n < nr_compounds; n++)
+        if (activity_store.is_available(ep, n))
+            selection.add(compounds[n]->get_similarity(), n);
+
+    // the least similar compound is never a neighbor
+    const vector<pair<float, int> > & selected = selection.select(neighbor_cutoff, min_neighbors);
+    for (unsigned int i = 0; i < selected.size(); i++)
+        neighbors->push_back(compounds[selected[i].second]);
+
+};
+
+
+template <class MolType, class FeatureType, class ActivityType>
+const vector<double> & MolVect<MolType, FeatureType, ActivityType>::get_masses(int slot, Feature<FeatureType> * feat) {
+
+    Masses & m = masses[slot];
+    unsigned int generation = feat->get_weight_generation(slot);
+    int nr_compounds = compounds.size();
+    vector<Feature<FeatureType> *> * feats;
+    typename vector<Feature<FeatureType> *>::iterator cur_feat;
+
+    if (m.generation != generation || (int) m.mass.size() != nr_compounds) {
+        m.generation = generation;
+        m.mass.assign(nr_compounds, 0);
+        m.nr_features.assign(nr_compounds, -1);
+    }
+
+    // sum again for compounds whose features have changed
+    for (int n = 0; n < nr_compounds; n++) {
+        feats = compounds[n]->get_sorted_features();
+        if (m.nr_features[n] != (int) feats->size()) {
+            m.mass[n] = 0;
+            for (cur_feat = feats->begin(); cur_feat != feats->end(); cur_feat++)
+                m.mass[n] += (*cur_feat)->get_slot_weight(slot);
+            m.nr_features[n] = feats->size();
         }
     }
-    typename multimap<float,sMolRef>::iterator cur_sn;
+    return(m.mass);
+
+};
+
+template <class MolType, class FeatureType, class ActivityType>
+void MolVect<MolType, FeatureType, ActivityType>::prepare_scorer(sMolRef test, string act, int ep) {
+
+    vector<Feature<FeatureType> *> * query_features = test->get_sorted_features();
+    typename vector<Feature<FeatureType> *>::iterator cur_feat;
+    int slot;
+    int nr = 0;
+    int id;
+    float w;
+    const float * base = NULL;
+
+    if (!scorer)
+        scorer.reset(new SimilarityScorer<MolType, FeatureType, ActivityType>());
+    scorer->compounds = &compounds;
+    scorer->test = test;
+    scorer->act = act;
+    scorer->query_w = NULL;
+    scorer->other_w = NULL;
+    scorer->nr_weights = 0;
+    scorer->query_weight = 0;
+    scorer->query_nr = 0;
+
+    if (query_features->empty())
+        return;
+
+    slot = query_features->front()->get_base_slot(ep);
+    base = query_features->front()->get_slot_weights(slot, &nr);
+    if (!base)
+        return;
+
+    if (slot != block_slot || query_features->front()->get_weight_generation(slot) != block_generation || (int) block_other.size() != nr) {
+        block_slot = slot;
+        block_generation = query_features->front()->get_weight_generation(slot);
+        block_other.assign(base, base + nr);
+        block_query.assign(nr, 0);
+    }
 
-    // cutoff 0.3 ~ (1/100)^(1/4), i.e. 100 compounds of similarity 0.3 are needed to compensate 1 compound of sim
-    cur_sn = sim_sorted_neighbors.end();
-    cur_sn--;
-    while ((cur_sn != sim_sorted_neighbors.begin()) && (cur_sn->second->get_similarity()>0.3)) {
-        if (cur_sn->second->is_available(act)) {
-            neighbors->push_back(cur_sn->second);
+    for (cur_feat = query_features->begin(); cur_feat != query_features->end(); cur_feat++) {
+        w = (*cur_feat)->get_weight(ep);
+        scorer->query_weight += w;
+        if (w > 0) scorer->query_nr++;
+        id = (*cur_feat)->get_id();
+        if (id >= 0 && id < nr) {
+            block_query[id] = w;
+            block_other[id] = 0;
         }
-        cur_sn--;
     }
+    scorer->query_w = &block_query[0];
+    scorer->other_w = &block_other[0];
+    scorer->nr_weights = nr;
 
-    // * Comment this out to revert to original Lazar implementation *
-    unsigned int min_n = 5;
-    if (!quantitative) min_n=5;
+};
+
+template <class MolType, class FeatureType, class ActivityType>
+void MolVect<MolType, FeatureType, ActivityType>::release_scorer() {
 
-    if ((cur_sn != sim_sorted_neighbors.begin()) && (neighbors->size() < min_n) && (neighbors->size() > 0)) {
-        do {
-            if (cur_sn->second->is_available(act)) {
-                neighbors->push_back(cur_sn->second);
+    vector<Feature<FeatureType> *> * query_features = scorer->test->get_sorted_features();
+    typename vector<Feature<FeatureType> *>::iterator cur_feat;
+    int id;
+
+    if (scorer->query_w) {
+        for (cur_feat = query_features->begin(); cur_feat != query_features->end(); cur_feat++) {
+            id = (*cur_feat)->get_id();
+            if (id >= 0 && id < scorer->nr_weights) {
+                block_query[id] = 0;
+                block_other[id] = (*cur_feat)->get_slot_weight(block_slot);
             }
-            cur_sn--;
-        } while ((neighbors->size() < min_n) && (cur_sn != sim_sorted_neighbors.begin()));
+        }
     }
-    // *                                                             *
+    scorer->test.reset();
 
 };
 
+template <class MolType, class FeatureType, class ActivityType>
+void MolVect<MolType, FeatureType, ActivityType>::precompute_similarities(string act) {
+
+    SimilarityMatrixFiller filler;
+    Feature<FeatureType> * feat = NULL;
+    vector<int> * feature_ids;
+    int nr = compounds.size();
+    int slot;
+    unsigned int generation;
+    uint64_t fingerprint = 14695981039346656037ULL;	// FNV-1a of nr, slot, weights and feature ids
+    bool filled;
+    ostringstream file;
+
+    if (!sim_cache || sim_matrix.empty() || nr == 0)
+        return;
+
+    for (int n = 0; n < nr && !feat; n++)
+        if (!compounds[n]->get_sorted_features()->empty())
+            feat = compounds[n]->get_sorted_features()->front();
+    if (!feat || feat->weights_depend_on_query())	// LOO weights depend on the test structure
+        return;
+    if (nr > max_dense_compounds) {
+        *out << "Too many compounds (" << nr << ") for a similarity matrix, using the cache only.\n";
+        out->print_err();
+        return;
+    }
+    slot = feat->get_base_slot(feat->get_endpoint(act));
+    if (slot < 0)
+        return;
+    filler.weights = feat->get_slot_weights(slot, &filler.nr_weights);
+    if (!filler.weights || filler.nr_weights == 0)
+        return;
+    generation = feat->get_weight_generation(slot);
+    if (sim_cache->has_dense(slot, generation))
+        return;
+
+    for (int n = 0; n < nr; n++) {
+        feature_ids = compounds[n]->get_feature_ids();
+        if (!feature_ids->empty() && feature_ids->back() >= filler.nr_weights)
+            return;	// features without weights
+        filler.ids.push_back(feature_ids->empty() ? NULL : &(*feature_ids)[0]);
+        filler.lens.push_back(feature_ids->size());
+    }
+
+    for (int k = 0; k < 2; k++) {
+        int v = k ? slot : nr;
+        for (unsigned int b = 0; b < sizeof(v); b++)
+            fingerprint = (fingerprint ^ ((v >> (8 * b)) & 0xff)) * 1099511628211ULL;
+    }
+    for (int f = 0; f < filler.nr_weights; f++) {
+        const unsigned char * bytes = (const unsigned char *) &filler.weights[f];
+        for (unsigned int b = 0; b < sizeof(float); b++)
+            fingerprint = (fingerprint ^ bytes[b]) * 1099511628211ULL;
+    }
+    for (int n = 0; n < nr; n++) {
+        fingerprint = (fingerprint ^ (unsigned int) filler.lens[n]) * 1099511628211ULL;
+        for (int j = 0; j < filler.lens[n]; j++)
+            fingerprint = (fingerprint ^ (unsigned int) filler.ids[n][j]) * 1099511628211ULL;
+    }
+
+    file << sim_matrix << "." << slot;
+    filler.dense = sim_cache->map_dense(slot, generation, nr, fingerprint, file.str(), &filled);
+    if (!filler.dense) {
+        *out << "Could not map similarity matrix " << file.str() << ", using the cache only.\n";
+        out->print_err();
+        return;
+    }
+    if (!filled) {
+        filler.init(nr_threads);
+        run_parallel(&filler, nr, nr_threads);
+    }
+    sim_cache->finish_dense(slot);
+
+};
+
+template <class MolType, class FeatureType, class ActivityType>
+void MolVect<MolType, FeatureType, ActivityType>::lsh_candidates(sMolRef test, int ep, vector<int> * cands) {
+
+    vector<Feature<FeatureType> *> * feats = test->get_sorted_features();
+    typename vector<Feature<FeatureType> *>::iterator cur_feat;
+    Feature<FeatureType> * first = feats->front();
+    int slot = first->get_base_slot(ep);
+    vector<int> ids;
+
+    if (!lsh || slot != lsh_slot || first->get_weight_generation(slot) != lsh_generation || (int) compounds.size() != lsh_nr_compounds) {
+        if (!lsh) lsh.reset(new LshIndex(lsh_bands, lsh_rows));
+        lsh->clear();
+        lsh_slot = slot;
+        lsh_generation = first->get_weight_generation(slot);
+        lsh_nr_compounds = compounds.size();
+        for (int n = 0; n < lsh_nr_compounds; n++) {
+            ids.clear();
+            feats = compounds[n]->get_sorted_features();
+            for (cur_feat = feats->begin(); cur_feat != feats->end(); cur_feat++)
+                if ((*cur_feat)->get_slot_weight(slot) > 0)
+                    ids.push_back((*cur_feat)->get_id());
+            lsh->add(n, ids.empty() ? NULL : &ids[0], ids.size());
+        }
+    }
+
+    ids.clear();
+    feats = test->get_sorted_features();
+    for (cur_feat = feats->begin(); cur_feat != feats->end(); cur_feat++)
+        if ((*cur_feat)->get_weight(ep) > 0)
+            ids.push_back((*cur_feat)->get_id());
+    lsh->query(ids.empty() ? NULL : &ids[0], ids.size(), cands);
+
+};
+
+template <class MolType, class FeatureType, class ActivityType>
+void MolVect<MolType, FeatureType, ActivityType>::measure_recall(sMolRef test, string act, int ep, vector<sMolRef>* neighbors) {
+
+    vector<Feature<FeatureType> *> * query_features = test->get_sorted_features();
+    typename vector<Feature<FeatureType> *>::iterator cur_feat;
+    typename vector<sMolRef>::iterator cur_n;
+    vector<int> * matches;
+    vector<int>::iterator cur_m;
+    vector<char> seen(compounds.size(), 0);
+    vector<int> cands;
+    vector<float> sims;
+    NeighborSelection exact;
+    int feat_ep;
+    int hits = 0;
+    int nr_exact = 0;
+
+    if (query_features->empty())
+        return;
+
+    // exact neighbors from the postings of the significant query features
+    feat_ep = query_features->front()->get_endpoint(act);
+    for (cur_feat = query_features->begin(); cur_feat != query_features->end(); cur_feat++) {
+        if ((*cur_feat)->get_weight(feat_ep) > 0) {
+            matches = (*cur_feat)->get_matches_ptr();
+            for (cur_m = matches->begin(); cur_m != matches->end(); cur_m++) {
+                if (!seen[*cur_m] && activity_store.is_available(ep, *cur_m))
+                    cands.push_back(*cur_m);
+                seen[*cur_m] = 1;
+            }
+        }
+    }
+    if (cands.empty())
+        return;
+    sims.resize(cands.size());
+    this->prepare_scorer(test, act, feat_ep);
+    scorer->score(&cands[0], cands.size(), &sims[0]);
+    this->release_scorer();
+    for (unsigned int i = 0; i < cands.size(); i++)
+        exact.add(sims[i], cands[i]);
+
+    // compare the neighbors with similarity > 0
+    seen.assign(compounds.size(), 0);
+    for (cur_n = neighbors->begin(); cur_n != neighbors->end(); cur_n++)
+        seen[(*cur_n)->get_line_nr()] = 1;
+    const vector<pair<float, int> > & selected = exact.select(neighbor_cutoff, min_neighbors, activity_store.count_available(ep));
+    for (unsigned int i = 0; i < selected.size(); i++) {
+        if (selected[i].first > 0) {
+            nr_exact++;
+            if (seen[selected[i].second]) hits++;
+        }
+    }
+    if (nr_exact == 0)
+        return;
+
+    lsh_recall = (double) hits / nr_exact;
+    lsh_recall_sum += lsh_recall;
+    lsh_nr_samples++;
+
+};
+
+template <class MolType, class FeatureType, class ActivityType>
+bool MolVect<MolType, FeatureType, ActivityType>::get_pruned_neighbors(sMolRef test, string act, int ep, vector<sMolRef>* neighbors) {
+
+    // The union of the query and compound n contains all query features (with their weights in the
+    // current LOO state) and the remaining features of n (with their base weights), i.e.
+    //   sim(n) = common / (query_weight + mass(n) - shared(n))
+    // The sums are exact up to rounding, which is covered by a relative slack. A compound can be
+    // skipped if its bound does not pass the cutoff and min_neighbors compounds are known to be more similar.
+
+    const vector<double> & mass = this->get_masses(pending_slot, test->get_sorted_features()->front());
+    int nr_available = activity_store.count_available(ep);
+    int nq = test->get_sorted_features()->size();
+    vector<int>::iterator cur_c;
+    unsigned int i;
+    int n;
+    float sim;
+
+    this->prepare_scorer(test, act, test->get_sorted_features()->front()->get_endpoint(act));
+
+    scan.clear();
+    for (cur_c = candidates.begin(); cur_c != candidates.end(); cur_c++) {
+        if (bound_common[*cur_c] > 0 && activity_store.is_available(ep, *cur_c))
+            scan.add(BoundedScan::bound(bound_common[*cur_c], query_weight, mass[*cur_c], bound_shared[*cur_c], nq + compounds[*cur_c]->get_sorted_features()->size()), *cur_c);
+    }
+    scan.start();
+
+    selection.clear();
+    while (scan.next(neighbor_cutoff, min_neighbors, &n)) {
+        scorer->score(&n, 1, &sim);
+        compounds[n]->set_similarity(sim);
+        selection.add(sim, n);
+        scan.scored(sim, min_neighbors);
+    }
+    nr_pruned = scan.get_nr_skipped();
+    this->release_scorer();
+
+    if (nr_pruned == 0)		// all similarities are known
+        return(false);
+
+    // pruned and unscored compounds rank below the min_neighbors best
+    const vector<pair<float, int> > & selected = selection.select(neighbor_cutoff, min_neighbors, nr_available);
+    for (i = 0; i < selected.size(); i++)
+        neighbors->push_back(compounds[selected[i].second]);
+    return(true);
+
+};
 
 template <class MolType, class FeatureType, class ActivityType>
 void MolVect<MolType, FeatureType, ActivityType>::determine_unknown(string act, sMolRef test) {
@@ -288,8 +1449,9 @@ void MolVect<MolType, FeatureType, ActivityType>::determine_unknown(string act,
     vector<Feature<FeatureType> *> feats = test->get_features();
     typename vector<Feature<FeatureType> *>::iterator cur_feat;
     bool act_m;
-    vector<int> matches;
+    vector<int> * matches;
     vector<int>::iterator cur_m;
+    int ep = activity_store.get_id(act);
 
     test->delete_unknown();
     //test->delete_infrequent();
@@ -298,9 +1460,9 @@ void MolVect<MolType, FeatureType, ActivityType>::determine_unknown(string act,
 
         // find features without activity values for the current activity
         act_m = false;
-        matches = (*cur_feat)->get_matches();
-        for (cur_m=matches.begin();cur_m!=matches.end();cur_m++) {
-            if (compounds[*cur_m]->is_available(act)) {
+        matches = (*cur_feat)->get_matches_ptr();
+        for (cur_m=matches->begin();cur_m!=matches->end();cur_m++) {
+            if (activity_store.is_available(ep, *cur_m)) {
                 act_m = true;
                 break;
             }
@@ -316,12 +1478,12 @@ void MolVect<MolType, FeatureType, ActivityType>::determine_unknown(string act,
 template <class MolType, class FeatureType, class ActivityType>
 vector<string>  MolVect<MolType, FeatureType, ActivityType>::get_idfromsmi(string smi) {
 
-    typename vector<MolRef>::iterator cur_mol;
     vector<string> ids;
+    typename unordered_map<string, vector<int> >::iterator found = smiles_index.find(smi);
 
-    for (cur_mol=compounds.begin(); cur_mol!= compounds.end(); cur_mol++) {
-        if ((*cur_mol)->get_smiles()==smi)
-            ids.push_back((*cur_mol)->get_id());
+    if (found != smiles_index.end()) {
+        for (vector<int>::iterator n = found->second.begin(); n != found->second.end(); n++)
+            ids.push_back(compounds[*n]->get_id());
     }
     return(ids);
 };
@@ -329,12 +1491,12 @@ vector<string>  MolVect<MolType, FeatureType, ActivityType>::get_idfromsmi(strin
 template <class MolType, class FeatureType, class ActivityType>
 vector<string>  MolVect<MolType, FeatureType, ActivityType>::get_idfrominchi(string inchi) {
 
-    typename vector<sMolRef>::iterator cur_mol;
     vector<string> ids;
+    typename unordered_map<string, vector<int> >::iterator found = inchi_index.find(inchi);
 
-    for (cur_mol=compounds.begin(); cur_mol!= compounds.end(); cur_mol++) {
-        if ((*cur_mol)->get_inchi()==inchi)
-            ids.push_back((*cur_mol)->get_id());
+    if (found != inchi_index.end()) {
+        for (vector<int>::iterator n = found->second.begin(); n != found->second.end(); n++)
+            ids.push_back(compounds[*n]->get_id());
     }
     return(ids);
 };
@@ -342,23 +1504,24 @@ vector<string>  MolVect<MolType, FeatureType, ActivityType>::get_idfrominchi(str
 template <class MolType, class FeatureType, class ActivityType>
 shared_ptr<FeatMol<MolType, FeatureType, ActivityType > > MolVect<MolType, FeatureType, ActivityType>::get_molfromid(string id) {
 
-    typename vector<sMolRef>::iterator cur_mol;
+    typename unordered_map<string, int>::iterator found = id_index.find(id);
 
-    for (cur_mol=compounds.begin(); cur_mol!= compounds.end(); cur_mol++) {
-        if ((*cur_mol)->get_id()==id)
-            break;
-    }
-
-    if (cur_mol == compounds.end())
+    if (found == id_index.end())
         return(sMolRef());
     else
-        return(*cur_mol);
+        return(compounds[found->second]);
 
 };
 
 template <class MolType, class FeatureType, class ActivityType>
 int MolVect<MolType, FeatureType, ActivityType>::get_linenrfromid(string id) {
-	return id2line_map[id];
+
+    typename unordered_map<string, int>::iterator found = id_index.find(id);
+
+    if (found == id_index.end())
+        return(0);
+    else
+        return(compounds[found->second]->get_line_nr());
 };
 
 #endif
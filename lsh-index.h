@@ -0,0 +1,110 @@
+/* Copyright (C) 2005  Christoph Helma <helma@in-silico.de>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+
+*/
+
+#ifndef LSH_INDEX_H
+#define LSH_INDEX_H
+
+#include <vector>
+#include <algorithm>
+#include <stdint.h>
+
+#include "boost/unordered_map.hpp"
+
+using namespace std;
+using namespace boost;
+
+//! MinHash signatures of feature id sets in an LSH banding index
+//
+// The signature of a set has bands * rows minima of independent hashes of the
+// feature ids. Each band of rows minima is hashed into a bucket of its own table,
+// two sets with Jaccard similarity J share at least one bucket with probability
+// 1 - (1 - J^rows)^bands. More bands raise the recall, more rows reduce the
+// number of candidates.
+class LshIndex {
+
+private:
+
+    int bands;
+    int rows;
+    vector<uint64_t> seeds;	// one per hash function
+    vector<unordered_map<uint64_t, vector<int> > > tables;	// tables[band][bucket] = compounds
+
+    static uint64_t mix(uint64_t x) {	// 64 bit finalizer of MurmurHash3
+        x ^= x >> 33;
+        x *= 0xff51afd7ed558ccdULL;
+        x ^= x >> 33;
+        x *= 0xc4ceb9fe1a85ec53ULL;
+        x ^= x >> 33;
+        return(x);
+    };
+
+    //! bucket keys of the bands of the set ids[0] .. ids[nr-1] (nr > 0)
+    void get_keys(const int * ids, int nr, vector<uint64_t> * keys) {
+        vector<uint64_t> minima(bands * rows, ~(uint64_t) 0);
+        for (int i = 0; i < nr; i++)
+            for (int h = 0; h < bands * rows; h++)
+                minima[h] = min(minima[h], mix(ids[i] ^ seeds[h]));
+        keys->assign(bands, 0);
+        for (int b = 0; b < bands; b++)
+            for (int r = 0; r < rows; r++)
+                (*keys)[b] = mix((*keys)[b] ^ minima[b * rows + r]);
+    };
+
+public:
+
+    LshIndex(int bands, int rows): bands(bands), rows(rows), tables(bands) {
+        uint64_t seed = 0x9e3779b97f4a7c15ULL;
+        for (int h = 0; h < bands * rows; h++) {
+            seed = mix(seed + h);
+            seeds.push_back(seed);
+        }
+    };
+
+    void clear() {
+        for (int b = 0; b < bands; b++)
+            tables[b].clear();
+    };
+
+    //! index compound n with the feature ids ids[0] .. ids[nr-1] (empty sets are not indexed)
+    void add(int n, const int * ids, int nr) {
+        vector<uint64_t> keys;
+        if (nr == 0) return;
+        this->get_keys(ids, nr, &keys);
+        for (int b = 0; b < bands; b++)
+            tables[b][keys[b]].push_back(n);
+    };
+
+    //! compounds that share a bucket with the set ids[0] .. ids[nr-1], sorted and without duplicates
+    void query(const int * ids, int nr, vector<int> * candidates) {
+        vector<uint64_t> keys;
+        unordered_map<uint64_t, vector<int> >::iterator found;
+        candidates->clear();
+        if (nr == 0) return;
+        this->get_keys(ids, nr, &keys);
+        for (int b = 0; b < bands; b++) {
+            found = tables[b].find(keys[b]);
+            if (found != tables[b].end())
+                candidates->insert(candidates->end(), found->second.begin(), found->second.end());
+        }
+        sort(candidates->begin(), candidates->end());
+        candidates->erase(unique(candidates->begin(), candidates->end()), candidates->end());
+    };
+
+};
+
+#endif
@@ -177,8 +177,6 @@ void Model<MolType,FeatureType,ActivityType>::calculate_prediction(shared_ptr<Fe
     vector<Feature<RegrFeat>*> lrf;
     vector<Feature<RegrFeat>*>* lr_features = &lrf;
     multimap<float, RegrFeat*> msf;
-    multimap<float,shared_ptr<FeatMol<MolType,RegrFeat,float> > > ssn;
-    multimap<float,shared_ptr<FeatMol<MolType,RegrFeat,float> > >* sim_sorted_neighbors = &ssn;
 
     // iterators
     typename sRegrMolVect::iterator cur_n;
@@ -196,18 +194,11 @@ void Model<MolType,FeatureType,ActivityType>::calculate_prediction(shared_ptr<Fe
 
     // primitive data types
     unsigned int no_r, no_c;
-    float sim;
     double chisq, y_est, y_err;
 
     if (neighbors->size()) {
 
-        // sort neighbors by similarity
-        sim_sorted_neighbors->clear();
-        for (cur_n = neighbors->begin(); cur_n != neighbors->end(); cur_n++) {
-            sim = (*cur_n)->get_similarity();
-            sim_sorted_neighbors->insert(pair<float, shared_ptr<FeatMol<MolType,RegrFeat,float> > >(sim,*cur_n));
-        }
-        test->extract_neighbors(neighbors, sim_sorted_neighbors);
+        // neighbors are sorted by similarity (MolVect::get_neighbors())
 
         // calculate confidence
         float confidence = test->calculate_confidence(neighbors, act);
@@ -483,8 +474,6 @@ void KernelModel<MolType,FeatureType,ActivityType>::calculate_prediction(shared_
     vector<Feature<RegrFeat>*> lrf;
     vector<Feature<RegrFeat>*>* lr_features = &lrf;
     multimap<float, RegrFeat*> msf;
-    multimap<float,shared_ptr<FeatMol<MolType,RegrFeat,float> > > ssn;
-    multimap<float,shared_ptr<FeatMol<MolType,RegrFeat,float> > >* sim_sorted_neighbors = &ssn;
 
 
     // iterators
@@ -494,17 +483,11 @@ void KernelModel<MolType,FeatureType,ActivityType>::calculate_prediction(shared_
     gsl_vector* y;
 
     // primitive data types
-    float confidence, sim;
+    float confidence;
 
     if (neighbors->size()) {
 
-        // sort neighbors by similarity
-        sim_sorted_neighbors->clear();
-        for (cur_n = neighbors->begin(); cur_n != neighbors->end(); cur_n++) {
-            sim = (*cur_n)->get_similarity();
-            sim_sorted_neighbors->insert(pair<float, shared_ptr<FeatMol<MolType,RegrFeat,float> > >(sim,*cur_n));
-        }
-        test->extract_neighbors(neighbors, sim_sorted_neighbors);
+        // neighbors are sorted by similarity (MolVect::get_neighbors())
 
         // calculate confidence
         confidence = test->calculate_confidence(neighbors, act);
@@ -0,0 +1,149 @@
+/* Copyright (C) 2005  Christoph Helma <helma@in-silico.de>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+
+*/
+
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <stdlib.h>
+
+#include "similarity.h"
+#include "neighbor-selection.h"
+
+using namespace std;
+
+//! neighbors of pruned scans (MolVect::get_pruned_neighbors()) compared with exhaustive scans on random training sets
+//
+// The query features have weights of a LOO state, all other features their base weights. Weights
+// are multiples of 1/8 with many zeros, so that similarities tie and fall on the cutoff.
+int main(int argc, char *argv[]) {
+
+    int nr_queries = argc > 1 ? atoi(argv[1]) : 20000;
+    int nr_tests = 0;
+    int nr_pruned = 0;
+    int nr_skipped = 0;
+    int nr_diff = 0;
+
+    if (nr_queries < 1) {
+        cerr << "usage: " << argv[0] << " [queries]\n";
+        return(1);
+    }
+
+    srand(1);
+    for (int q = 0; q < nr_queries; q++) {
+
+        int nr_compounds = 2 + rand() % 300;
+        int nr_features = 1 + rand() % 200;
+        int nr_per_compound = 1 + rand() % 20;
+        vector<vector<int> > features(nr_compounds);
+        vector<const int *> ids(nr_compounds);
+        vector<int> lens(nr_compounds);
+        vector<bool> available(nr_compounds);
+        vector<float> base(nr_features);
+        vector<float> query_w(nr_features, 0);
+        vector<float> other_w(nr_features);
+        vector<bool> in_query(nr_features, false);
+        vector<float> sims(nr_compounds);
+        vector<double> common(nr_compounds, 0);
+        vector<double> shared(nr_compounds, 0);
+        vector<double> mass(nr_compounds, 0);
+        float query_weight = 0;
+        int query_nr = 0;
+        int nq = 0;
+        int nr_available = 0;
+        NeighborSelection exhaustive;
+        NeighborSelection pruned;
+        BoundedScan scan;
+        int n;
+        float sim;
+
+        for (int f = 0; f < nr_features; f++) {
+            base[f] = (rand() % 3 == 0) ? 0 : (rand() % 9) / 8.0;
+            if (rand() % 4 == 0) {
+                in_query[f] = true;
+                query_w[f] = (rand() % 2) ? base[f] : (rand() % 9) / 8.0;	// LOO state
+                query_weight += query_w[f];
+                if (query_w[f] > 0) query_nr++;
+                nq++;
+            }
+            other_w[f] = in_query[f] ? 0 : base[f];
+        }
+
+        for (n = 0; n < nr_compounds; n++) {
+            int len = rand() % (2 * nr_per_compound);
+            for (int j = 0; j < len; j++)
+                features[n].push_back(rand() % nr_features);
+            sort(features[n].begin(), features[n].end());
+            features[n].erase(unique(features[n].begin(), features[n].end()), features[n].end());
+            features[n].push_back(nr_features);	// keeps &features[n][0] valid
+            ids[n] = &features[n][0];
+            lens[n] = features[n].size() - 1;
+            available[n] = rand() % 8 != 0;
+            if (available[n]) nr_available++;
+            for (int j = 0; j < lens[n]; j++) {
+                int f = ids[n][j];
+                mass[n] += base[f];
+                if (in_query[f]) {
+                    common[n] += query_w[f];
+                    shared[n] += base[f];
+                }
+            }
+        }
+
+        // exhaustive: all similarities (MolVect::get_neighbors() without prune_neighbors)
+        weighted_tanimoto_block(&query_w[0], &other_w[0], query_weight, query_nr, &ids[0], &lens[0], nr_compounds, &sims[0]);
+        for (n = 0; n < nr_compounds; n++)
+            if (available[n])
+                exhaustive.add(sims[n], n);
+        const vector<pair<float, int> > & reference = exhaustive.select(neighbor_cutoff, min_neighbors);
+
+        // pruned: candidates with common features in the order of their bounds
+        for (n = 0; n < nr_compounds; n++)
+            if (common[n] > 0 && available[n])
+                scan.add(BoundedScan::bound(common[n], query_weight, mass[n], shared[n], nq + lens[n]), n);
+        scan.start();
+        while (scan.next(neighbor_cutoff, min_neighbors, &n)) {
+            weighted_tanimoto_block(&query_w[0], &other_w[0], query_weight, query_nr, &ids[n], &lens[n], 1, &sim);
+            pruned.add(sim, n);
+            scan.scored(sim, min_neighbors);
+        }
+        nr_tests++;
+        if (scan.get_nr_skipped() == 0)		// get_neighbors() falls back to the exhaustive scan
+            continue;
+        nr_pruned++;
+        nr_skipped += scan.get_nr_skipped();
+
+        const vector<pair<float, int> > & selected = pruned.select(neighbor_cutoff, min_neighbors, nr_available);
+        if (selected != reference) {
+            nr_diff++;
+            if (nr_diff <= 5) {
+                cerr << "query " << q << ": " << selected.size() << " neighbors, exhaustive " << reference.size() << "\n";
+                for (unsigned int i = 0; i < max(selected.size(), reference.size()); i++) {
+                    if (i < selected.size()) cerr << "  " << selected[i].second << " " << selected[i].first;
+                    else cerr << "  -";
+                    if (i < reference.size()) cerr << "\t" << reference[i].second << " " << reference[i].first;
+                    cerr << "\n";
+                }
+            }
+        }
+    }
+
+    cout << "queries: " << nr_tests << ", pruned: " << nr_pruned << ", skipped candidates: " << nr_skipped << "\n";
+    cout << "neighbor lists different from the exhaustive scan: " << nr_diff << "\n";
+
+    return(nr_diff > 0);
+}
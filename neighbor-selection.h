@@ -0,0 +1,186 @@
+/* Copyright (C) 2005  Christoph Helma <helma@in-silico.de>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+
+*/
+
+#ifndef NEIGHBOR_SELECTION_H
+#define NEIGHBOR_SELECTION_H
+
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include <queue>
+#include <float.h>
+
+using namespace std;
+
+// neighbor rule of MolVect::get_neighbors(), every reduce(), select() and BoundedScan of a query has to use it:
+// cutoff 0.3 ~ (1/100)^(1/4), i.e. 100 compounds of similarity 0.3 are needed to compensate 1 compound of sim
+// at least 5 neighbors if any compound passes the cutoff
+const double neighbor_cutoff = 0.3;
+const int min_neighbors = 5;
+
+//! top-k selection of neighbors from (similarity, compound index) pairs
+//
+// Candidates are ranked by similarity and then by index, both descending.
+// select() keeps all candidates above the cutoff, fills up to min_n candidates if
+// at least one is above the cutoff, and never keeps the least similar of all
+// nr_candidates compounds. Only the selected candidates are sorted
+// (nth_element + partial sort), the result is contiguous and in rank order.
+class NeighborSelection {
+
+private:
+
+    vector<pair<float, int> > ranked;
+
+    struct Above {
+        double cutoff;
+        Above(double cutoff): cutoff(cutoff) {};
+        bool operator() (const pair<float, int> & r) const {
+            return(r.first > cutoff);
+        };
+    };
+
+public:
+
+    void clear() {
+        ranked.clear();
+    };
+
+    void add(float sim, int n) {
+        ranked.push_back(make_pair(sim, n));
+    };
+
+    //! add the candidates of another selection (e.g. of another part of the training set)
+    void add(const NeighborSelection & other) {
+        ranked.insert(ranked.end(), other.ranked.begin(), other.ranked.end());
+    };
+
+    int size() {
+        return(ranked.size());
+    };
+
+    //! drop the candidates that select() with the same cutoff and min_n can never return, i.e. keep all above the cutoff and the best min_n
+    void reduce(double cutoff, int min_n) {
+        vector<pair<float, int> >::iterator mid = partition(ranked.begin(), ranked.end(), Above(cutoff));
+        int a = mid - ranked.begin();
+        int rest = 0;
+        if (a < min_n) {
+            rest = min(min_n - a, (int) (ranked.end() - mid));
+            nth_element(mid, mid + rest, ranked.end(), greater<pair<float, int> >());
+        }
+        ranked.resize(a + rest);
+    };
+
+    //! select the neighbors among nr_candidates compounds (the ones that have not been added are less similar than all added ones)
+    const vector<pair<float, int> > & select(double cutoff, int min_n, int nr_candidates) {
+
+        int a = 0;
+        int k;
+        vector<pair<float, int> >::iterator cur_r;
+
+        for (cur_r = ranked.begin(); cur_r != ranked.end(); cur_r++)
+            if (cur_r->first > cutoff) a++;
+        a = min(a, nr_candidates - 1);
+
+        if (a <= 0) {
+            ranked.clear();
+            return(ranked);
+        }
+
+        k = min(max(a, min(min_n, nr_candidates - 1)), (int) ranked.size());
+        if (k < (int) ranked.size())
+            nth_element(ranked.begin(), ranked.begin() + k, ranked.end(), greater<pair<float, int> >());
+        ranked.resize(k);
+        sort(ranked.begin(), ranked.end(), greater<pair<float, int> >());
+        return(ranked);
+    };
+
+    const vector<pair<float, int> > & select(double cutoff, int min_n) {
+        return(this->select(cutoff, min_n, ranked.size()));
+    };
+
+};
+
+//! exact scoring of neighbor candidates in the order of upper bounds of their similarities
+//
+// The candidates are added with upper bounds of their similarities and handed out by next()
+// in descending order of the bounds. The caller scores them exactly and reports the result with
+// scored(). The scan stops once a bound does not pass the cutoff and min_n scored candidates are
+// strictly more similar: no remaining candidate can be selected then, i.e. NeighborSelection::select()
+// of the scored candidates (with the number of all candidates) returns the same neighbors as
+// select() of all similarities.
+class BoundedScan {
+
+private:
+
+    vector<pair<double, int> > bounds;
+    priority_queue<float, vector<float>, greater<float> > best;	// min_n best similarities
+    unsigned int pos;
+
+public:
+
+    BoundedScan(): pos(0) {};
+
+    //! upper bound of the weighted Tanimoto similarity common / (query_weight + mass - shared), where
+    //! the sums have nr_terms terms in total; the relative slack covers their rounding errors
+    static double bound(double common, double query_weight, double mass, double shared, int nr_terms) {
+        double den = query_weight + mass - shared;
+        if (den <= 0)
+            return(1.0);
+        return(min(1.0, common / den * (1 + 4 * (nr_terms + 2) * FLT_EPSILON)));
+    };
+
+    void clear() {
+        bounds.clear();
+        best = priority_queue<float, vector<float>, greater<float> >();
+        pos = 0;
+    };
+
+    void add(double bound, int n) {
+        bounds.push_back(make_pair(bound, n));
+    };
+
+    //! sort the candidates by their bounds, call after all add() calls
+    void start() {
+        sort(bounds.begin(), bounds.end(), greater<pair<double, int> >());
+        pos = 0;
+    };
+
+    //! next candidate *n to score, returns false if the remaining candidates cannot be neighbors
+    bool next(double cutoff, int min_n, int * n) {
+        if (pos >= bounds.size())
+            return(false);
+        if (bounds[pos].first <= cutoff && (int) best.size() == min_n && best.top() > bounds[pos].first)
+            return(false);
+        *n = bounds[pos++].second;
+        return(true);
+    };
+
+    //! exact similarity of the last candidate of next()
+    void scored(float sim, int min_n) {
+        best.push(sim);
+        if ((int) best.size() > min_n) best.pop();
+    };
+
+    //! number of candidates that have not been scored
+    int get_nr_skipped() {
+        return(bounds.size() - pos);
+    };
+
+};
+
+#endif
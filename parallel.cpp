@@ -0,0 +1,96 @@
+/* Copyright (C) 2005  Christoph Helma <helma@in-silico.de>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+
+*/
+
+#include <pthread.h>
+#include <vector>
+
+#include "parallel.h"
+
+using namespace std;
+
+struct ParallelState {
+    ParallelJobs * jobs;
+    int nr_jobs;
+    int next_job;
+    pthread_mutex_t lock;
+};
+
+struct ParallelWorker {
+    ParallelState * state;
+    int thread_nr;
+};
+
+static void * parallel_worker(void * arg) {
+
+    ParallelWorker * worker = (ParallelWorker *) arg;
+    ParallelState * state = worker->state;
+    int job_nr;
+
+    for (;;) {
+        pthread_mutex_lock(&state->lock);
+        job_nr = state->next_job++;
+        pthread_mutex_unlock(&state->lock);
+
+        if (job_nr >= state->nr_jobs)
+            break;
+
+        state->jobs->run(worker->thread_nr, job_nr);
+    }
+
+    return NULL;
+}
+
+void run_parallel(ParallelJobs * jobs, int nr_jobs, int nr_threads) {
+
+    if (nr_threads > nr_jobs)
+        nr_threads = nr_jobs;
+
+    if (nr_threads <= 1) {
+        for (int n = 0; n < nr_jobs; n++)
+            jobs->run(0, n);
+        return;
+    }
+
+    ParallelState state;
+    state.jobs = jobs;
+    state.nr_jobs = nr_jobs;
+    state.next_job = 0;
+    pthread_mutex_init(&state.lock, NULL);
+
+    vector<ParallelWorker> workers(nr_threads);
+    vector<pthread_t> threads(nr_threads);
+    int nr_started = 0;
+
+    // thread 0 is the calling thread
+    for (int t = 0; t < nr_threads; t++) {
+        workers[t].state = &state;
+        workers[t].thread_nr = t;
+    }
+    for (int t = 1; t < nr_threads; t++) {
+        if (pthread_create(&threads[t], NULL, parallel_worker, &workers[t]) != 0)
+            break;	// continue with the threads we have
+        nr_started = t;
+    }
+
+    parallel_worker(&workers[0]);
+
+    for (int t = 1; t <= nr_started; t++)
+        pthread_join(threads[t], NULL);
+
+    pthread_mutex_destroy(&state.lock);
+}
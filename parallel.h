@@ -0,0 +1,38 @@
+/* Copyright (C) 2005  Christoph Helma <helma@in-silico.de>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+
+*/
+
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+//! a set of independent jobs, subclass and implement run()
+class ParallelJobs {
+
+public:
+
+    virtual ~ParallelJobs() {};
+
+    //! process job job_nr on thread thread_nr (0 .. nr_threads-1), must not touch data of other jobs
+    virtual void run(int thread_nr, int job_nr) = 0;
+
+};
+
+//! run jobs 0 .. nr_jobs-1 on a pool of nr_threads worker threads and wait until all are done
+//! (jobs are handed out in ascending order, nr_threads <= 1 runs them in the calling thread)
+void run_parallel(ParallelJobs * jobs, int nr_jobs, int nr_threads);
+
+#endif
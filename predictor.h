@@ -32,6 +32,10 @@ using namespace boost;
 
 extern bool kernel;
 extern bool quantitative;
+extern int window_size;
+extern bool prune_neighbors;
+extern int lsh_bands;
+extern bool fused_endpoints;
 
 //! make predictions from training data (structures, activities, features)
 template <class MolType, class FeatureType, class ActivityType>
@@ -63,34 +67,115 @@ private:
     char* a_file;
     //! make leave-one-out crossvalidation?
     bool loo;
+    //! test structure file for streaming batch predictions (window_size > 0)
+    char* test_file;
 		//! output object
 		shared_ptr<Out> out;
 
+    //! recalculate the significances of endpoint act, or only the outdated ones (not for LOO classification)
+    void refresh_significance(string act, bool recalculate);
+
 public:
 
     //! Predictor constructor for LOO
-    Predictor(char * structure_file, char * act_file, char * feat_file, shared_ptr<Out> out): a_file(NULL), loo(false), out(out) {
+    Predictor(char * structure_file, char * act_file, char * feat_file, shared_ptr<Out> out): a_file(NULL), loo(false), test_file(NULL), out(out) {
         train_structures.reset( new ActMolVect <MolType, FeatureType, ActivityType>(act_file, feat_file, structure_file, out) );
         if (kernel) model.reset( new KernelModel<MolType, FeatureType, ActivityType>(out) );
         else model.reset( new Model<MolType, FeatureType, ActivityType>(out) );
     };
 
     //! Predictor constructor for single SMILES prediction
-    Predictor(char * structure_file, char * act_file, char * feat_file, char * alphabet_file, shared_ptr<Out> out): a_file(alphabet_file), loo(false), out(out){
+    Predictor(char * structure_file, char * act_file, char * feat_file, char * alphabet_file, shared_ptr<Out> out): a_file(alphabet_file), loo(false), test_file(NULL), out(out){
         train_structures.reset( new ActMolVect <MolType, FeatureType, ActivityType>(act_file, feat_file, structure_file, out) );
         if (kernel) model.reset( new KernelModel<MolType, FeatureType, ActivityType>(out ));
         else model.reset(new Model<MolType, FeatureType, ActivityType>(out));
     }
 
     //! Predictor constructor for batch prediction
-    Predictor(char * structure_file, char * act_file, char * feat_file, char * alphabet_file, char * input_file, shared_ptr<Out> out): a_file(alphabet_file), loo(false), out(out){
+    Predictor(char * structure_file, char * act_file, char * feat_file, char * alphabet_file, char * input_file, shared_ptr<Out> out): a_file(alphabet_file), loo(false), test_file(NULL), out(out){
         train_structures.reset( new ActMolVect <MolType, FeatureType, ActivityType>(act_file, feat_file, structure_file, out) );
-        test_structures.reset( new MolVect <MolType, FeatureType, ActivityType>(input_file, out) );
+        this->read_test_structures(input_file);
         if (kernel) model.reset( new KernelModel<MolType, FeatureType, ActivityType>(out) );
         else model.reset( new Model<MolType, FeatureType, ActivityType>(out) );
     }
 
 
+    //! Predictor constructor for LOO from a training set snapshot
+    Predictor(char * snapshot_file, shared_ptr<Out> out): a_file(NULL), loo(false), test_file(NULL), out(out) {
+        this->read_snapshot(snapshot_file);
+        if (kernel) model.reset( new KernelModel<MolType, FeatureType, ActivityType>(out) );
+        else model.reset( new Model<MolType, FeatureType, ActivityType>(out) );
+    };
+
+    //! Predictor constructor for single SMILES and (with read_test_structures()) batch prediction from a training set snapshot
+    Predictor(char * snapshot_file, char * alphabet_file, shared_ptr<Out> out): a_file(alphabet_file), loo(false), test_file(NULL), out(out) {
+        this->read_snapshot(snapshot_file);
+        if (kernel) model.reset( new KernelModel<MolType, FeatureType, ActivityType>(out) );
+        else model.reset( new Model<MolType, FeatureType, ActivityType>(out) );
+    };
+
+    //! read the training set from a snapshot file (copied into the training set, the snapshot buffer is released afterwards)
+    void read_snapshot(char * snapshot_file) {
+        shared_ptr<Snapshot> snapshot( new Snapshot(snapshot_file, out) );
+        train_structures.reset( new ActMolVect <MolType, FeatureType, ActivityType>(snapshot.get(), out) );
+    };
+
+    //! save the training set as snapshot
+    void write_snapshot(char * snapshot_file) {
+        train_structures->write_snapshot(snapshot_file);
+    };
+
+    //! append structures, features and activities to the training set (feature file compound numbers refer to the lines of structure_file)
+    void append(char * structure_file, char * act_file, char * feat_file) {
+        train_structures->append(structure_file, act_file, feat_file);
+    };
+
+    //! append a single structure to the training set, returns false if the ID is not unique
+    bool add_compound(string id, string smiles) {
+        return(train_structures->add_compound(id, smiles) >= 0);
+    };
+
+    //! add a match of feature name to training compound id
+    bool add_feature_match(string name, string id) {
+        return(train_structures->add_feature_match(name, id));
+    };
+
+    //! add an activity value of endpoint act to training compound id
+    bool add_activity(string id, string act, ActivityType value) {
+        return(train_structures->add_activity(id, act, value));
+    };
+
+    //! total time spent to precompute similarity weights after significance calculations
+    float get_weight_secs() {
+        return(train_structures->get_weight_secs());
+    };
+
+    //! mean recall of the approximate (LSH) neighbors on the sampled predictions
+    double get_lsh_recall() {
+        return(train_structures->get_mean_lsh_recall());
+    };
+
+    //! number of predictions whose LSH recall has been measured
+    int get_nr_lsh_samples() {
+        return(train_structures->get_nr_lsh_samples());
+    };
+
+    //! lookups of training compound pairs that were answered by the similarity cache
+    unsigned long get_sim_cache_hits() {
+        return(train_structures->get_sim_cache_hits());
+    };
+    unsigned long get_sim_cache_misses() {
+        return(train_structures->get_sim_cache_misses());
+    };
+
+    //! read test structures for batch predictions (or keep the file name, if they should be streamed in windows)
+    void read_test_structures(char * input_file) {
+        if (window_size > 0)
+            test_file = input_file;
+        else
+            test_structures.reset( new MolVect <MolType, FeatureType, ActivityType>(input_file, out) );
+    };
+
     //! predict a single smiles
     void predict_smi(string smiles);
 
@@ -100,6 +185,15 @@ public:
     //! batch predictions: predict arbitrary comps.
     void predict_file();
 
+    //! predict_fold() for test files that are read in windows of window_size structures
+    void predict_fold_stream();
+
+    //! predict_file() for test files that are read in windows of window_size structures
+    void predict_file_stream();
+
+    //! add training set features that occur in a test structure (and record them in feat_map, if not NULL)
+    void add_train_features(sMolRef cur_mol, map<string, vector<string> > * feat_map);
+
     //! leave one out crossvalidation
     void loo_predict();
 
@@ -131,6 +225,11 @@ void Predictor<MolType, FeatureType, ActivityType>::predict_fold() {
     typedef shared_ptr<Feature<FeatureType> > sFeatRef;
     //Fminer* fminer = NULL; 
 
+    if (test_file) {
+        this->predict_fold_stream();
+        return;
+    }
+
     sMolRef cur_mol;
     int test_size = test_structures->get_size();
  
@@ -139,7 +238,6 @@ void Predictor<MolType, FeatureType, ActivityType>::predict_fold() {
 
     map<string, vector<string> > feat_map;
 
-
     // ADD FRAGMENTS FROM THE TRAINING SET TO TEST SET STRUCTURES
     for (int n = 0; n < test_size; n++) {
         cur_mol = test_structures->get_compound(n);
@@ -172,18 +270,7 @@ void Predictor<MolType, FeatureType, ActivityType>::predict_fold() {
         */
 
 
-        for (feat_it=features->begin(); feat_it!=features->end(); feat_it++) {
-            shared_ptr<OBSmartsPattern> frag (new OBSmartsPattern() );
-            if (!frag->Init((*feat_it)->get_name())) {
-                cerr << "Warning! predict_fold(): OBSmartsFrag '" << (*feat_it)->get_name() << "' failed to initialize!" << endl;
-            }
-            else {
-                if ( frag->Match((*(cur_mol->get_mol_ref())),true) ) {
-                     cur_mol->add_feature((*feat_it).get());
-                     feat_map[(*feat_it)->get_name()].push_back(cur_mol->get_id());
-                }
-            }
-        }
+        this->add_train_features(cur_mol, &feat_map);
 	
         // REMOVE ALL TEST STRUCTURES
         vector<sMolRef> duplicates = train_structures->remove_duplicates(cur_mol);
@@ -231,11 +318,141 @@ void Predictor<MolType, FeatureType, ActivityType>::predict_fold() {
 };
 
 template <class MolType, class FeatureType, class ActivityType>
-void Predictor<MolType, FeatureType, ActivityType>::predict_file() {
+void Predictor<MolType, FeatureType, ActivityType>::add_train_features(sMolRef cur_mol, map<string, vector<string> > * feat_map) {
+
+    typedef shared_ptr<Feature<FeatureType> > sFeatRef;
+    vector<sFeatRef>* features = train_structures->get_features();
+    typename vector<sFeatRef>::iterator feat_it;
+
+    for (feat_it=features->begin(); feat_it!=features->end(); feat_it++) {
+        shared_ptr<OBSmartsPattern> frag (new OBSmartsPattern() );
+        if (!frag->Init((*feat_it)->get_name())) {
+            cerr << "Warning! predict_fold(): OBSmartsFrag '" << (*feat_it)->get_name() << "' failed to initialize!" << endl;
+        }
+        else {
+            if ( cur_mol->MolType::match(frag.get()) ) {
+                 cur_mol->add_feature((*feat_it).get());
+                 if (feat_map)
+                     (*feat_map)[(*feat_it)->get_name()].push_back(cur_mol->get_id());
+            }
+        }
+    }
 
+};
+
+template <class MolType, class FeatureType, class ActivityType>
+void Predictor<MolType, FeatureType, ActivityType>::predict_fold_stream() {
+
+    sMolRef cur_mol;
+    vector<sMolRef> window;
+    typename vector<sMolRef>::iterator cur_test;
     typename vector<sMolRef>::iterator cur_dup;
+    // training set instances of the test structures (by test line nr), these are shared with the training set
+    map<int, vector<sMolRef> > duplicates;
+    int n = 0;
+
+    // REMOVE ALL TEST STRUCTURES
+    {
+        MolStream<MolType, FeatureType, ActivityType> test_stream(test_file, out);
+        while (test_stream.read_window(window_size, &window)) {
+            for (cur_test = window.begin(); cur_test != window.end(); cur_test++) {
+                vector<sMolRef> dups = train_structures->remove_duplicates(*cur_test);
+                if (dups.size()) {
+                    *out << int(dups.size()) << " instances of " << (*cur_test)->get_smiles() << " removed from the training set!\n";
+                    out->print_err();
+                    duplicates[(*cur_test)->get_line_nr()] = dups;
+                }
+            }
+        }
+    }
+
+    // PREDICT FOLD
+    MolStream<MolType, FeatureType, ActivityType> test_stream(test_file, out);
+    while (test_stream.read_window(window_size, &window)) {
+
+        for (cur_test = window.begin(); cur_test != window.end(); cur_test++) {
+
+            cur_mol = *cur_test;
+            this->add_train_features(cur_mol, NULL);
+
+            // database activities of the removed instances
+            if (duplicates.find(cur_mol->get_line_nr()) != duplicates.end()) {
+                vector<sMolRef> & dups = duplicates[cur_mol->get_line_nr()];
+                for (cur_dup = dups.begin(); cur_dup != dups.end(); cur_dup++)
+                    (*cur_dup)->copy_activities(cur_mol);
+            }
+
+            *out << "Predicting external test id " << cur_mol->get_id() << endl;
+            out->print_err();
+
+            // recalculate frequencies and and significance only for the first time
+            this->predict(cur_mol, n == 0);
+            n++;
+        }
+
+        // free the window before the next one is read
+        window.clear();
+        neighbors.clear();
+    }
+
+};
+
+template <class MolType, class FeatureType, class ActivityType>
+void Predictor<MolType, FeatureType, ActivityType>::predict_file_stream() {
+
+    vector<sMolRef> window;
+    typename vector<sMolRef>::iterator cur_test;
+    sMolRef cur_mol;
+    int n = 0;
+
+    MolStream<MolType, FeatureType, ActivityType> test_stream(test_file, out);
+
+    while (test_stream.read_window(window_size, &window)) {
+
+        for (cur_test = window.begin(); cur_test != window.end(); cur_test++) {
+
+            cur_mol = *cur_test;
+            feat_gen.reset(new FeatGen <MolType, FeatureType, ActivityType>(a_file, train_structures, cur_mol,out));
+            feat_gen->generate_linfrag(train_structures,cur_mol);
+
+            *out << "Looking for " << cur_mol->get_smiles() << " in the training set\n";
+            out->print_err();
+
+            vector<sMolRef> duplicates = train_structures->remove_duplicates(cur_mol);
+
+            if (duplicates.size() > 1) {
+                *out << int(duplicates.size()) << " instances of " << cur_mol->get_smiles() << " in the training set!\n";
+                out->print_err();
+            }
+
+            // recalculate frequencies and and significance only if necessary
+            this->predict(cur_mol, n == 0 || duplicates.size() > 0, true);
+            n++;
+
+            // restore duplicates for batch predictions
+            train_structures->restore_duplicates(duplicates);
+        }
+
+        // free the window (and the feature generator, which refers to the last structure) before the next one is read
+        window.clear();
+        cur_mol.reset();
+        feat_gen.reset();
+        neighbors.clear();
+    }
+
+};
+
+template <class MolType, class FeatureType, class ActivityType>
+void Predictor<MolType, FeatureType, ActivityType>::predict_file() {
+
 
     sMolRef cur_mol;
+
+    if (test_file) {
+        this->predict_file_stream();
+        return;
+    }
+
     int test_size = test_structures->get_size();
 
     for (int n = 0; n < test_size; n++) {
@@ -270,11 +487,7 @@ void Predictor<MolType, FeatureType, ActivityType>::predict_file() {
 
         // restore duplicates for batch predictions
 
-        if (duplicates.size() >= 1) {
-            for (cur_dup=duplicates.begin(); cur_dup != duplicates.end(); cur_dup++) {
-                (*cur_dup)->restore();
-            }
-        }
+        train_structures->restore_duplicates(duplicates);
     }
 
 };
@@ -284,26 +497,14 @@ void Predictor<MolType, FeatureType, ActivityType>::loo_predict() {
 
     loo = true;
     sMolRef cur_mol;
-    typename vector<sMolRef>::iterator cur_dup;
 
 
     clock_t t1 = clock();
     cerr << "Precomputing significance values... ";
 
-    if (!quantitative) {
-        // MG : precompute
-        vector<ActivityType> activity_values;
-        vector<string> activity_names = train_structures->get_activity_names();
-        typename vector<string>::iterator cur_act;
-
-        for (cur_act = activity_names.begin(); cur_act != activity_names.end(); cur_act++) {
-
-            activity_values = train_structures->get_activity_values(*cur_act);
-            train_structures->precompute_feature_significance(*cur_act, activity_values);
-
-        }
-        // MG
-    }
+    // MG : precompute (all endpoints at once), regression: KS steps for the single compound exclusions of predict()
+    train_structures->precompute_feature_significance(train_structures->get_activity_names());
+    // MG
 
     clock_t t2 = clock();
     cerr << "done (" << (float)(t2-t1)/CLOCKS_PER_SEC << "sec)!" << endl;
@@ -326,11 +527,7 @@ void Predictor<MolType, FeatureType, ActivityType>::loo_predict() {
         this->predict(cur_mol,true,false);
 
         // recover query compound as train structure for the next round
-        if (duplicates.size() >= 1) {
-            for (cur_dup=duplicates.begin(); cur_dup != duplicates.end(); cur_dup++) {
-                (*cur_dup)->restore();
-            }
-        }
+        train_structures->restore_duplicates(duplicates);
 
         t2 = clock();
         static float avg_s = 0;
@@ -349,7 +546,6 @@ void Predictor<MolType, FeatureType, ActivityType>::predict_smi(string smiles) {
 
     bool recalculate = true;
     vector<sMolRef> duplicates ;
-    typename vector<sMolRef>::iterator cur_dup;
 
     shared_ptr<FeatMol <MolType, FeatureType, ActivityType> > cur_mol ( new FeatMol<MolType, FeatureType, ActivityType>(0,"test structure",smiles,out) );
 
@@ -376,10 +572,22 @@ void Predictor<MolType, FeatureType, ActivityType>::predict_smi(string smiles) {
 
     // restore duplicates for batch predictions
 
-    if (duplicates.size() >= 1) {
-        for (cur_dup=duplicates.begin(); cur_dup != duplicates.end(); cur_dup++) {
-            (*cur_dup)->restore();
-        }
+    train_structures->restore_duplicates(duplicates);
+
+};
+
+template <class MolType, class FeatureType, class ActivityType>
+void Predictor<MolType, FeatureType, ActivityType>::refresh_significance(string act, bool recalculate) {
+
+    if (recalculate)
+        train_structures->exclude_significance(act);	// AM: feature significance (without the removed duplicates)
+    else if (train_structures->update_significance(act)) {
+        *out << "Outdated significances for " << act << " recalculated.\n";
+        out->print_err();
+    }
+    else {
+        *out << "Significances for " << act << " not recalculated.\n";
+        out->print_err();
     }
 
 };
@@ -387,13 +595,20 @@ void Predictor<MolType, FeatureType, ActivityType>::predict_smi(string smiles) {
 template <class MolType, class FeatureType, class ActivityType>
 void Predictor<MolType, FeatureType, ActivityType>::predict(sMolRef test, bool recalculate, bool verbose=true) {
 
-    vector<ActivityType> activity_values;
     vector<string> activity_names = train_structures->get_activity_names();
     typename vector<string>::iterator cur_act;
+    bool fused = false;
 
     // determine common features in the training set
     train_structures->common_features(test);
 
+    // fused_endpoints: significances of all endpoints first, then one similarity pass for all of them
+    if (fused_endpoints && !loo) {
+        for (cur_act = activity_names.begin(); cur_act != activity_names.end(); cur_act++)
+            this->refresh_significance(*cur_act, recalculate);
+        fused = train_structures->relevant_features(test, activity_names);
+    }
+
     for (cur_act = activity_names.begin(); cur_act != activity_names.end(); cur_act++) {
 
 
@@ -402,38 +617,32 @@ void Predictor<MolType, FeatureType, ActivityType>::predict(sMolRef test, bool r
             *out << "---\n";
             out->print();
 
-            if (recalculate) {
+            if (recalculate && loo && !quantitative) {
 
-                if (!loo || quantitative) {
-                    activity_values = train_structures->get_activity_values(*cur_act);
-                    train_structures->feature_significance(*cur_act, activity_values);	// AM: feature significance
+                // MG
+                typename vector<FeatRef>::iterator cur_feat;
+                vector<ActivityType> tmp_activities;
+
+                tmp_activities = test->get_act(*cur_act);
+                if (tmp_activities.size() > 1) {
+                    fprintf(stderr, "Current test structure has more than one activity value");
+                    exit(1);
                 }
+                // the LOO state is kept with the statistics that all training features share
+                if (!train_structures->get_features()->empty())
+                    train_structures->get_features()->front()->set_cur_str_active( *tmp_activities.begin() );
 
-                // MG
-                else {
-                    typename vector<FeatRef>::iterator cur_feat;
-                    vector<ActivityType> tmp_activities;
-
-                    tmp_activities = test->get_act(*cur_act);
-                    if (tmp_activities.size() > 1) {
-                        fprintf(stderr, "Current test structure has more than one activity value");
-                        exit(1);
-                    }
-                    ClassFeat::set_cur_str_active( *tmp_activities.begin() );
-
-                    // label features that occur in current test structure
-                    vector<FeatRef> test_features = test->get_features();
-                    for (cur_feat=test_features.begin(); cur_feat!=test_features.end(); cur_feat++){
-                        (*cur_feat)->set_cur_feat_occurs( true );
-                    }
+                // label features that occur in current test structure
+                vector<FeatRef> test_features = test->get_features();
+                for (cur_feat=test_features.begin(); cur_feat!=test_features.end(); cur_feat++){
+                    (*cur_feat)->set_cur_feat_occurs( true );
                 }
             }
-            else {
-                *out << "Significances for " << *cur_act << " not recalculated.\n";
-                out->print_err();
-            }
+            else if (!fused_endpoints || loo)	// LOO regression: from the steps of precompute_feature_significance()
+                this->refresh_significance(*cur_act, recalculate);
 
-            train_structures->relevant_features(test, *cur_act);
+            if (!fused || !train_structures->select_endpoint(*cur_act))
+                train_structures->relevant_features(test, *cur_act);
             this->knn_predict(test,*cur_act);
             *out << "\n";
             out->print();
@@ -470,6 +679,10 @@ void Predictor<MolType, FeatureType, ActivityType>::knn_predict(sMolRef test, st
     test->print_db_activity(act,loo);
     model->calculate_prediction(test, &neighbors, act);
     *out << "endpoint: '" << act << "'\n";
+    if (prune_neighbors)
+        *out << "pruned_candidates: " << train_structures->get_nr_pruned() << "\n";
+    if (lsh_bands > 0 && train_structures->get_lsh_recall() >= 0)
+        *out << "lsh_recall: " << train_structures->get_lsh_recall() << "\n";
     out->print();
 
     // print neighbors
@@ -493,8 +706,7 @@ void Predictor<MolType, FeatureType, ActivityType>::print_neighbors(string act)
     int n;
     typename vector<sMolRef>::iterator cur_n;
 
-    sort(neighbors.begin(),neighbors.end(),greater_sim<MolType,FeatureType,ActivityType>());
-
+    // neighbors are sorted by similarity (MolVect::get_neighbors())
     if (neighbors.size()>0) {
 
         n = 0;
@@ -0,0 +1,112 @@
+/* Copyright (C) 2005  Christoph Helma <helma@in-silico.de>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+
+*/
+
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <stdlib.h>
+#include <math.h>
+#include <sys/time.h>
+
+#include "similarity.h"
+
+using namespace std;
+
+static double now() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return(tv.tv_sec + tv.tv_usec / 1e6);
+}
+
+//! compounds per second of kernel for repeated scoring of all compounds
+static double bench(void (*kernel)(const float *, const float *, float, int, const int * const *, const int *, int, float *),
+                    vector<float> & query_w, vector<float> & other_w, float query_weight, int query_nr,
+                    vector<const int *> & ids, vector<int> & lens, vector<float> & sims) {
+
+    int nr = ids.size();
+    int rounds = 0;
+    double start = now();
+    double secs;
+
+    do {
+        kernel(&query_w[0], &other_w[0], query_weight, query_nr, &ids[0], &lens[0], nr, &sims[0]);
+        rounds++;
+        secs = now() - start;
+    } while (secs < 1.0);
+    return(rounds * (double) nr / secs);
+}
+
+//! micro-benchmark of the weighted Tanimoto kernels on random data
+int main(int argc, char *argv[]) {
+
+    int nr_compounds = argc > 1 ? atoi(argv[1]) : 10000;
+    int nr_features = argc > 2 ? atoi(argv[2]) : 5000;
+    int nr_per_compound = argc > 3 ? atoi(argv[3]) : 60;
+
+    if (nr_compounds < 1 || nr_features < 1 || nr_per_compound < 1 || nr_per_compound > nr_features) {
+        cerr << "usage: " << argv[0] << " [compounds [features [features_per_compound]]]\n";
+        return(1);
+    }
+
+    vector<vector<int> > features(nr_compounds);
+    vector<const int *> ids(nr_compounds);
+    vector<int> lens(nr_compounds);
+    vector<float> weights(nr_features);
+    vector<float> query_w(nr_features, 0);
+    vector<float> other_w(nr_features);
+    vector<float> sims(nr_compounds);
+    vector<float> reference(nr_compounds);
+    float query_weight = 0;
+    int query_nr = 0;
+    double max_diff = 0;
+
+    srand(1);
+    for (int f = 0; f < nr_features; f++)
+        weights[f] = (rand() % 4 == 0) ? 0 : (float) rand() / RAND_MAX;	// some features are not significant
+    for (int n = 0; n < nr_compounds; n++) {
+        int len = 1 + rand() % (2 * nr_per_compound);
+        for (int j = 0; j < len; j++)
+            features[n].push_back(rand() % nr_features);
+        sort(features[n].begin(), features[n].end());
+        features[n].erase(unique(features[n].begin(), features[n].end()), features[n].end());
+        ids[n] = &features[n][0];
+        lens[n] = features[n].size();
+    }
+
+    // the query is the first compound
+    other_w = weights;
+    for (int j = 0; j < lens[0]; j++) {
+        int f = ids[0][j];
+        query_w[f] = weights[f];
+        other_w[f] = 0;
+        query_weight += weights[f];
+        if (weights[f] > 0) query_nr++;
+    }
+
+    weighted_tanimoto_block_scalar(&query_w[0], &other_w[0], query_weight, query_nr, &ids[0], &lens[0], nr_compounds, &reference[0]);
+    weighted_tanimoto_block(&query_w[0], &other_w[0], query_weight, query_nr, &ids[0], &lens[0], nr_compounds, &sims[0]);
+    for (int n = 0; n < nr_compounds; n++)
+        max_diff = max(max_diff, (double) fabs(sims[n] - reference[n]));
+
+    cout << "compounds: " << nr_compounds << ", features: " << nr_features << ", features per compound: " << nr_per_compound << "\n";
+    cout << "scalar: " << bench(weighted_tanimoto_block_scalar, query_w, other_w, query_weight, query_nr, ids, lens, sims) << " compounds/sec\n";
+    cout << weighted_tanimoto_isa() << ": " << bench(weighted_tanimoto_block, query_w, other_w, query_weight, query_nr, ids, lens, sims) << " compounds/sec\n";
+    cout << "max difference: " << max_diff << "\n";
+
+    return(0);
+}
@@ -0,0 +1,192 @@
+/* Copyright (C) 2005  Christoph Helma <helma@in-silico.de>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+
+*/
+
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "similarity-cache.h"
+
+//! header of dense matrix files
+struct DenseHeader {
+    char magic[8];
+    int32_t nr;
+    int32_t complete;
+    uint64_t fingerprint;
+};
+
+static const char dense_magic[8] = "LAZSIM1";
+
+SimilarityCache::SimilarityCache(): capacity(0), hits(0), misses(0) {
+    pthread_mutex_init(&lock, NULL);
+};
+
+SimilarityCache::~SimilarityCache() {
+    for (unordered_map<int, Table>::iterator t = tables.begin(); t != tables.end(); t++)
+        this->unmap(t->second);
+    pthread_mutex_destroy(&lock);
+};
+
+void SimilarityCache::unmap(Table & table) {
+    if (table.map)
+        munmap(table.map, table.map_size);
+    table.map = NULL;
+    table.map_size = 0;
+    table.dense = NULL;
+    table.complete = false;
+    table.nr_dense = 0;
+};
+
+SimilarityCache::Table & SimilarityCache::get_table(int slot, unsigned int generation) {
+
+    Table & table = tables[slot];
+    if (table.generation != generation) {	// significances have changed
+        table.lru.clear();
+        table.index.clear();
+        table.generation = generation;
+    }
+    return(table);
+};
+
+void SimilarityCache::set_capacity(unsigned int new_capacity) {
+
+    pthread_mutex_lock(&lock);
+    capacity = new_capacity;
+    for (unordered_map<int, Table>::iterator t = tables.begin(); t != tables.end(); t++) {
+        while (t->second.lru.size() > capacity) {
+            t->second.index.erase(t->second.lru.back().first);
+            t->second.lru.pop_back();
+        }
+    }
+    pthread_mutex_unlock(&lock);
+};
+
+bool SimilarityCache::get(int slot, unsigned int generation, int a, int b, float * sim) {
+
+    bool found = false;
+
+    pthread_mutex_lock(&lock);
+    Table & table = this->get_table(slot, generation);
+    if (table.complete && table.dense_generation == generation && a < table.nr_dense && b < table.nr_dense) {
+        *sim = table.dense[dense_index(a, b, table.nr_dense)];
+        found = true;
+    }
+    else {
+        unordered_map<uint64_t, LRUList::iterator>::iterator pos = table.index.find(key(a, b));
+        if (pos != table.index.end()) {
+            table.lru.splice(table.lru.begin(), table.lru, pos->second);	// move to front
+            *sim = pos->second->second;
+            found = true;
+        }
+    }
+    if (found) hits++;
+    else misses++;
+    pthread_mutex_unlock(&lock);
+
+    return(found);
+};
+
+void SimilarityCache::put(int slot, unsigned int generation, int a, int b, float sim) {
+
+    pthread_mutex_lock(&lock);
+    Table & table = this->get_table(slot, generation);
+    uint64_t k = key(a, b);
+    if (capacity > 0 && table.index.find(k) == table.index.end()) {
+        if (table.lru.size() >= capacity) {
+            table.index.erase(table.lru.back().first);
+            table.lru.pop_back();
+        }
+        table.lru.push_front(make_pair(k, sim));
+        table.index[k] = table.lru.begin();
+    }
+    pthread_mutex_unlock(&lock);
+};
+
+float * SimilarityCache::map_dense(int slot, unsigned int generation, int nr, uint64_t fingerprint, string file, bool * filled) {
+
+    size_t size = sizeof(DenseHeader) + (size_t) nr * (nr + 1) / 2 * sizeof(float);
+    DenseHeader * header;
+    struct stat st;
+    void * map;
+    int fd;
+
+    *filled = false;
+
+    pthread_mutex_lock(&lock);
+    Table & table = this->get_table(slot, generation);
+    this->unmap(table);
+    pthread_mutex_unlock(&lock);
+
+    fd = open(file.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0)
+        return(NULL);
+    if (fstat(fd, &st) != 0 || ((size_t) st.st_size != size && ftruncate(fd, size) != 0)) {
+        close(fd);
+        return(NULL);
+    }
+    map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return(NULL);
+
+    header = (DenseHeader *) map;
+    if (memcmp(header->magic, dense_magic, sizeof(dense_magic)) == 0 && header->nr == nr && header->fingerprint == fingerprint && header->complete)
+        *filled = true;
+    else {
+        memcpy(header->magic, dense_magic, sizeof(dense_magic));
+        header->nr = nr;
+        header->complete = 0;
+        header->fingerprint = fingerprint;
+    }
+
+    pthread_mutex_lock(&lock);
+    table.map = map;
+    table.map_size = size;
+    table.dense_generation = generation;
+    table.nr_dense = nr;
+    table.dense = (float *) ((char *) map + sizeof(DenseHeader));
+    table.complete = *filled;
+    pthread_mutex_unlock(&lock);
+
+    return(table.dense);
+};
+
+void SimilarityCache::finish_dense(int slot) {
+
+    pthread_mutex_lock(&lock);
+    Table & table = tables[slot];
+    if (table.map) {
+        ((DenseHeader *) table.map)->complete = 1;
+        table.complete = true;
+        msync(table.map, table.map_size, MS_ASYNC);
+    }
+    pthread_mutex_unlock(&lock);
+};
+
+bool SimilarityCache::has_dense(int slot, unsigned int generation) {
+
+    bool dense;
+
+    pthread_mutex_lock(&lock);
+    Table & table = this->get_table(slot, generation);
+    dense = table.complete && table.dense_generation == generation;
+    pthread_mutex_unlock(&lock);
+    return(dense);
+};
@@ -0,0 +1,114 @@
+/* Copyright (C) 2005  Christoph Helma <helma@in-silico.de>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+
+*/
+
+#ifndef SIMILARITY_CACHE_H
+#define SIMILARITY_CACHE_H
+
+#include <string>
+#include <list>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "boost/unordered_map.hpp"
+
+using namespace std;
+using namespace boost;
+
+//! similarities of pairs of training compounds, per weight slot (endpoint and LOO state)
+//
+// Values are only valid for the weight generation they have been computed with
+// (see FeatureStats::get_generation()). Each slot has a sparse LRU table with at most
+// capacity pairs, it is cleared as soon as it is accessed with another generation, and
+// optionally a dense matrix (packed upper triangle including the diagonal) in a memory
+// mapped file. The matrix is kept for its own generation, i.e. it is used again when the
+// weights return to it (e.g. after FeatureStats::rollback() of a LOO exclusion).
+class SimilarityCache {
+
+private:
+
+    typedef list<pair<uint64_t, float> > LRUList;
+
+    struct Table {
+        unsigned int generation;	// of the sparse table
+        LRUList lru;	// most recently used first
+        unordered_map<uint64_t, LRUList::iterator> index;
+        unsigned int dense_generation;
+        int nr_dense;	// compounds of the dense matrix, 0: none
+        float * dense;
+        bool complete;	// dense has all values
+        size_t map_size;
+        void * map;
+        Table(): generation(0), dense_generation(0), nr_dense(0), dense(NULL), complete(false), map_size(0), map(NULL) {};
+    };
+
+    unsigned int capacity;	// pairs per slot, 0: disabled
+    unordered_map<int, Table> tables;
+    unsigned long hits;
+    unsigned long misses;
+    pthread_mutex_t lock;
+
+    //! table of slot with the sparse table for generation (caller holds the lock)
+    Table & get_table(int slot, unsigned int generation);
+    void unmap(Table & table);
+
+    static uint64_t key(int a, int b) {
+        if (a > b) swap(a, b);
+        return(((uint64_t) a << 32) | (uint32_t) b);
+    };
+
+public:
+
+    SimilarityCache();
+    ~SimilarityCache();
+
+    //! keep at most capacity pairs per slot (0 disables the sparse tables)
+    void set_capacity(unsigned int new_capacity);
+
+    bool is_enabled() {
+        return(capacity > 0);
+    };
+
+    //! cached similarity of compounds a and b, returns false if it is unknown
+    bool get(int slot, unsigned int generation, int a, int b, float * sim);
+    //! add the similarity of compounds a and b and evict the least recently used pair if the table is full
+    void put(int slot, unsigned int generation, int a, int b, float sim);
+
+    //! map the dense matrix of nr compounds for slot from file (created if it does not match nr and fingerprint),
+    //! returns the matrix for precompute (NULL on errors, *filled if the file already had the values)
+    float * map_dense(int slot, unsigned int generation, int nr, uint64_t fingerprint, string file, bool * filled);
+    //! mark the matrix of map_dense() as complete
+    void finish_dense(int slot);
+    //! true if slot has a complete dense matrix for generation
+    bool has_dense(int slot, unsigned int generation);
+
+    //! position of pair (a, b) in the packed upper triangle of nr compounds
+    static size_t dense_index(int a, int b, int nr) {
+        if (a > b) swap(a, b);
+        return((size_t) a * nr - (size_t) a * (a - 1) / 2 + (b - a));
+    };
+
+    unsigned long get_hits() {
+        return(hits);
+    };
+    unsigned long get_misses() {
+        return(misses);
+    };
+
+};
+
+#endif
@@ -0,0 +1,166 @@
+/* Copyright (C) 2005  Christoph Helma <helma@in-silico.de>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+
+*/
+
+#include "similarity.h"
+
+// gather based kernels, compiled for their instruction set with target attributes and
+// selected at runtime (the rest of the program does not need -mavx2)
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SIMILARITY_X86
+#include <immintrin.h>
+#endif
+
+typedef void (*BlockKernel)(const float *, const float *, float, int, const int * const *, const int *, int, float *);
+
+static inline float finish(float common, float other, float query_weight, int nr_u) {
+    float u = query_weight + other;
+    if (nr_u > 1 && u > 0)
+        return(common/u);
+    return(0.0);
+}
+
+void weighted_tanimoto_block_scalar(const float * query_w, const float * other_w, float query_weight, int query_nr, const int * const * ids, const int * lens, int nr, float * sims) {
+
+    for (int i = 0; i < nr; i++) {
+        const int * id = ids[i];
+        float common = 0;
+        float other = 0;
+        int nr_u = query_nr;
+        for (int j = 0; j < lens[i]; j++) {
+            common += query_w[id[j]];
+            other += other_w[id[j]];
+            if (other_w[id[j]] > 0) nr_u++;
+        }
+        sims[i] = finish(common, other, query_weight, nr_u);
+    }
+
+}
+
+#ifdef SIMILARITY_X86
+
+__attribute__((target("avx2")))
+static float hsum_avx2(__m256 v) {
+    __m128 s = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+    s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+    return(_mm_cvtss_f32(s));
+}
+
+__attribute__((target("avx2")))
+static void weighted_tanimoto_block_avx2(const float * query_w, const float * other_w, float query_weight, int query_nr, const int * const * ids, const int * lens, int nr, float * sims) {
+
+    const __m256 zero = _mm256_setzero_ps();
+
+    for (int i = 0; i < nr; i++) {
+        const int * id = ids[i];
+        int len = lens[i];
+        int j = 0;
+        int nr_u = query_nr;
+        __m256 common = zero;
+        __m256 other = zero;
+        for (; j + 8 <= len; j += 8) {
+            __m256i idx = _mm256_loadu_si256((const __m256i *) (id + j));
+            __m256 o = _mm256_i32gather_ps(other_w, idx, 4);
+            common = _mm256_add_ps(common, _mm256_i32gather_ps(query_w, idx, 4));
+            other = _mm256_add_ps(other, o);
+            nr_u += __builtin_popcount(_mm256_movemask_ps(_mm256_cmp_ps(o, zero, _CMP_GT_OQ)));
+        }
+        float c = hsum_avx2(common);
+        float u = hsum_avx2(other);
+        for (; j < len; j++) {
+            c += query_w[id[j]];
+            u += other_w[id[j]];
+            if (other_w[id[j]] > 0) nr_u++;
+        }
+        sims[i] = finish(c, u, query_weight, nr_u);
+    }
+
+}
+
+__attribute__((target("avx512f")))
+static float hsum_avx512(__m512 v) {
+    float lanes[16];
+    float s = 0;
+    _mm512_storeu_ps(lanes, v);
+    for (int k = 0; k < 16; k++)
+        s += lanes[k];
+    return(s);
+}
+
+__attribute__((target("avx512f")))
+static void weighted_tanimoto_block_avx512(const float * query_w, const float * other_w, float query_weight, int query_nr, const int * const * ids, const int * lens, int nr, float * sims) {
+
+    const __m512 zero = _mm512_setzero_ps();
+
+    for (int i = 0; i < nr; i++) {
+        const int * id = ids[i];
+        int len = lens[i];
+        int j = 0;
+        int nr_u = query_nr;
+        __m512 common = zero;
+        __m512 other = zero;
+        for (; j + 16 <= len; j += 16) {
+            __m512i idx = _mm512_loadu_si512((const void *) (id + j));
+            __m512 o = _mm512_mask_i32gather_ps(zero, 0xFFFF, idx, other_w, 4);
+            common = _mm512_add_ps(common, _mm512_mask_i32gather_ps(zero, 0xFFFF, idx, query_w, 4));
+            other = _mm512_add_ps(other, o);
+            nr_u += __builtin_popcount(_mm512_cmp_ps_mask(o, zero, _CMP_GT_OQ));
+        }
+        if (j < len) {	// masked tail
+            __mmask16 m = (__mmask16) ((1u << (len - j)) - 1);
+            __m512i idx = _mm512_maskz_loadu_epi32(m, (const void *) (id + j));
+            __m512 o = _mm512_mask_i32gather_ps(zero, m, idx, other_w, 4);
+            common = _mm512_add_ps(common, _mm512_mask_i32gather_ps(zero, m, idx, query_w, 4));
+            other = _mm512_add_ps(other, o);
+            nr_u += __builtin_popcount(_mm512_mask_cmp_ps_mask(m, o, zero, _CMP_GT_OQ));
+        }
+        sims[i] = finish(hsum_avx512(common), hsum_avx512(other), query_weight, nr_u);
+    }
+
+}
+
+#endif
+
+static BlockKernel select_kernel(const char ** isa) {
+
+#ifdef SIMILARITY_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) {
+        *isa = "avx512";
+        return(weighted_tanimoto_block_avx512);
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        *isa = "avx2";
+        return(weighted_tanimoto_block_avx2);
+    }
+#endif
+    *isa = "scalar";
+    return(weighted_tanimoto_block_scalar);
+
+}
+
+static const char * kernel_isa = "scalar";
+static BlockKernel block_kernel = select_kernel(&kernel_isa);
+
+void weighted_tanimoto_block(const float * query_w, const float * other_w, float query_weight, int query_nr, const int * const * ids, const int * lens, int nr, float * sims) {
+    block_kernel(query_w, other_w, query_weight, query_nr, ids, lens, nr, sims);
+}
+
+const char * weighted_tanimoto_isa() {
+    return(kernel_isa);
+}
@@ -0,0 +1,41 @@
+/* Copyright (C) 2005  Christoph Helma <helma@in-silico.de>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+
+*/
+
+#ifndef SIMILARITY_H
+#define SIMILARITY_H
+
+//! weighted Tanimoto similarities of one query against a block of compounds
+//
+// The query is given by two dense arrays indexed by feature id: query_w holds the
+// weights of the query features (0 for all other features), other_w the weights of
+// all features that do not occur in the query (0 for query features). query_weight
+// is the sum of the query weights, query_nr the number of query features with weight > 0.
+// Compound i has the feature ids ids[i][0] .. ids[i][lens[i]-1] (all < the array size):
+//   common = sum query_w[id], union = query_weight + sum other_w[id]
+//   sims[i] = common / union if more than one union feature has a weight > 0, 0 otherwise
+// This is FeatMol::weighted_tanimoto() with another summation order, i.e. the results
+// agree to within a few float ulps.
+void weighted_tanimoto_block(const float * query_w, const float * other_w, float query_weight, int query_nr, const int * const * ids, const int * lens, int nr, float * sims);
+
+//! weighted_tanimoto_block() without SIMD instructions
+void weighted_tanimoto_block_scalar(const float * query_w, const float * other_w, float query_weight, int query_nr, const int * const * ids, const int * lens, int nr, float * sims);
+
+//! instruction set of weighted_tanimoto_block() on this CPU ("avx512", "avx2" or "scalar")
+const char * weighted_tanimoto_isa();
+
+#endif
@@ -0,0 +1,271 @@
+/* Copyright (C) 2005  Christoph Helma <helma@in-silico.de>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "snapshot.h"
+
+// pad sections to 8 byte boundaries
+static uint64_t align8(uint64_t offset) {
+    return (offset + 7) & ~((uint64_t) 7);
+}
+
+static bool write_section(FILE * fp, const void * data, size_t size, uint64_t * pos) {
+
+    static const char zeros[8] = {0,0,0,0,0,0,0,0};
+    uint64_t start = align8(*pos);
+
+    if (start > *pos && fwrite(zeros, 1, start - *pos, fp) != start - *pos)
+        return false;
+    if (size > 0 && fwrite(data, 1, size, fp) != size)
+        return false;
+
+    *pos = start + size;
+    return true;
+}
+
+// SnapshotWriter
+
+static const uint64_t max_offset = 0xffffffffULL;
+
+SnapshotWriter::SnapshotWriter(bool quantitative): quantitative(quantitative), too_large(false) {
+    strings.push_back('\0');	// offset 0 is the empty string
+};
+
+uint32_t SnapshotWriter::index(size_t nr) {
+    if (nr > max_offset) {
+        too_large = true;
+        return 0;
+    }
+    return nr;
+};
+
+uint32_t SnapshotWriter::add_string(const string & str) {
+
+    if (str.size() == 0 || too_large)
+        return 0;
+
+    uint32_t offset = index(strings.size());
+    if (!too_large) {
+        strings.insert(strings.end(), str.begin(), str.end());
+        strings.push_back('\0');
+    }
+    return offset;
+};
+
+void SnapshotWriter::add_compound(int line_nr, string id, string smiles, string inchi) {
+
+    SnapCompound comp;
+    comp.line_nr = line_nr;
+    comp.id = add_string(id);
+    comp.smiles = add_string(smiles);
+    comp.inchi = add_string(inchi);
+    compounds.push_back(comp);
+};
+
+void SnapshotWriter::add_feature(string name, vector<int> * matches) {
+
+    SnapFeature feat;
+    feat.name = add_string(name);
+    feat.first_posting = index(postings.size());
+    feat.nr_postings = index(matches->size());
+    feat.reserved = 0;
+    postings.insert(postings.end(), matches->begin(), matches->end());
+    features.push_back(feat);
+};
+
+void SnapshotWriter::add_endpoint(string name) {
+
+    if (endpoint_nrs.find(name) == endpoint_nrs.end()) {
+        endpoint_nrs[name] = endpoints.size();
+        endpoints.push_back(add_string(name));
+    }
+};
+
+void SnapshotWriter::add_activity(int comp_nr, string endpoint, vector<float> * vals, bool available) {
+
+    SnapActivity act;
+    act.compound = comp_nr;
+    act.endpoint = endpoint_nrs[endpoint];
+    act.first_value = index(values.size());
+    act.nr_values = index(vals->size());
+    act.available = available;
+    values.insert(values.end(), vals->begin(), vals->end());
+    activities.push_back(act);
+};
+
+bool SnapshotWriter::write(const char * file) {
+
+    SnapshotHeader header;
+    uint64_t pos = 0;
+
+    index(postings.size());	// the header counts
+    index(values.size());
+    if (too_large)
+        return false;
+
+    memset(&header, 0, sizeof(header));
+    strncpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.byte_order = SNAPSHOT_BYTE_ORDER;
+    header.quantitative = quantitative;
+    header.nr_compounds = compounds.size();
+    header.nr_features = features.size();
+    header.nr_postings = postings.size();
+    header.nr_endpoints = endpoints.size();
+    header.nr_activities = activities.size();
+    header.nr_values = values.size();
+
+    // section layout
+    pos = sizeof(header);
+    header.strings_offset = pos = align8(pos);
+    header.strings_size = strings.size();
+    pos += strings.size();
+    header.compounds_offset = pos = align8(pos);
+    pos += compounds.size() * sizeof(SnapCompound);
+    header.features_offset = pos = align8(pos);
+    pos += features.size() * sizeof(SnapFeature);
+    header.postings_offset = pos = align8(pos);
+    pos += postings.size() * sizeof(int32_t);
+    header.endpoints_offset = pos = align8(pos);
+    pos += endpoints.size() * sizeof(uint32_t);
+    header.activities_offset = pos = align8(pos);
+    pos += activities.size() * sizeof(SnapActivity);
+    header.values_offset = pos = align8(pos);
+
+    FILE * fp = fopen(file, "wb");
+    if (fp == NULL)
+        return false;
+
+    pos = 0;
+    bool ok = write_section(fp, &header, sizeof(header), &pos) &&
+              write_section(fp, &strings[0], strings.size(), &pos) &&
+              write_section(fp, compounds.empty() ? NULL : &compounds[0], compounds.size() * sizeof(SnapCompound), &pos) &&
+              write_section(fp, features.empty() ? NULL : &features[0], features.size() * sizeof(SnapFeature), &pos) &&
+              write_section(fp, postings.empty() ? NULL : &postings[0], postings.size() * sizeof(int32_t), &pos) &&
+              write_section(fp, endpoints.empty() ? NULL : &endpoints[0], endpoints.size() * sizeof(uint32_t), &pos) &&
+              write_section(fp, activities.empty() ? NULL : &activities[0], activities.size() * sizeof(SnapActivity), &pos) &&
+              write_section(fp, values.empty() ? NULL : &values[0], values.size() * sizeof(float), &pos);
+
+    if (fclose(fp) != 0)
+        ok = false;
+
+    return ok;
+};
+
+// Snapshot
+
+bool Snapshot::section_ok(uint64_t offset, uint64_t nr, size_t record_size) {
+    return (offset % 8 == 0) && (offset <= size) && (nr * record_size <= size - offset);
+};
+
+// reads the whole file into buf, returns false on i/o errors
+static bool read_file(const char * file, vector<uint64_t> * buf, size_t * size) {
+
+    FILE * fp = fopen(file, "rb");
+    long end;
+
+    if (fp == NULL)
+        return false;
+    if (fseek(fp, 0, SEEK_END) != 0 || (end = ftell(fp)) < 0 || fseek(fp, 0, SEEK_SET) != 0) {
+        fclose(fp);
+        return false;
+    }
+
+    *size = end;
+    buf->resize(*size / sizeof(uint64_t) + 1);
+    bool ok = (*size == 0 || fread(&(*buf)[0], 1, *size, fp) == *size);
+    fclose(fp);
+    return ok;
+};
+
+Snapshot::Snapshot(const char * snapshot_file, shared_ptr<Out> out) {
+
+    if (!read_file(snapshot_file, &data, &size)) {
+        *out << "Cannot open " << snapshot_file << endl;
+        out->print_err();
+        exit(1);
+    }
+
+    *out << "Reading snapshot from " << snapshot_file << endl;
+    out->print_err();
+
+    const char * base = (const char *) &data[0];
+    header = (const SnapshotHeader *) base;
+
+    if (size < sizeof(SnapshotHeader) || strncmp(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic)) != 0) {
+        *out << snapshot_file << " is not a lazar snapshot ... exiting.\n";
+        out->print_err();
+        exit(1);
+    }
+
+    if (header->byte_order != SNAPSHOT_BYTE_ORDER || header->version != SNAPSHOT_VERSION) {
+        *out << snapshot_file << " has been written by an incompatible lazar version (snapshot version " << header->version << ", expected " << SNAPSHOT_VERSION << "). Please recreate it ... exiting.\n";
+        out->print_err();
+        exit(1);
+    }
+
+    if (!section_ok(header->strings_offset, header->strings_size, 1) ||
+        !section_ok(header->compounds_offset, header->nr_compounds, sizeof(SnapCompound)) ||
+        !section_ok(header->features_offset, header->nr_features, sizeof(SnapFeature)) ||
+        !section_ok(header->postings_offset, header->nr_postings, sizeof(int32_t)) ||
+        !section_ok(header->endpoints_offset, header->nr_endpoints, sizeof(uint32_t)) ||
+        !section_ok(header->activities_offset, header->nr_activities, sizeof(SnapActivity)) ||
+        !section_ok(header->values_offset, header->nr_values, sizeof(float)) ||
+        header->strings_size == 0) {
+        *out << snapshot_file << " is truncated ... exiting.\n";
+        out->print_err();
+        exit(1);
+    }
+
+    strings = base + header->strings_offset;
+    compounds = (const SnapCompound *) (base + header->compounds_offset);
+    features = (const SnapFeature *) (base + header->features_offset);
+    postings = (const int32_t *) (base + header->postings_offset);
+    endpoints = (const uint32_t *) (base + header->endpoints_offset);
+    activities = (const SnapActivity *) (base + header->activities_offset);
+    values = (const float *) (base + header->values_offset);
+
+    // validate all references once, so that the loaders can use them unchecked
+    bool ok = (strings[header->strings_size-1] == '\0');
+
+    for (uint32_t n = 0; ok && n < header->nr_compounds; n++) {
+        ok = compounds[n].id < header->strings_size && compounds[n].smiles < header->strings_size && compounds[n].inchi < header->strings_size;
+    }
+    for (uint32_t n = 0; ok && n < header->nr_features; n++) {
+        ok = features[n].name < header->strings_size && (uint64_t) features[n].first_posting + features[n].nr_postings <= header->nr_postings;
+    }
+    for (uint32_t n = 0; ok && n < header->nr_postings; n++) {
+        ok = postings[n] >= 0 && (uint32_t) postings[n] < header->nr_compounds;
+    }
+    for (uint32_t n = 0; ok && n < header->nr_endpoints; n++) {
+        ok = endpoints[n] < header->strings_size;
+    }
+    for (uint32_t n = 0; ok && n < header->nr_activities; n++) {
+        ok = activities[n].compound < header->nr_compounds && activities[n].endpoint < header->nr_endpoints &&
+             (uint64_t) activities[n].first_value + activities[n].nr_values <= header->nr_values;
+    }
+
+    if (!ok) {
+        *out << snapshot_file << " is corrupt ... exiting.\n";
+        out->print_err();
+        exit(1);
+    }
+};
@@ -0,0 +1,196 @@
+/* Copyright (C) 2005  Christoph Helma <helma@in-silico.de>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+
+*/
+
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <stdint.h>
+
+#include "boost/smart_ptr.hpp"
+#include "io.h"
+
+using namespace std;
+using namespace boost;
+
+// Binary training set snapshot
+//
+// A snapshot holds everything ActMolVect reads from the structure, activity and
+// feature files (ids, SMILES, InChIs, feature postings and activities) in one
+// binary file, so that no SMILES parsing, no InChI generation and no tokenizing
+// is needed at startup. The file is read into memory in one pass and its records
+// are copied into the training set objects; the buffer is released after loading.
+// Loading is therefore still linear in the size of the training set, and every
+// process holds its own copy of the training set.
+// All sections are 8 byte aligned arrays of the records below; strings are
+// stored NUL terminated in a common string table and referenced by their 32 bit
+// offset. Increase SNAPSHOT_VERSION whenever the layout changes.
+
+#define SNAPSHOT_MAGIC "LAZSNAP"
+#define SNAPSHOT_VERSION 1
+#define SNAPSHOT_BYTE_ORDER 0x01020304
+
+struct SnapshotHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint32_t quantitative;	// activities are log10 transformed regression values
+    uint32_t nr_compounds;
+    uint32_t nr_features;
+    uint32_t nr_postings;
+    uint32_t nr_endpoints;
+    uint32_t nr_activities;
+    uint32_t nr_values;
+    uint32_t reserved;
+    uint64_t strings_offset;
+    uint64_t strings_size;
+    uint64_t compounds_offset;
+    uint64_t features_offset;
+    uint64_t postings_offset;
+    uint64_t endpoints_offset;
+    uint64_t activities_offset;
+    uint64_t values_offset;
+};
+
+struct SnapCompound {
+    int32_t line_nr;
+    uint32_t id;	// string offsets
+    uint32_t smiles;
+    uint32_t inchi;
+};
+
+struct SnapFeature {
+    uint32_t name;
+    uint32_t first_posting;
+    uint32_t nr_postings;
+    uint32_t reserved;
+};
+
+//! activity values of one compound for one endpoint
+struct SnapActivity {
+    uint32_t compound;
+    uint32_t endpoint;
+    uint32_t first_value;
+    uint32_t nr_values;
+    uint32_t available;
+};
+
+//! collects a training set and writes it as snapshot
+class SnapshotWriter {
+
+private:
+
+    bool quantitative;
+    vector<char> strings;
+    vector<SnapCompound> compounds;
+    vector<SnapFeature> features;
+    vector<int32_t> postings;
+    vector<uint32_t> endpoints;
+    map<string, uint32_t> endpoint_nrs;
+    vector<SnapActivity> activities;
+    vector<float> values;
+    bool too_large;	// a string offset or record index does not fit into 32 bits
+
+    uint32_t add_string(const string & str);
+    uint32_t index(size_t nr);
+
+public:
+
+    SnapshotWriter(bool quantitative);
+
+    void add_compound(int line_nr, string id, string smiles, string inchi);
+    void add_feature(string name, vector<int> * matches);
+    void add_endpoint(string name);
+    //! add the values of compound comp_nr for endpoint (which has to be added before)
+    void add_activity(int comp_nr, string endpoint, vector<float> * vals, bool available);
+
+    //! true if the training set does not fit into the 32 bit offsets of a snapshot (write() fails)
+    bool is_too_large() {
+        return(too_large);
+    };
+
+    //! write the snapshot, returns false on i/o errors and for training sets that are too large
+    bool write(const char * file);
+};
+
+//! contents of a snapshot file, read into memory until the training set has been built from it
+class Snapshot {
+
+private:
+
+    vector<uint64_t> data;	// 8 byte aligned like the sections
+    size_t size;
+    const SnapshotHeader * header;
+    const char * strings;
+    const SnapCompound * compounds;
+    const SnapFeature * features;
+    const int32_t * postings;
+    const uint32_t * endpoints;
+    const SnapActivity * activities;
+    const float * values;
+
+    bool section_ok(uint64_t offset, uint64_t nr, size_t record_size);
+
+public:
+
+    //! read and check a snapshot file, exits on errors like the text file readers
+    Snapshot(const char * snapshot_file, shared_ptr<Out> out);
+
+    bool is_quantitative() {
+        return(header->quantitative != 0);
+    };
+
+    int get_nr_compounds() {
+        return(header->nr_compounds);
+    };
+    int get_nr_features() {
+        return(header->nr_features);
+    };
+    int get_nr_endpoints() {
+        return(header->nr_endpoints);
+    };
+    int get_nr_activities() {
+        return(header->nr_activities);
+    };
+
+    const SnapCompound * get_compound(int n) {
+        return(&compounds[n]);
+    };
+    const SnapFeature * get_feature(int n) {
+        return(&features[n]);
+    };
+    const int32_t * get_postings(const SnapFeature * feat) {
+        return(&postings[feat->first_posting]);
+    };
+    const char * get_endpoint(int n) {
+        return(get_string(endpoints[n]));
+    };
+    const SnapActivity * get_activity(int n) {
+        return(&activities[n]);
+    };
+    const float * get_values(const SnapActivity * act) {
+        return(&values[act->first_value]);
+    };
+    const char * get_string(uint32_t offset) {
+        return(&strings[offset]);
+    };
+};
+
+#endif